@@ -0,0 +1,1209 @@
+/* 
+   bench.cpp --- timings for the editor's hot paths
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+// Run with no arguments for every benchmark, or name the ones wanted:
+//   bench.exe highlight search
+// --mb=N sets the size of the generated log (1024 by default).
+// --threads=N is the most threads "parallel" tries (one per core by default).
+// --json=FILE writes every result there as JSON.
+// --compare=FILE compares them with a baseline written by --json and exits
+// with 2 if any is worse by more than --tolerance=PERCENT (10 by default).
+// --corpus=DIR only writes the texts the "file" benchmark uses into DIR.
+
+#include "edit.h"
+
+#include <chrono>
+#include <functional>
+
+typedef std::chrono::steady_clock bench_clock;
+
+double elapsed_us(bench_clock::time_point since)
+{
+	return std::chrono::duration < double, std::micro > (bench_clock::now() - since).count();
+}
+
+// Small deterministic generator so every run sees the same text
+unsigned long long bench_seed = 88172645463325252ULL;
+unsigned long long bench_rand()
+{
+	bench_seed ^= bench_seed << 13;
+	bench_seed ^= bench_seed >> 7;
+	bench_seed ^= bench_seed << 17;
+	return bench_seed;
+}
+
+// C-like source with comments, strings and numbers
+std::string make_source(size_t lines)
+{
+	const char *samples[] = {
+		"\tint value = %d;	// a trailing comment",
+		"\tif (value > %d && name != \"text\")",
+		"\t{",
+		"\t}",
+		"/* block comment opened and closed %d */",
+		"#define LIMIT %d",
+		"\treturn compute(value, 'c', %d);",
+		"",
+	};
+
+	std::string out;
+	char line[128];
+	for (size_t i = 0; i < lines; i++)
+	{
+		snprintf(line, sizeof(line), samples[bench_rand() % 8], (int)(bench_rand() % 100000));
+		out += line;
+		out += '\n';
+	}
+	return out;
+}
+
+size_t bench_mb = 1024;
+
+// Service log lines, the kind of file that gets searched
+std::string make_log(size_t bytes)
+{
+	const char *levels[] = { "INFO", "INFO", "INFO", "DEBUG", "WARN", "ERROR" };
+	const char *paths[] = { "/api/v1/items", "/api/v1/users", "/health", "/api/v2/orders", "/static/app.js" };
+
+	std::string out;
+	out.reserve(bytes + 256);
+	char line[256];
+	while (out.size() < bytes)
+	{
+		unsigned long long r = bench_rand();
+		snprintf(line, sizeof(line),
+			 "2024-05-%02llu %02llu:%02llu:%02llu %s [worker-%llu] request id=%llu path=%s status=%d took=%llums\n",
+			 r % 28 + 1, (r >> 5) % 24, (r >> 10) % 60, (r >> 16) % 60, levels[(r >> 22) % 6],
+			 (r >> 25) % 32, (r >> 30) % 1000000, paths[(r >> 50) % 5], ((r >> 53) % 8) ? 200 : 404,
+			 (r >> 56) % 250);
+		out += line;
+	}
+	return out;
+}
+
+double gb_per_s(size_t bytes, double us)
+{
+	return bytes / (us * 1000.0);
+}
+
+// Every figure a benchmark reports, by name, for --json and --compare.
+// Figures in a rate (a unit ending in /s) are better higher, the rest lower.
+struct Result
+{
+	std::string name;
+	double value;
+	std::string unit;
+};
+std::vector < Result > bench_results;
+
+// what a benchmark found broken, not merely slow; any fails the run
+size_t bench_failures = 0;
+
+double result(const std::string & name, double value, const char *unit)
+{
+	bench_results.push_back(Result { name, value, unit });
+	return value;
+}
+
+bool higher_is_better(const std::string & unit)
+{
+	return unit.size() > 2 && unit.compare(unit.size() - 2, 2, "/s") == 0;
+}
+
+// Scanning a whole log for a needle that is not there
+void bench_search()
+{
+	std::string log = make_log(bench_mb << 20);
+	Search::Chunks chunks = Search::chunks_of(log);
+
+	struct Case
+	{
+		const char *needle;
+		bool icase;
+		bool backward;
+	} cases[] = {
+		{"status=503", false, false},
+		{"request id=1234567", false, false},
+		{"Status=503", true, false},
+		{"TIMEOUT", true, false},
+		{"status=503", false, true},
+	};
+
+	for (const Case & c:cases)
+	{
+		Search::Literal lit(c.needle, c.icase);
+		auto start = bench_clock::now();
+		size_t at = c.backward ? Search::find_prev(chunks, lit, log.size())
+			: Search::find_next(chunks, lit, 0);
+		double us = elapsed_us(start);
+		printf("search: %-20s %-6s %-8s %6.2f GB/s%s\n", c.needle, c.icase ? "icase" : "exact",
+		       c.backward ? "backward" : "forward",
+		       result(std::string("search/") + c.needle + (c.icase ? "/icase" : "") + (c.backward ? "/backward" : ""),
+			      gb_per_s(log.size(), us), "GB/s"),
+		       at == std::string::npos ? "" : " (found early)");
+	}
+}
+
+size_t bench_threads = std::thread::hardware_concurrency();
+
+// Count All and a search for a late match on 1, 2, 4 ... N threads
+void bench_parallel()
+{
+	std::string log = make_log(bench_mb << 20);
+	Search::Chunks chunks = Search::chunks_of(log);
+	Search::Literal common("status=404", false);
+	Search::Literal late(log.substr(log.size() - 64, 40), false);	// only at the end
+
+	std::vector < size_t > counts;
+	for (size_t t = 1; t < bench_threads; t *= 2)
+		counts.push_back(t);
+	counts.push_back(std::max < size_t > (bench_threads, 1));
+
+	double base = 0;
+	for (size_t t:counts)
+	{
+		WorkerPool pool(t);
+
+		size_t n = 0;
+		auto start = bench_clock::now();
+		Search::scan(chunks, common, 0, log.size(), pool,[&](size_t)
+			     {
+				     n++;
+				     return true;
+			     });
+		double count_us = elapsed_us(start);
+
+		size_t at = std::string::npos;
+		start = bench_clock::now();
+		Search::scan(chunks, late, 0, log.size(), pool,[&](size_t pos)
+			     {
+				     at = pos;
+				     return false;
+			     });
+		double find_us = elapsed_us(start);
+
+		if (base == 0)
+			base = count_us;
+		printf("parallel: %2zu threads: count all %6.2f GB/s (%zu matches, x%.2f), late find %6.2f GB/s%s\n", t,
+		       result("parallel/" + std::to_string(t) + "/count", gb_per_s(log.size(), count_us), "GB/s"), n,
+		       base / count_us, result("parallel/" + std::to_string(t) + "/find", gb_per_s(log.size(), find_us), "GB/s"),
+		       at == std::string::npos ? " (not found!)" : "");
+	}
+}
+
+// Time each keystroke of an incremental search takes before the screen
+// can be drawn, typing a query and then taking it back
+void bench_isearch()
+{
+	std::string log = make_log(bench_mb << 20);
+	const std::string query = "path=/health status=404 took=1";
+
+	Search::Incremental inc(log, log.size() / 2, false);
+	std::string typed;
+	double worst = 0, total = 0;
+	int keys = 0;
+
+	auto key =[&](const char *what)
+	{
+		auto start = bench_clock::now();
+		Search::Incremental::State state = inc.update(typed);
+		double us = elapsed_us(start);
+		worst = std::max(worst, us);
+		total += us;
+		keys++;
+		printf("isearch: %-6s %-32s %8.1f us %s\n", what, ("\"" + typed + "\"").c_str(), us,
+		       state == Search::Incremental::FOUND ? "found" :
+		       state == Search::Incremental::PENDING ? "pending" : "no match");
+	};
+
+	for (char c:query)
+	{
+		typed += c;
+		key("type");
+		// a fast typist, the prompt polls while waiting for the next key
+		for (int tick = 0; tick < 4; tick++)
+		{
+			std::this_thread::sleep_for(std::chrono::milliseconds(30));
+			inc.poll();
+		}
+	}
+	while (typed.size() > 1)
+	{
+		typed.pop_back();
+		key("erase");
+	}
+	printf("isearch: %d keys: avg %.1f us, worst %.1f us (frame is 16667 us)\n", keys,
+	       result("isearch/avg", total / keys, "us"), result("isearch/worst", worst, "us"));
+}
+
+// Regex scans that never match, so they cover the whole log, and a pattern
+// that makes backtracking engines take exponential time
+void bench_regex()
+{
+	std::string log = make_log(bench_mb << 20);
+	Search::Chunks chunks = Search::chunks_of(log);
+
+	const char *patterns[] = {
+		"status=50[0-9]",
+		"(GET|POST) /api/v[0-9]+",
+		"^2024-06-\\d\\d",
+		"ERROR.*took=9\\d\\dms",
+	};
+
+	for (const char *pattern:patterns)
+	{
+		Search::Regex re(pattern, false);
+		size_t pos, len;
+		auto start = bench_clock::now();
+		bool found = re.find(chunks, 0, pos, len);
+		double us = elapsed_us(start);
+		printf("regex: %-24s %6.2f GB/s%s\n", pattern,
+		       result(std::string("regex/") + pattern, gb_per_s(log.size(), us), "GB/s"), found ? " (found early)" : "");
+	}
+
+	for (size_t n = 1000; n <= 1000000; n *= 10)
+	{
+		std::string text(n, 'x');
+		Search::Regex re("(x+x+)+y", false);
+		size_t pos, len;
+		auto start = bench_clock::now();
+		re.find(Search::chunks_of(text), 0, pos, len);
+		printf("regex: (x+x+)+y over %7zu x's: %10.1f us\n", n,
+		       result("regex/(x+x+)+y/" + std::to_string(n), elapsed_us(start), "us"));
+	}
+}
+
+// Replace All over the log, one match in every eight lines or so: finding
+// the matches, rebuilding the buffer, and undoing it again
+void bench_replace()
+{
+	filename = "bench.log";
+	filebuf = make_log(bench_mb << 20);
+	buffer_reset();
+
+	Search::query = "status=404";
+	Search::match_case = true;
+	Search::use_regex = false;
+
+	const char *texts[] = { "status=410", "status=404 retried=1", "" };
+	for (const char *text:texts)
+	{
+		std::vector < size_t > at, lens;
+		auto start = bench_clock::now();
+		Search::matches(0,[&](size_t pos, size_t len)
+				{
+					at.push_back(pos);
+					lens.push_back(len);
+					return true;
+				});
+		double find_us = elapsed_us(start);
+
+		start = bench_clock::now();
+		buffer_replace(at, lens, text);
+		double replace_us = elapsed_us(start);
+
+		start = bench_clock::now();
+		buffer_undo();
+		double undo_us = elapsed_us(start);
+
+		printf("replace: %zu x \"%s\": find %.0f ms, replace %.0f ms, total %.0f ms, undo %.0f ms\n", at.size(),
+		       text, find_us / 1000, replace_us / 1000,
+		       result(std::string("replace/") + text, (find_us + replace_us) / 1000, "ms"), undo_us / 1000);
+	}
+}
+
+// A fixed-width file of 100k lines and a block 10 columns wide down all of
+// it: typing, erasing, copying and pasting it are one pass each. Typing
+// into the first few thousand lines one insert at a time, as the keyboard
+// would, shows what that saves.
+void bench_block()
+{
+	const size_t lines = 100000;
+	filename = "bench.dat";
+	filebuf.clear();
+	char row[96];
+	for (size_t i = 0; i < lines; i++)
+	{
+		snprintf(row, sizeof(row), "%08zu %-20s %12.2f %-30s\n", i, (i % 3) ? "ACTIVE" : "CLOSED", i * 1.25,
+			 "fixed width record");
+		filebuf += row;
+	}
+	buffer_reset();
+
+	Block::Rect r = { 0, lines - 1, 9, 19 };
+	auto time =[&](const char *what, std::function < void () > run)
+	{
+		auto start = bench_clock::now();
+		run();
+		printf("block: %-40s %10.1f ms\n", what, result(std::string("block/") + what, elapsed_us(start) / 1000, "ms"));
+	};
+
+	time("type a key on 100k lines",[&]()
+	     {
+		     Block::type(r, "|");
+	     });
+	time("undo it",[&]()
+	     {
+		     buffer_undo();
+	     });
+	time("erase 10 columns of 100k lines",[&]()
+	     {
+		     Block::erase(r);
+	     });
+	time("undo it",[&]()
+	     {
+		     buffer_undo();
+	     });
+	std::string rows;
+	time("copy 10 columns of 100k lines",[&]()
+	     {
+		     rows = Block::text(r);
+	     });
+	time("paste them at column 0",[&]()
+	     {
+		     Block::paste(0, 0, rows);
+	     });
+	time("type a key on 5k lines, one at a time",[&]()
+	     {
+		     for (size_t i = 0; i < 5000; i++)
+			     buffer_insert(buflines.start(i) + 9, "|");
+	     });
+}
+
+// Quick open over a million paths made up in memory, typed a key at a
+// time: every key should come back within a frame
+void bench_quickopen()
+{
+	const char *words[] = { "core", "util", "net", "http", "server", "client", "parser", "render", "widget",
+		"model", "view", "store", "cache", "index", "buffer", "stream", "event", "codec", "image", "config"
+	};
+	const char *exts[] = { "cpp", "h", "py", "js", "md", "txt" };
+	const size_t n_words = sizeof(words) / sizeof(words[0]);
+
+	QuickOpen::Segments segments;
+	std::shared_ptr < QuickOpen::Segment > seg;
+	unsigned seed = 12345;
+	auto next =[&]()
+	{
+		seed = seed * 1103515245 + 12345;
+		return (seed >> 16) & 0x7fff;
+	};
+
+	auto start = bench_clock::now();
+	for (size_t i = 0; i < 1000000; i++)
+	{
+		if (i % 65536 == 0)
+		{
+			seg = std::make_shared < QuickOpen::Segment > ();
+			segments.push_back(seg);
+		}
+		if (i % 20 == 0 || seg->dirs.empty())	// a directory of twenty files
+		{
+			std::string dir = std::string(words[next() % n_words]) + "/" + words[next() % n_words] + "/" +
+				words[next() % n_words] + std::to_string(i / 20 % 97);
+			seg->dirs.push_back((uint32_t) seg->arena.size());
+			seg->arena.append(dir).push_back('\0');
+		}
+		std::string name = std::string(words[next() % n_words]) + "_" + words[next() % n_words] +
+			std::to_string(i % 50) + "." + exts[next() % 6];
+		const char *dir = seg->arena.data() + seg->dirs.back();
+		QuickOpen::Segment::File f;
+		f.dir = (uint32_t) seg->dirs.size() - 1;
+		f.name = (uint32_t) seg->arena.size();
+		f.mask = QuickOpen::mask_of(dir, strlen(dir)) | QuickOpen::mask_of(name.data(), name.size());
+		seg->arena.append(name).push_back('\0');
+		seg->files.push_back(f);
+	}
+	printf("quickopen: 1M paths made in %.0f ms\n", elapsed_us(start) / 1000);
+
+	QuickOpen::Finder finder;
+	std::vector < QuickOpen::Result > results;
+	std::string query;
+	for (char c:std::string("srvcfgidx"))
+	{
+		query += c;
+		start = bench_clock::now();
+		size_t matched = finder.search(segments, 0, query, 50, results);
+		printf("quickopen: %-10s %8zu matches %8.2f ms  %s\n", query.c_str(), matched,
+		       result("quickopen/" + query, elapsed_us(start) / 1000, "ms"),
+		       results.empty()? "" : QuickOpen::path(segments, results[0]).c_str());
+	}
+}
+
+// Copying half the log, typing before it, and pasting it twice, then
+// cutting it: copy and the typing should not depend on its size
+void bench_registers()
+{
+	filename = "bench.log";
+	filebuf = make_log(bench_mb << 20);
+	buffer_reset();
+
+	size_t from = filebuf.size() / 4, len = filebuf.size() / 2;
+	Registers::current = 'a';
+
+	auto time =[&](const char *what, std::function < void () > run)
+	{
+		auto start = bench_clock::now();
+		run();
+		printf("registers: %-34s %10.1f us\n", what, result(std::string("registers/") + what, elapsed_us(start), "us"));
+	};
+
+	char what[64];
+	snprintf(what, sizeof(what), "copy %zu MB", len >> 20);
+	time(what,[&]()
+	     {
+		     Registers::copy(from, len);
+	     });
+	time("type a key before the copied text",[&]()
+	     {
+		     buffer_insert(0, "x");
+	     });
+	time("paste it at the end",[&]()
+	     {
+		     Registers::paste(filebuf.size());
+	     });
+	time("paste it again",[&]()
+	     {
+		     Registers::paste(filebuf.size());
+	     });
+	snprintf(what, sizeof(what), "cut %zu MB", len >> 20);
+	time(what,[&]()
+	     {
+		     Registers::cut(from + 1, len);
+	     });
+}
+
+// Cost of one keystroke: the edit plus highlighting what is on screen
+void bench_highlight()
+{
+	const size_t lines = 100000;
+	const size_t rows = 50;
+	const size_t top = lines / 2;
+
+	filename = "bench.c";
+	filebuf = make_source(lines);
+	buffer_reset();
+
+	auto keystroke =[&](size_t pos, const std::string & text, size_t first)
+	{
+		auto start = bench_clock::now();
+		buffer_insert(pos, text);
+		Highlight::prepare(first + rows - 1);
+		for (size_t y = first; y < first + rows; y++)
+			Highlight::colorize(y, filebuf.data() + buflines.start(y), buflines.length(y), 0, 80);
+		return elapsed_us(start);
+	};
+
+	// first paint of the middle of the file lexes everything above it once
+	auto start = bench_clock::now();
+	Highlight::prepare(top + rows - 1);
+	printf("highlight: first paint at line %zu: %.1f us (%zu lines lexed)\n", top, elapsed_us(start),
+	       Highlight::lexed_lines());
+
+	// typing inside a visible line
+	double total = 0, worst = 0;
+	const int keys = 1000;
+	for (int i = 0; i < keys; i++)
+	{
+		size_t before = Highlight::lexed_lines();
+		double t = keystroke(buflines.start(top + 10) + 1, "x", top);
+		total += t;
+		worst = std::max(worst, t);
+		if (i == keys - 1)
+			printf("highlight: lines lexed by the last keystroke: %zu\n", Highlight::lexed_lines() - before);
+	}
+	printf("highlight: typing, %d keys: avg %.2f us, worst %.2f us\n", keys,
+	       result("highlight/typing/avg", total / keys, "us"), result("highlight/typing/worst", worst, "us"));
+
+	// opening a block comment changes every line below it, but only the
+	// visible ones get lexed
+	size_t before = Highlight::lexed_lines();
+	double t = keystroke(buflines.start(top + 5), "/*", top);
+	printf("highlight: open block comment on screen: %.2f us (%zu lines lexed)\n", t,
+	       Highlight::lexed_lines() - before);
+
+	before = Highlight::lexed_lines();
+	t = keystroke(buflines.start(top + 5), "*/", top);
+	printf("highlight: close it again: %.2f us (%zu lines lexed)\n", t, Highlight::lexed_lines() - before);
+}
+
+// Frames of a minified JSON file that is one 200 MB line: coloring what a
+// screen shows of it at its start, middle and end, against the whole line
+void bench_longline()
+{
+	const size_t bytes = 200 << 20;
+	const size_t width = 200;
+
+	filename = "bench.json";
+	filebuf.clear();
+	filebuf.reserve(bytes + 256);
+	char item[128];
+	while (filebuf.size() < bytes)
+	{
+		snprintf(item, sizeof(item), "{\"id\":%llu,\"name\":\"item %llu\",\"tags\":[\"a\",\"b\"],\"ok\":true},",
+			 bench_rand() % 1000000, bench_rand() % 1000);
+		filebuf += item;
+	}
+	buffer_reset();
+	size_t len = buflines.length(0);
+
+	auto start = bench_clock::now();
+	Highlight::prepare(0);
+	printf("longline: %zu MB line lexed once: %.1f ms\n", len >> 20, elapsed_us(start) / 1000);
+
+	for (size_t at : { (size_t)0, len / 2, len - width })
+	{
+		start = bench_clock::now();
+		const int frames = 1000;
+		for (int i = 0; i < frames; i++)
+			Highlight::colorize(0, filebuf.data(), len, at + i % 64, at + i % 64 + width);
+		printf("longline: frame at byte %zu: %.2f us\n", at,
+		       result("longline/frame/" + std::to_string(at), elapsed_us(start) / frames, "us"));
+	}
+
+	// what every frame cost when the whole line was colored
+	start = bench_clock::now();
+	Highlight::colorize(0, filebuf.data(), len, 0, len);
+	printf("longline: the whole line colored: %.1f ms\n", elapsed_us(start) / 1000);
+
+	// a line that is one block comment has its marks inside it too
+	filename = "bench.c";
+	filebuf = "int x; /* ";
+	while (filebuf.size() < bytes)
+		filebuf += "commented out ";
+	filebuf += "*/ int y;\n";
+	buffer_reset();
+	len = buflines.length(0);
+	Highlight::prepare(0);
+	for (size_t at : { (size_t)0, len / 2, len - width })
+	{
+		start = bench_clock::now();
+		const int frames = 1000;
+		for (int i = 0; i < frames; i++)
+			Highlight::colorize(0, filebuf.data(), len, at + i % 64, at + i % 64 + width);
+		printf("longline: frame in a comment at byte %zu: %.2f us\n", at,
+		       result("longline/comment/" + std::to_string(at), elapsed_us(start) / frames, "us"));
+	}
+}
+
+// A message box over 200000 I/O errors: what opening it and paging
+// through it lay out, against wrapping all of it as opening one did
+void bench_dialog()
+{
+	std::string message;
+	char line[128];
+	for (int i = 0; i < 200000; i++)
+	{
+		snprintf(line, sizeof(line), "I/O error occurred while reading the file \"/var/log/app/part%d.log\".\n", i);
+		message += line;
+	}
+
+	const size_t width = 116, rows = 40;
+	char shown[width];
+	std::string_view row;
+
+	auto start = bench_clock::now();
+	WrappedText text(message, width);
+	for (size_t i = 0; i < rows && text.row(i, row); i++)
+		WrappedText::shown(row, shown);
+	printf("dialog: %zu MB message, first screen: %.1f us\n", message.size() >> 20,
+	       result("dialog/first screen", elapsed_us(start), "us"));
+
+	start = bench_clock::now();
+	size_t top = 0;
+	for (int page = 0; page < 100; page++)
+	{
+		top += rows;
+		for (size_t i = 0; i < rows && text.row(top + i, row); i++)
+			WrappedText::shown(row, shown);
+	}
+	printf("dialog: a page down: %.1f us\n", result("dialog/page down", elapsed_us(start) / 100, "us"));
+
+	start = bench_clock::now();
+	WrappedText all(message, width);
+	size_t count = 0;
+	while (all.row(count, row))
+		count++;
+	printf("dialog: all %zu rows laid out: %.1f ms\n", count, elapsed_us(start) / 1000);
+}
+
+// Scripted edits over 256 files in place, one thread and then one per
+// core, against sed -i doing the same: the script swaps a status and sed
+// swaps it back, so both find as many matches and write every file
+void bench_batch()
+{
+	std::filesystem::path dir = std::filesystem::temp_directory_path() / "edit-bench-batch";
+	std::filesystem::create_directories(dir);
+	size_t each = (std::min < size_t > (bench_mb, 256) << 20) / 256;
+	std::vector < std::string > files;
+	std::string list;
+	for (int i = 0; i < 256; i++)
+	{
+		files.push_back((dir / ("part" + std::to_string(i) + ".log")).string());
+		writefile(files.back(), make_log(each));
+		list += " \"" + files.back() + "\"";
+	}
+
+	for (size_t jobs = 1;; jobs = std::max < size_t > (bench_threads, 1))
+	{
+		std::vector < std::string > args = { "-j", std::to_string(jobs), "-e", "s/status=404/status=410/g",
+			"-e", "write"
+		};
+		args.insert(args.end(), files.begin(), files.end());
+		std::vector < char *>argv;
+		for (std::string & arg:args)
+			argv.push_back(&arg[0]);
+
+		auto start = bench_clock::now();
+		Batch::run(argv.size(), argv.data());
+		double batch_us = elapsed_us(start);
+
+		start = bench_clock::now();
+		int status = system(("sed -i 's/status=410/status=404/g'" + list).c_str());
+		double sed_us = elapsed_us(start);
+
+		double mb = (double)(each * files.size()) / (1 << 20);
+		printf("batch: 256 files, %.0f MB, %zu thread(s): %.0f ms (%.0f MB/s)", mb, jobs, batch_us / 1000,
+		       result("batch/" + std::to_string(jobs), mb / (batch_us / 1e6), "MB/s"));
+		if (status == 0)
+			printf(", sed -i %.0f ms (%.0f MB/s)\n", sed_us / 1000, mb / (sed_us / 1e6));
+		else
+			printf(", sed could not be run\n");
+		if (jobs >= bench_threads)
+			break;
+	}
+
+	std::error_code ec;
+	std::filesystem::remove_all(dir, ec);
+}
+
+// A log followed while it grows by 100 MB/s, taken in as the screen does,
+// every 100 ms or at once while a burst is still going in: how long that
+// holds up a frame, and whether it keeps up
+void bench_follow()
+{
+	std::string path = (std::filesystem::temp_directory_path() / "edit-bench-follow.log").string();
+	filebuf = make_log(4 << 20);
+	writefile(path, filebuf);
+	filename = path;
+	buffer_reset();
+	size_t start_size = filebuf.size();
+	size_t mb = std::min < size_t > (bench_mb, 512);
+
+	Stream::follow(path, filebuf.size());
+	std::string chunk = make_log(1 << 20);
+	std::atomic < bool > writing(true);
+	std::thread writer([&]()
+			   {
+				   FILE * f = fopen(path.c_str(), "ab");
+				   auto begin = bench_clock::now();
+				   for (size_t i = 0; f != NULL && i < mb; i++)
+				   {
+					   fwrite(chunk.data(), 1, chunk.size(), f);
+					   fflush(f);
+					   std::this_thread::sleep_until(begin + std::chrono::milliseconds(10 * (i + 1)));
+				   }
+				   if (f != NULL)
+					   fclose(f);
+				   writing = false;
+			   });
+
+	auto begin = bench_clock::now();
+	double worst = 0, sum = 0;
+	size_t takes = 0;
+	while ((writing || filebuf.size() < start_size + mb * chunk.size()) && elapsed_us(begin) < 60e6)
+	{
+		auto start = bench_clock::now();
+		Stream::take();
+		double us = elapsed_us(start);
+		worst = std::max(worst, us);
+		sum += us;
+		takes++;
+		if (!Stream::pending())
+			std::this_thread::sleep_for(std::chrono::milliseconds(100));
+	}
+	double seconds = elapsed_us(begin) / 1e6;
+	writer.join();
+	Stream::close();
+
+	printf("follow: %zu MB appended at 100 MB/s, %zu MB taken in %.1f s: %zu takes, worst %.1f ms, mean %.1f ms\n",
+	       mb, (filebuf.size() - start_size) >> 20, seconds, takes, result("follow/worst", worst / 1000, "ms"),
+	       result("follow/mean", sum / takes / 1000, "ms"));
+	std::error_code ec;
+	std::filesystem::remove(path, ec);
+}
+
+// What a traced scope costs, alone and on four threads at once, and what
+// writing out the trace takes; nothing to time unless built with USE_TRACE
+void bench_trace()
+{
+#if USE_TRACE
+	const int scopes = 10000000;
+	volatile int sink = 0;
+
+	auto start = bench_clock::now();
+	for (int i = 0; i < scopes; i++)
+		sink = sink + 1;
+	double bare = elapsed_us(start);
+
+	start = bench_clock::now();
+	for (int i = 0; i < scopes; i++)
+	{
+		TRACE_SCOPE("bench");
+		sink = sink + 1;
+	}
+	double traced = elapsed_us(start);
+	printf("trace: a scope: %.1f ns\n", result("trace/scope", (traced - bare) * 1000 / scopes, "ns"));
+
+	start = bench_clock::now();
+	std::vector < std::thread > threads;
+	for (int t = 0; t < 4; t++)
+		threads.emplace_back([&]
+				     {
+				     for (int i = 0; i < scopes / 4; i++)
+				     {
+				     TRACE_SCOPE("bench"); sink = sink + 1;}
+				     });
+	for (std::thread & t:threads)
+		t.join();
+	printf("trace: a scope on 4 threads: %.1f ns\n",
+	       result("trace/scope/4 threads", (elapsed_us(start) - bare) * 1000 / scopes, "ns"));
+
+	std::string path = (std::filesystem::temp_directory_path() / "edit-bench-trace.json").string();
+	start = bench_clock::now();
+	bool written = Trace::dump(path);
+	printf("trace: writing it out: %.1f ms%s\n", result("trace/dump", elapsed_us(start) / 1000, "ms"),
+	       written ? "" : " (could not be written)");
+	std::filesystem::remove(path);
+#else
+	printf("trace: built without USE_TRACE, so a scope is nothing\n");
+#endif
+}
+
+#if defined(_WIN32)
+#define NULL_DEVICE "NUL"
+#else
+#define NULL_DEVICE "/dev/null"
+#endif
+extern WINDOW *menuBar, *textArea, *statusBar;
+
+// Whole frames of a C file drawn into a terminal that goes nowhere, at
+// the top, in the middle with a selection and Find All's matches, and on
+// a wide screen: after the first, drawing one should allocate nothing
+void bench_frame()
+{
+	FILE *out = fopen(NULL_DEVICE, "w"), *in = fopen(NULL_DEVICE, "r");
+	SCREEN *screen = (out && in) ? newterm("xterm", out, in) : NULL;
+	if (screen == NULL)
+	{
+		printf("frame: no terminal could be made to draw into\n");
+		return;
+	}
+
+	filebuf = make_source(100000);
+	filename = "bench/some/rather/deep/directory/of/sources/frame.c";
+	buffer_reset();
+	Search::query = "value";
+	Search::match_case = true;
+	Search::use_regex = false;
+	find_all(true);
+
+	struct Case
+	{
+		const char *what;
+		int columns;
+		size_t line;
+		bool select;
+	} cases[] = {
+		{"top", 100, 0, false},
+		{"middle, selecting", 100, 50000, true},
+		{"400 columns", 400, 90000, false},
+	};
+
+	for (const Case & c:cases)
+	{
+		menuBar = newwin(1, c.columns, 0, 0);
+		textArea = newwin(40, c.columns, 1, 0);
+		statusBar = newwin(1, c.columns, 41, 0);
+		jump_to(buflines.start(c.line));
+		selection_mark = c.select ? buflines.start(c.line - 10) : std::string::npos;
+
+		draw_frame();	// the first lexes and lays out
+		const int frames = 200;
+		unsigned long long before = Memory::allocations();
+		auto start = bench_clock::now();
+		for (int i = 0; i < frames; i++)
+			draw_frame();
+		double us = elapsed_us(start) / frames;
+		unsigned long long allocations = Memory::allocations() - before;
+
+		printf("frame: %-18s %8.1f us, %llu allocations a frame%s, arena %zu of %zu bytes\n", c.what,
+		       result(std::string("frame/") + c.what, us, "us"),
+		       (unsigned long long)result(std::string("frame/") + c.what + "/allocations",
+						  (double)allocations / frames, "allocations"),
+		       allocations ? "  FAILED, should be none" : "", Frame::used(), Frame::capacity());
+		bench_failures += allocations != 0;
+
+		delwin(menuBar);
+		delwin(textArea);
+		delwin(statusBar);
+	}
+	selection_mark = std::string::npos;
+	endwin();
+	delscreen(screen);
+	fclose(out);
+	fclose(in);
+}
+
+// The texts the file benchmark reads and writes, made the same on every
+// run whatever ran before: many short lines, lines of kilobytes, a log
+// with CRLF line ends, text that is mostly multibyte UTF-8, and the log
+// (--mb=N, 1 GB by default)
+const char *corpus_kinds[] = { "short", "long", "crlf", "utf8", "log" };
+
+std::string make_corpus(const std::string & kind)
+{
+	unsigned long long seed = bench_seed;
+	bench_seed = 0x2545f4914f6cdd1dULL ^ std::hash < std::string > ()(kind);
+
+	size_t bytes = std::min < size_t > (bench_mb, 64) << 20;
+	std::string out;
+	out.reserve(bytes + 65536);
+	if (kind == "short")
+	{
+		const char *words[] = { "a", "if", "the", "end", "else", "value", "return", "}" };
+		while (out.size() < bytes)
+		{
+			for (unsigned long long n = bench_rand() % 4; n > 0; n--)
+			{
+				out += words[bench_rand() % 8];
+				out += ' ';
+			}
+			out += '\n';
+		}
+	}
+	else if (kind == "long")
+	{
+		while (out.size() < bytes)
+		{
+			for (unsigned long long n = 2048 + bench_rand() % 16384; n > 0; n--)
+				out += "{\"k\":1},"[bench_rand() % 8];
+			out += '\n';
+		}
+	}
+	else if (kind == "crlf")
+	{
+		std::string log = make_log(bytes);
+		for (char c:log)
+		{
+			if (c == '\n')
+				out += '\r';
+			out += c;
+		}
+	}
+	else if (kind == "utf8")
+	{
+		const char *words[] = { "текст", "строка", "文字列", "編集", "ändern", "ελληνικά", "😀", "ok" };
+		while (out.size() < bytes)
+		{
+			for (unsigned long long n = 1 + bench_rand() % 12; n > 0; n--)
+			{
+				out += words[bench_rand() % 8];
+				out += ' ';
+			}
+			out += '\n';
+		}
+	}
+	else
+		out = make_log(bench_mb << 20);
+
+	bench_seed = seed;
+	return out;
+}
+
+// Writing every corpus and reading it back, and the line lookups the old
+// display used on each: finding the last line, a screen from the middle,
+// the last line alone, and a screen of it wrapped as a message box does
+void bench_file()
+{
+	for (const char *kind:corpus_kinds)
+	{
+		std::string text = make_corpus(kind);
+		std::string path = (std::filesystem::temp_directory_path() / ("edit-bench-" + std::string(kind) + ".txt")).string();
+		std::string name = std::string("file/") + kind + "/";
+
+		try
+		{
+			auto start = bench_clock::now();
+			writefile(path, text);
+			double write_us = elapsed_us(start);
+
+			std::string back;
+			start = bench_clock::now();
+			readfile(path, back);
+			double read_us = elapsed_us(start);
+			std::filesystem::remove(path);
+
+			double write = result(name + "write", gb_per_s(text.size(), write_us), "GB/s");
+			double read = result(name + "read", gb_per_s(text.size(), read_us), "GB/s");
+			printf("file: %-5s %5zu MB: write %6.2f GB/s, read %6.2f GB/s%s\n", kind, text.size() >> 20, write, read,
+			       back == text ? "" : " (differs!)");
+		}
+		catch(const std::runtime_error & ex)
+		{
+			std::filesystem::remove(path);
+			printf("file: %-5s could not be written: %s\n", kind, ex.what());
+		}
+
+		// the best of a few runs, so that --compare sees the code and
+		// not the noise
+		auto best =[](std::function < void () > run)
+		{
+			double fastest = 0;
+			for (int i = 0; i < 5; i++)
+			{
+				auto start = bench_clock::now();
+				run();
+				double us = elapsed_us(start);
+				fastest = (i == 0) ? us : std::min(fastest, us);
+			}
+			return fastest;
+		};
+
+		size_t lines = std::count(text.begin(), text.end(), '\n');
+		size_t last = 0;
+		double us = best([&]
+				 {
+				 last = getNthDelimWithOffset(text, lines, 0);});
+		printf("file: %-5s %9zu lines: last found at byte %zu, %6.2f GB/s\n", kind, lines, last,
+		       result(name + "getNthDelimWithOffset", gb_per_s(last, us), "GB/s"));
+
+		us = best([&]
+			  {
+			  std::vector < std::string > screen; extractLinesFromBuf(screen, text, lines / 2, 40);});
+		printf("file: %-5s 40 lines from the middle: %10.1f us\n", kind, result(name + "extractLinesFromBuf", us, "us"));
+
+		us = best([&]
+			  {
+			  std::string line; extractSingleLineFromBuf(line, text, lines);});
+		printf("file: %-5s the last line alone: %10.1f us\n", kind, result(name + "extractSingleLineFromBuf", us, "us"));
+
+		us = best([&]
+			  {
+			  char shown[80];
+			  std::string_view row;
+			  WrappedText wrapped(text, sizeof(shown));
+			  for (size_t i = 0; i < 40 && wrapped.row(i, row); i++)
+			  WrappedText::shown(row, shown);});
+		printf("file: %-5s a screen wrapped at 80: %10.1f us\n", kind, result(name + "wrap", us, "us"));
+	}
+}
+
+// The results as JSON, one result to a line
+void write_json(FILE * out)
+{
+	fprintf(out, "{\"results\": [\n");
+	for (size_t i = 0; i < bench_results.size(); i++)
+	{
+		std::string name;
+		for (char c:bench_results[i].name)
+		{
+			if (c == '"' || c == '\\')
+				name += '\\';
+			name += c;
+		}
+		fprintf(out, "  {\"name\": \"%s\", \"value\": %.6g, \"unit\": \"%s\"}%s\n", name.c_str(),
+			bench_results[i].value, bench_results[i].unit.c_str(), i + 1 < bench_results.size()? "," : "");
+	}
+	fprintf(out, "]}\n");
+}
+
+// A string member of a result line as written above
+bool json_field(const std::string & line, const char *key, std::string & value)
+{
+	size_t at = line.find("\"" + std::string(key) + "\": ");
+	if (at == std::string::npos)
+		return false;
+	at += strlen(key) + 4;
+	value.clear();
+	if (line[at] != '"')
+	{
+		value = line.substr(at, line.find_first_of(",}", at) - at);
+		return true;
+	}
+	for (at++; at < line.size() && line[at] != '"'; at++)
+	{
+		if (line[at] == '\\')
+			at++;
+		value += line[at];
+	}
+	return true;
+}
+
+// Every result the baseline has too and how far it moved; one worse by
+// more than tolerance percent is a regression. The count of them.
+size_t compare(const std::string & baseline, double tolerance)
+{
+	std::ifstream in(baseline);
+	if (!in)
+	{
+		printf("compare: cannot read %s\n", baseline.c_str());
+		return 1;
+	}
+
+	std::vector < Result > before;
+	std::string line, name, value, unit;
+	while (std::getline(in, line))
+	{
+		if (json_field(line, "name", name) && json_field(line, "value", value) && json_field(line, "unit", unit))
+			before.push_back(Result { name, strtod(value.c_str(), NULL), unit });
+	}
+
+	size_t regressions = 0;
+	for (const Result & now:bench_results)
+	{
+		for (const Result & was:before)
+		{
+			if (was.name != now.name || was.unit != now.unit)
+				continue;
+			// from nothing, any at all is worse
+			double change = (was.value > 0) ? (now.value - was.value) / was.value * 100 :
+				(now.value > was.value) ? 100 : 0;
+			double worse = higher_is_better(now.unit) ? -change : change;
+			bool regressed = worse > tolerance || (was.value <= 0 && worse > 0);
+			regressions += regressed;
+			printf("compare: %-48s %10.4g -> %10.4g %s %+7.1f%%%s\n", now.name.c_str(), was.value, now.value,
+			       now.unit.c_str(), change, regressed ? "  REGRESSION" : "");
+		}
+	}
+	printf("compare: %zu regression(s) past %.0f%% against %s\n", regressions, tolerance, baseline.c_str());
+	return regressions;
+}
+
+struct Benchmark
+{
+	const char *name;
+	std::function < void () > run;
+};
+
+int main(int argc, char **argv)
+{
+	std::vector < Benchmark > benchmarks = {
+		{"highlight", bench_highlight},
+		{"search", bench_search},
+		{"regex", bench_regex},
+		{"parallel", bench_parallel},
+		{"isearch", bench_isearch},
+		{"replace", bench_replace},
+		{"registers", bench_registers},
+		{"block", bench_block},
+		{"quickopen", bench_quickopen},
+		{"longline", bench_longline},
+		{"dialog", bench_dialog},
+		{"batch", bench_batch},
+		{"follow", bench_follow},
+		{"file", bench_file},
+		{"trace", bench_trace},
+		{"frame", bench_frame},
+	};
+
+	std::string json, baseline, corpus;
+	double tolerance = 10;
+
+	bool named = false;
+	for (int i = 1; i < argc; i++)
+	{
+		if (strncmp(argv[i], "--mb=", 5) == 0)
+			bench_mb = strtoull(argv[i] + 5, NULL, 10);
+		else if (strncmp(argv[i], "--threads=", 10) == 0)
+			bench_threads = strtoull(argv[i] + 10, NULL, 10);
+		else if (strncmp(argv[i], "--json=", 7) == 0)
+			json = argv[i] + 7;
+		else if (strncmp(argv[i], "--compare=", 10) == 0)
+			baseline = argv[i] + 10;
+		else if (strncmp(argv[i], "--tolerance=", 12) == 0)
+			tolerance = strtod(argv[i] + 12, NULL);
+		else if (strncmp(argv[i], "--corpus=", 9) == 0)
+			corpus = argv[i] + 9;
+		else
+			named = true;
+	}
+
+	if (!corpus.empty())
+	{
+		std::error_code ec;
+		std::filesystem::create_directories(corpus, ec);
+		for (const char *kind:corpus_kinds)
+		{
+			std::string path = (std::filesystem::path(corpus) / (std::string(kind) + ".txt")).string();
+			try
+			{
+				writefile(path, make_corpus(kind));
+				printf("corpus: %s\n", path.c_str());
+			}
+			catch(const std::runtime_error & ex)
+			{
+				printf("corpus: %s: %s\n", path.c_str(), ex.what());
+				return 1;
+			}
+		}
+		return 0;
+	}
+
+	for (const Benchmark & b:benchmarks)
+	{
+		bool wanted = !named;
+		for (int i = 1; i < argc; i++)
+		{
+			if (b.name == std::string(argv[i]))
+				wanted = true;
+		}
+
+		if (wanted)
+			b.run();
+	}
+
+	if (!json.empty())
+	{
+		FILE *out = fopen(json.c_str(), "w");
+		if (out == NULL)
+		{
+			printf("json: cannot write %s\n", json.c_str());
+			return 1;
+		}
+		write_json(out);
+		fclose(out);
+	}
+	bool regressed = !baseline.empty() && compare(baseline, tolerance) > 0;
+	if (bench_failures > 0)
+	{
+		printf("%zu failure(s)\n", bench_failures);
+		return 1;
+	}
+	return regressed ? 2 : 0;
+}
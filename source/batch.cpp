@@ -0,0 +1,491 @@
+/* 
+   batch.cpp --- scripted edits without the screen
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <cstdio>
+
+namespace Batch
+{
+	// the next field of s/PATTERN/TEXT/ from at, up to a delim that is
+	// not escaped; an escaped delim loses its backslash, other escapes
+	// are kept for later. False if no delim ends it.
+	static bool field(const std::string & s, size_t & at, char delim, std::string & out)
+	{
+		out.clear();
+		for (; at < s.size(); at++)
+		{
+			if (s[at] == delim)
+			{
+				at++;
+				return true;
+			}
+			if (s[at] == '\\' && at + 1 < s.size())
+			{
+				if (s[at + 1] != delim)
+					out += '\\';
+				out += s[++at];
+			}
+			else
+				out += s[at];
+		}
+		return false;
+	}
+
+	// TEXT with its escapes taken; with matches, an & that is not escaped
+	// is left out and where it was noted
+	static std::string unescape(const std::string & raw, std::vector < size_t > *matches = NULL)
+	{
+		std::string text;
+		for (size_t i = 0; i < raw.size(); i++)
+		{
+			char c = raw[i];
+			if (c == '\\' && i + 1 < raw.size())
+			{
+				c = raw[++i];
+				if (c == 'n')
+					c = '\n';
+				else if (c == 't')
+					c = '\t';
+			}
+			else if (c == '&' && matches)
+			{
+				matches->push_back(text.size());
+				continue;
+			}
+			text += c;
+		}
+		return text;
+	}
+
+	static bool number(const std::string & s, size_t & n)
+	{
+		if (s.empty() || s.find_first_not_of("0123456789") != std::string::npos)
+			return false;
+		n = strtoull(s.c_str(), NULL, 10);
+		return n > 0;
+	}
+
+	static std::string trim(const std::string & s)
+	{
+		size_t first = s.find_first_not_of(" \t");
+		if (first == std::string::npos)
+			return "";
+		return s.substr(first, s.find_last_not_of(" \t") - first + 1);
+	}
+
+	// a pattern with nothing of a regular expression in it is searched
+	// for as it is, which is faster
+	static bool plain(const std::string & pattern)
+	{
+		return pattern.find_first_of("\\.[]*+?{}|()^$") == std::string::npos;
+	}
+
+	Script parse(const std::string & source)
+	{
+		Script script;
+		std::istringstream in(source);
+		std::string line;
+
+		for (size_t at_line = 1; std::getline(in, line); at_line++)
+		{
+			if (!line.empty() && line.back() == '\r')
+				line.pop_back();
+			size_t start = line.find_first_not_of(" \t");
+			if (start == std::string::npos || line[start] == '#')
+				continue;
+
+			auto wrong =[&](const std::string & why)
+			{
+				return std::runtime_error("line " + std::to_string(at_line) + ": " + why);
+			};
+
+			size_t end = line.find_first_of(" \t", start);
+			std::string name = line.substr(start, end - start);
+			// insert keeps all but the one space after its name
+			std::string arg = (end == std::string::npos) ? "" : line.substr(end + 1);
+			Command c;
+
+			if (name == "goto")
+			{
+				c.kind = Command::GOTO;
+				std::string where = trim(arg);
+				size_t colon = where.find(':');
+				std::string row = where.substr(0, colon);
+				if (row == "$")
+					c.line = 0;
+				else if (!number(row, c.line))
+					throw wrong("goto needs a line from 1, or $");
+				if (colon != std::string::npos && !number(where.substr(colon + 1), c.column))
+					throw wrong("goto needs a column from 1");
+			}
+			else if (name == "insert")
+			{
+				c.kind = Command::INSERT;
+				c.text = unescape(arg);
+				if (c.text.empty())
+					throw wrong("insert needs text");
+			}
+			else if (name == "delete")
+			{
+				c.kind = Command::DELETE;
+				if (!trim(arg).empty() && !number(trim(arg), c.count))
+					throw wrong("delete needs a count of lines from 1");
+			}
+			else if (name == "write")
+			{
+				c.kind = Command::WRITE;
+				c.text = trim(arg);
+			}
+			else if (name == "substitute" || (line[start] == 's' && start + 1 < line.size()
+							  && !isalnum((unsigned char)line[start + 1])
+							  && !isspace((unsigned char)line[start + 1])))
+			{
+				c.kind = Command::SUBSTITUTE;
+				std::string s = (name == "substitute") ? trim(arg) : line.substr(start + 1);
+				if (s.empty())
+					throw wrong("substitute needs /PATTERN/TEXT/");
+
+				size_t at = 1;
+				std::string raw;
+				if (!field(s, at, s[0], c.pattern) || !field(s, at, s[0], raw))
+					throw wrong("substitute needs /PATTERN/TEXT/");
+				if (c.pattern.empty())
+					throw wrong("substitute needs a pattern");
+				c.text = unescape(raw, &c.matches);
+
+				for (char flag:trim(s.substr(at)))
+				{
+					if (flag == 'g')
+						c.global = true;
+					else if (flag == 'i')
+						c.icase = true;
+					else
+						throw wrong(std::string("unknown flag ") + flag);
+				}
+
+				if (!plain(c.pattern))
+				{
+					try
+					{
+						Search::Regex check(c.pattern, c.icase);
+					}
+					catch(const std::runtime_error & ex)
+					{
+						throw wrong(ex.what());
+					}
+				}
+			}
+			else
+				throw wrong("unknown command " + name);
+
+			script.push_back(c);
+		}
+		return script;
+	}
+
+	// the matches of c from at on, in order; only the first unless global
+	static void matches_of(const Command & c, const std::string & text, size_t at, std::vector < size_t > &pos,
+			       std::vector < size_t > &len)
+	{
+		Search::Chunks chunks = Search::chunks_of(text);
+		size_t p, n;
+
+		if (plain(c.pattern))
+		{
+			Search::Literal lit(c.pattern, c.icase);
+			for (; (p = Search::find_next(chunks, lit, at)) != std::string::npos; at = p + lit.size())
+			{
+				pos.push_back(p);
+				len.push_back(lit.size());
+				if (!c.global)
+					break;
+			}
+			return;
+		}
+
+		// as sed: an empty match right where the one before ended is none
+		Search::Regex re(c.pattern, c.icase);
+		size_t end = std::string::npos;
+		for (; at <= text.size() && re.find(chunks, at, p, n); at = p + std::max < size_t > (n, 1))
+		{
+			if (n == 0 && p == end)
+				continue;
+			pos.push_back(p);
+			len.push_back(n);
+			end = p + n;
+			if (!c.global)
+				break;
+		}
+	}
+
+	void apply(const Script & script, const std::string & name, std::string & text, std::string & out)
+	{
+		LineIndex lines;
+		lines.build(text);
+		size_t at = 0;		// the cursor
+		bool wrote = false;
+
+		std::vector < Splice > pieces;
+		auto replace =[&]()
+		{
+			splice_text(text, pieces);
+			lines.spliced(pieces);
+			pieces.clear();
+		};
+
+		for (const Command & c:script)
+		{
+			switch (c.kind)
+			{
+			case Command::GOTO:
+				{
+					// not the empty one after a last newline
+					size_t last = lines.count() - 1;
+					if (last > 0 && lines.start(last) == text.size())
+						last--;
+					size_t line = (c.line == 0) ? last : std::min(c.line - 1, last);
+					size_t len = lines.length(line);
+					if (len > 0 && text[lines.start(line) + len - 1] == '\r')
+						len--;
+					at = lines.start(line) + std::min(c.column - 1, len);
+					break;
+				}
+			case Command::INSERT:
+				pieces.push_back({ at, 0, c.text.data(), c.text.size() });
+				replace();
+				at += c.text.size();
+				break;
+			case Command::DELETE:
+				{
+					size_t line = lines.line_of(at);
+					size_t next = line + c.count;
+					size_t from = lines.start(line);
+					size_t to = next < lines.count()? lines.start(next) : text.size();
+					pieces.push_back({ from, to - from, "", 0 });
+					replace();
+					at = from;
+					break;
+				}
+			case Command::SUBSTITUTE:
+				{
+					std::vector < size_t > pos, len;
+					matches_of(c, text, at, pos, len);
+					if (pos.empty())
+						break;
+
+					// with &, every piece has its own text
+					std::string texts;
+					std::vector < size_t > sizes;
+					for (size_t i = 0; i < pos.size() && !c.matches.empty(); i++)
+					{
+						size_t before = texts.size(), from = 0;
+						for (size_t m:c.matches)
+						{
+							texts.append(c.text, from, m - from);
+							texts.append(text, pos[i], len[i]);
+							from = m;
+						}
+						texts.append(c.text, from, std::string::npos);
+						sizes.push_back(texts.size() - before);
+					}
+
+					const char *next = texts.data();
+					for (size_t i = 0; i < pos.size(); i++)
+					{
+						if (sizes.empty())
+							pieces.push_back({ pos[i], len[i], c.text.data(), c.text.size() });
+						else
+						{
+							pieces.push_back({ pos[i], len[i], next, sizes[i] });
+							next += sizes[i];
+						}
+					}
+					replace();
+					break;
+				}
+			case Command::WRITE:
+				{
+					std::string target = c.text.empty()? name : c.text;
+					if (target == "-")
+						out += text;
+					else
+						writefile(target, text);
+					wrote = true;
+					break;
+				}
+			}
+		}
+
+		if (wrote)
+			return;
+		if (out.empty())
+			out.swap(text);
+		else
+			out += text;
+	}
+
+	static void read_input(std::string & text)
+	{
+		char block[1 << 16];
+		size_t n;
+		while ((n = fread(block, 1, sizeof(block), stdin)) > 0)
+			text.append(block, n);
+		if (ferror(stdin))
+			throw std::runtime_error("I/O error occurred while reading the input.");
+	}
+
+	static int usage()
+	{
+		std::cerr << "usage: edit --batch [-j JOBS] [-e COMMAND]... [-f SCRIPT] [FILE]...\n";
+		return 2;
+	}
+
+	int run(int argc, char **argv)
+	{
+		std::string source;
+		size_t jobs = std::thread::hardware_concurrency();
+		int i = 0;
+
+		for (; i < argc; i++)
+		{
+			std::string arg = argv[i];
+			if (arg == "--")
+			{
+				i++;
+				break;
+			}
+			else if (arg.size() < 2 || arg[0] != '-')
+				break;
+			else if (i + 1 == argc || (arg != "-e" && arg != "-f" && arg != "-j"))
+				return usage();
+
+			std::string value = argv[++i];
+			if (arg == "-e")
+				source += value + "\n";
+			else if (arg == "-j" && !number(value, jobs))
+				return usage();
+			else if (arg == "-f")
+			{
+				std::string text;
+				try
+				{
+					readfile(value, text);
+				}
+				catch(const std::runtime_error & ex)
+				{
+					std::cerr << "edit: " << ex.what() << "\n";
+					return 2;
+				}
+				source += text + "\n";
+			}
+		}
+
+		Script script;
+		try
+		{
+			script = parse(source);
+		}
+		catch(const std::runtime_error & ex)
+		{
+			std::cerr << "edit: script " << ex.what() << "\n";
+			return 2;
+		}
+		if (script.empty())
+			return usage();
+
+		std::vector < std::string > files(argv + i, argv + argc);
+		if (files.empty())
+			files.push_back("-");
+
+		struct Result
+		{
+			bool done = false;
+			std::string out;
+			std::string error;
+		};
+		std::vector < Result > results(files.size());
+		std::mutex lock;
+		std::condition_variable ready;
+		int status = 0;
+
+		WorkerPool pool(jobs);
+		// files are taken only so far ahead of the output, which holds
+		// what they write until those before them are out
+		size_t ahead = 4 * pool.size();
+		size_t taken = 0;
+
+		for (size_t shown = 0; shown < files.size(); shown++)
+		{
+			for (; taken < files.size() && taken < shown + ahead; taken++)
+			{
+				pool.submit([&, k = taken]()
+					    {
+						    std::string text, out, error;
+						    try
+						    {
+							    if (files[k] == "-")
+								    read_input(text);
+							    else
+								    readfile(files[k], text);
+							    apply(script, files[k], text, out);
+						    }
+						    catch(const std::runtime_error & ex)
+						    {
+							    error = ex.what();
+						    }
+
+						    std::lock_guard < std::mutex > guard(lock);
+						    results[k].out.swap(out);
+						    results[k].error.swap(error);
+						    results[k].done = true;
+						    ready.notify_all();
+					    });
+			}
+
+			Result r;
+			{
+				std::unique_lock < std::mutex > guard(lock);
+				ready.wait(guard,[&]()
+					   {
+						   return results[shown].done;
+					   });
+				std::swap(r, results[shown]);
+			}
+			fwrite(r.out.data(), 1, r.out.size(), stdout);
+			if (!r.error.empty())
+			{
+				std::cerr << "edit: " << files[shown] << ": " << r.error << "\n";
+				status = 1;
+			}
+		}
+
+		fflush(stdout);
+		return status;
+	}
+}				// namespace Batch
@@ -0,0 +1,143 @@
+/* 
+   block.cpp --- rectangular selections, edited a column at a time
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+namespace Block
+{
+	// Columns [left, right) of a line, as offsets, clamped to the line
+	static void columns(size_t line, size_t left, size_t right, size_t & from, size_t & to)
+	{
+		size_t start = buflines.start(line);
+		size_t len = buffer_line_length(line);
+		from = start + std::min(left, len);
+		to = start + std::min(right, len);
+	}
+
+	std::string text(const Rect & r)
+	{
+		std::string out;
+		for (size_t line = r.first; line <= r.last && line < buflines.count(); line++)
+		{
+			size_t from, to;
+			columns(line, r.left, r.right, from, to);
+			if (line > r.first)
+				out += '\n';
+			out.append(filebuf, from, to - from);
+		}
+		return out;
+	}
+
+	// Replace columns [left, right) of count lines from first on. Every
+	// line gets all of rows when same is set, otherwise line first + i
+	// gets the i-th line of rows. A line too short to reach left is padded
+	// with spaces when something goes there, and rows past the last line
+	// become lines of their own. However many lines, it is one pass over
+	// the buffer and one undo step; returns the lines changed.
+	static size_t put(size_t first, size_t count, size_t left, size_t right, const std::string & rows, bool same)
+	{
+		std::vector < size_t > at, lens, sizes;
+		std::string texts;
+		at.reserve(count);
+		lens.reserve(count);
+		sizes.reserve(count);
+
+		const char *eol = useCRLF ? "\r\n" : "\n";
+		size_t next = 0;	// where the next row begins in rows
+		for (size_t i = 0; i < count; i++)
+		{
+			size_t row = 0, len = rows.size();
+			if (!same)
+			{
+				size_t end = rows.find('\n', next);
+				if (end == std::string::npos)
+					end = rows.size();
+				row = next;
+				len = end - next;
+				next = end + 1;
+			}
+
+			size_t line = first + i;
+			size_t from, to, pad = 0, size = texts.size();
+			if (line < buflines.count())
+			{
+				columns(line, left, right, from, to);
+				size_t have = buffer_line_length(line);
+				if (len > 0 && have < left)
+					pad = left - have;
+				if (from == to && len == 0)
+					continue;	// nothing to take out or put in
+			}
+			else
+			{
+				from = to = filebuf.size();
+				texts += eol;
+				pad = left;
+			}
+			texts.append(pad, ' ');
+			texts.append(rows, row, len);
+
+			// new lines all go at the end, as one piece
+			if (!at.empty() && at.back() + lens.back() == from && from == to)
+			{
+				sizes.back() += texts.size() - size;
+				continue;
+			}
+			at.push_back(from);
+			lens.push_back(to - from);
+			sizes.push_back(texts.size() - size);
+		}
+
+		buffer_replace(at, lens, texts, sizes);
+		return at.size();
+	}
+
+	// the lines of the rectangle that exist
+	static size_t height(const Rect & r)
+	{
+		if (r.first >= buflines.count() || r.last < r.first)
+			return 0;
+		return std::min(r.last, buflines.count() - 1) - r.first + 1;
+	}
+
+	size_t erase(const Rect & r)
+	{
+		return put(r.first, height(r), r.left, r.right, std::string(), true);
+	}
+
+	size_t type(const Rect & r, const std::string & text)
+	{
+		return put(r.first, height(r), r.left, r.right, text, true);
+	}
+
+	size_t paste(size_t line, size_t col, const std::string & rows)
+	{
+		size_t count = std::count(rows.begin(), rows.end(), '\n') + 1;
+		return put(line, count, col, col, rows, false);
+	}
+}				// namespace Block
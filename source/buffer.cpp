@@ -0,0 +1,722 @@
+/* 
+   buffer.cpp --- line index and edit primitives over the buffer
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+std::string filebuf = "";
+std::string filename;		// filename path
+
+#if USE_DOS_PATH
+bool useCRLF = true;
+#else
+bool useCRLF = false;
+#endif
+
+LineIndex buflines;
+DocStats docstats;
+
+bool is_blank(unsigned char c)
+{
+	return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+}
+
+// Number of words starting inside [from, to), a word starts on a non blank
+// byte that follows a blank one or the start of the buffer
+size_t count_word_starts(const std::string & buffer, size_t from, size_t to)
+{
+	size_t count = 0;
+	to = std::min(to, buffer.size());
+
+	if (from >= to)
+		return 0;
+
+	bool prev_blank = (from == 0) || is_blank(buffer[from - 1]);
+	size_t i = from;
+
+#if defined(__SSE2__)
+	// 16 bytes at a time, pasting a large text counts all of it
+	const __m128i space = _mm_set1_epi8(' '), tab = _mm_set1_epi8('\t'), four = _mm_set1_epi8(4);
+	unsigned carry = prev_blank;
+	for (; i + 16 <= to; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(buffer.data() + i));
+		__m128i ctl = _mm_sub_epi8(v, tab);	// \t \n \v \f \r become 0 to 4
+		__m128i blank = _mm_or_si128(_mm_cmpeq_epi8(v, space), _mm_cmpeq_epi8(_mm_min_epu8(ctl, four), ctl));
+		unsigned mask = _mm_movemask_epi8(blank);
+		unsigned before = ((mask << 1) | carry) & 0xffff;	// is the byte before each blank
+		count += __builtin_popcount(before & ~mask & 0xffff);
+		carry = mask >> 15;
+	}
+	prev_blank = carry;
+#endif
+
+	for (; i < to; i++)
+	{
+		bool blank = is_blank(buffer[i]);
+		if (prev_blank && !blank)
+			count++;
+		prev_blank = blank;
+	}
+	return count;
+}
+
+// Number of UTF-8 characters, every byte but the continuation bytes
+size_t count_chars(const char *text, size_t len)
+{
+	size_t count = 0;
+	size_t i = 0;
+
+#if defined(__SSE2__)
+	// continuation bytes are 0x80 to 0xbf, below -64 as signed bytes
+	const __m128i limit = _mm_set1_epi8(-64);
+	for (; i + 16 <= len; i += 16)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i *)(text + i));
+		count += 16 - __builtin_popcount(_mm_movemask_epi8(_mm_cmplt_epi8(v, limit)));
+	}
+#endif
+
+	for (; i < len; i++)
+	{
+		if (((unsigned char)text[i] & 0xc0) != 0x80)
+			count++;
+	}
+	return count;
+}
+
+// Build the index from scratch, used after a file is opened
+void LineIndex::build(const std::string & buffer, char delim)
+{
+	Memory::Scope memory(Memory::LINES);
+	starts.clear();
+	starts.push_back(0);
+	total = buffer.size();
+
+	const char *base = buffer.data();
+	const char *p = base;
+	const char *last = base + buffer.size();
+
+	// memchr is much faster than walking byte by byte on large files
+	while (p < last && (p = (const char *)memchr(p, delim, last - p)) != NULL)
+	{
+		p++;
+		starts.push_back(p - base);
+	}
+}
+
+void LineIndex::assign(std::vector < size_t > &&offsets, size_t size)
+{
+	starts = std::move(offsets);
+	total = size;
+}
+
+// The index covers buffer up to from, and buffer has only grown since
+void LineIndex::extend(const std::string & buffer, size_t from, char delim)
+{
+	Memory::Scope memory(Memory::LINES);
+	total = buffer.size();
+
+	const char *base = buffer.data();
+	const char *p = base + from;
+	const char *last = base + buffer.size();
+	while (p < last && (p = (const char *)memchr(p, delim, last - p)) != NULL)
+	{
+		p++;
+		starts.push_back(p - base);
+	}
+}
+
+// Update the index after len bytes of text were inserted at pos
+void LineIndex::inserted(size_t pos, const char *text, size_t len, char delim)
+{
+	Memory::Scope memory(Memory::LINES);
+	if (len == 0)
+		return;
+
+	size_t line = line_of(pos);
+
+	std::vector < size_t > added;
+	const char *p = text;
+	const char *last = text + len;
+	while (p < last && (p = (const char *)memchr(p, delim, last - p)) != NULL)
+	{
+		p++;
+		added.push_back(pos + (p - text));
+	}
+
+	// every line after the edited one moves by len
+	for (size_t i = line + 1; i < starts.size(); i++)
+		starts[i] += len;
+
+	starts.insert(starts.begin() + line + 1, added.begin(), added.end());
+	total += len;
+}
+
+// Update the index after len bytes starting at pos were removed
+void LineIndex::erased(size_t pos, size_t len)
+{
+	Memory::Scope memory(Memory::LINES);
+	if (len == 0)
+		return;
+
+	// lines starting inside (pos, pos + len] lost their delimiter
+	auto first = std::upper_bound(starts.begin(), starts.end(), pos);
+	auto last = std::upper_bound(first, starts.end(), pos + len);
+
+	for (auto it = last; it != starts.end(); ++it)
+		*it -= len;
+
+	starts.erase(first, last);
+	total -= len;
+}
+
+// Update the index after every piece was replaced, in one walk over it
+// rather than over the text
+void LineIndex::spliced(const std::vector < Splice > &pieces, char delim)
+{
+	Memory::Scope memory(Memory::LINES);
+	std::vector < size_t > out;
+	out.reserve(starts.size());
+
+	auto old = starts.begin();
+	size_t shift = 0;
+	for (const Splice & p:pieces)
+	{
+		// lines starting up to the piece stay, those whose delimiter
+		// was inside it go
+		for (; old != starts.end() && *old <= p.pos; ++old)
+			out.push_back(*old + shift);
+		for (; old != starts.end() && *old <= p.pos + p.len; ++old)
+			;
+
+		for (size_t i = 0; i < p.size; i++)
+		{
+			if (p.text[i] == delim)
+				out.push_back(p.pos + shift + i + 1);
+		}
+		shift += p.size - p.len;
+	}
+	for (; old != starts.end(); ++old)
+		out.push_back(*old + shift);
+
+	starts.swap(out);
+	total += shift;
+}
+
+// Line number containing the byte at offset (the delimiter belongs to its
+// line)
+size_t LineIndex::line_of(size_t offset) const
+{
+	auto it = std::upper_bound(starts.begin(), starts.end(), offset);
+	return (it - starts.begin()) - 1;
+}
+
+// One undo step: pieces of the text as it was before the step, at[i] and
+// lens[i] long, every one replaced by inserted. removed holds the old
+// pieces one after another, so a replace all is one step however many
+// matches it had. A block edit gives every piece its own text; then
+// inserted holds those one after another too, sizes[i] long. The texts
+// are shared with registers, so cutting and pasting do not copy them
+// again.
+struct Change
+{
+	std::vector < size_t > at;	// ascending, the pieces never overlap
+	std::vector < size_t > lens;
+	std::vector < size_t > sizes;	// empty when every piece is inserted
+	std::shared_ptr < const std::string > removed;
+	std::shared_ptr < const std::string > inserted;
+};
+
+typedef std::shared_ptr < const std::string > Text;
+
+static std::vector < Change > undo_steps;
+static std::vector < Change > redo_steps;
+static bool typing = false;	// the last step may still grow
+
+// the rest of a reset, once buflines and docstats are right
+static void forget_history()
+{
+	Highlight::reset(filename);
+	docstats.modified = false;
+	Search::forget();
+
+	undo_steps.clear();
+	redo_steps.clear();
+	typing = false;
+}
+
+void buffer_reset()
+{
+	Memory::Scope memory(Memory::BUFFER);
+	buflines.build(filebuf);
+	docstats.chars = count_chars(filebuf.data(), filebuf.size());
+	docstats.words = count_word_starts(filebuf, 0, filebuf.size());
+	forget_history();
+}
+
+bool buffer_load(const std::string & path, Progress * progress)
+{
+	TRACE_FUNCTION();
+	Memory::Scope memory(Memory::BUFFER);
+	// read beside the old text, which stays, with its history, if reading
+	// is canceled or fails
+	std::string text;
+	try
+	{
+		if (!readfile(path, text, progress) || (progress && progress->cancel))
+			return false;
+	}
+	catch(const std::runtime_error &)
+	{
+		Stream::close(false);
+		throw;
+	}
+
+	Stream::close();	// input still arriving would go to the wrong text
+
+	Registers::detach();	// copies still point into the old text
+	filebuf.swap(text);
+	std::string().swap(text);
+	filename = path;
+	Disk::remember(path, filebuf);
+
+	// a large file opened before need not be scanned again
+	if (LineCache::restore(path, filebuf, buflines, docstats))
+		forget_history();
+	else
+		buffer_reset();
+	LineCache::keep(path, filebuf, buflines, docstats);
+	return true;
+}
+
+static void insert_text(size_t pos, const char *text, size_t len)
+{
+	Memory::Scope memory(Memory::BUFFER);
+	if (pos > filebuf.size())
+		throw std::runtime_error("Attempted to insert past the end of the buffer.");
+
+	size_t line = buflines.line_of(pos);
+	size_t before = buflines.count();
+
+	// only the inserted bytes and the one after them can change whether a
+	// word starts there
+	size_t words_before = count_word_starts(filebuf, pos, pos + 1);
+
+	Registers::edited(pos, 0, len);
+	filebuf.insert(pos, text, len);
+	buflines.inserted(pos, text, len);
+
+	docstats.words += count_word_starts(filebuf, pos, pos + len + 1) - words_before;
+	docstats.chars += count_chars(text, len);
+	docstats.modified = true;
+	Search::forget();	// the matches moved, stop highlighting them
+
+	Highlight::edited(line, 0, buflines.count() - before);
+}
+
+// Text arriving at the end, as from a pipe: not an edit, so no undo step,
+// and the buffer is no more modified than it was
+void buffer_append(const char *text, size_t len)
+{
+	Memory::Scope memory(Memory::BUFFER);
+	bool modified = docstats.modified;
+	insert_text(filebuf.size(), text, len);
+	docstats.modified = modified;
+}
+
+static void erase_text(size_t pos, size_t len)
+{
+	Memory::Scope memory(Memory::BUFFER);
+	if (pos > filebuf.size() || len > filebuf.size() - pos)
+		throw std::runtime_error("Attempted to erase past the end of the buffer.");
+
+	size_t line = buflines.line_of(pos);
+	size_t before = buflines.count();
+
+	size_t words_before = count_word_starts(filebuf, pos, pos + len + 1);
+	docstats.chars -= count_chars(filebuf.data() + pos, len);
+
+	Registers::edited(pos, len, 0);
+	filebuf.erase(pos, len);
+	buflines.erased(pos, len);
+
+	docstats.words += count_word_starts(filebuf, pos, pos + 1) - words_before;
+	docstats.modified = true;
+	Search::forget();
+
+	Highlight::edited(line, before - buflines.count(), 0);
+}
+
+// The text of a typing step, to add to. Only typing steps grow and those
+// are never shared, so this does not copy.
+static std::string & grow(Text & text)
+{
+	if (text.use_count() > 1)
+		text = std::make_shared < const std::string > (*text);
+	return *std::const_pointer_cast < std::string > (text);
+}
+
+// An edit becomes an undo step, or a single one joins the last while
+// typing or backspacing runs on within a line
+static void record(size_t pos, const Text & removed, const Text & inserted, bool single)
+{
+	Memory::Scope memory(Memory::BUFFER);
+	redo_steps.clear();
+
+	bool line_break = inserted->find('\n') != std::string::npos || removed->find('\n') != std::string::npos;
+	if (single && typing && !line_break)
+	{
+		Change & last = undo_steps.back();
+		if (removed->empty() && last.removed->empty() && pos == last.at[0] + last.inserted->size())
+		{
+			grow(last.inserted) += *inserted;
+			return;
+		}
+		if (inserted->empty() && last.inserted->empty() && pos + removed->size() == last.at[0])
+		{
+			last.at[0] = pos;
+			last.lens[0] += removed->size();
+			grow(last.removed).insert(0, *removed);
+			return;
+		}
+	}
+
+	Change step;
+	step.at.push_back(pos);
+	step.lens.push_back(removed->size());
+	step.removed = removed;
+	step.inserted = inserted;
+	undo_steps.push_back(std::move(step));
+	typing = single && !line_break;
+}
+
+static const Text nothing = std::make_shared < const std::string > ();
+
+void buffer_insert(size_t pos, const std::string & text)
+{
+	insert_text(pos, text.data(), text.size());
+	record(pos, nothing, std::make_shared < const std::string > (text), true);
+}
+
+static Text erase_step(size_t pos, size_t len, bool single)
+{
+	if (pos > filebuf.size() || len > filebuf.size() - pos)
+		throw std::runtime_error("Attempted to erase past the end of the buffer.");
+
+	Text removed = std::make_shared < const std::string > (filebuf, pos, len);
+	erase_text(pos, len);
+	record(pos, removed, nothing, single);
+	return removed;
+}
+
+void buffer_erase(size_t pos, size_t len)
+{
+	erase_step(pos, len, true);
+}
+
+Text buffer_cut(size_t pos, size_t len)
+{
+	return erase_step(pos, len, false);
+}
+
+void buffer_paste(size_t pos, const Text & text)
+{
+	insert_text(pos, text->data(), text->size());
+	record(pos, nothing, text, false);
+}
+
+// Put the pieces in place in one pass that moves every byte at most once,
+// in place when they all grow or all shrink
+void splice_text(std::string & text, const std::vector < Splice > &pieces)
+{
+	size_t n = pieces.size();
+	if (n == 0)
+		return;
+
+	size_t old_size = text.size();
+	size_t new_size = old_size;
+	bool grows = false, shrinks = false;
+	for (const Splice & p:pieces)
+	{
+		new_size += p.size - p.len;
+		grows |= p.size > p.len;
+		shrinks |= p.size < p.len;
+	}
+
+	if (grows && (shrinks || text.capacity() < new_size))
+	{
+		// some bytes move left and some right, so no single direction
+		// can move them in place; or the buffer has to be reallocated,
+		// which copies it anyway
+		std::string out;
+		out.reserve(new_size);
+		size_t from = 0;
+		for (const Splice & p:pieces)
+		{
+			out.append(text, from, p.pos - from);
+			out.append(p.text, p.size);
+			from = p.pos + p.len;
+		}
+		out.append(text, from, std::string::npos);
+		text.swap(out);
+	}
+	else if (grows)
+	{
+		// from the end, each gap moves right before anything lands on it
+		text.resize(new_size);
+		char *base = &text[0];
+		size_t src = old_size, dst = new_size;
+		for (size_t i = n; i-- > 0;)
+		{
+			const Splice & p = pieces[i];
+			size_t gap = src - (p.pos + p.len);
+			dst -= gap;
+			memmove(base + dst, base + p.pos + p.len, gap);
+			dst -= p.size;
+			memcpy(base + dst, p.text, p.size);
+			src = p.pos;
+		}
+	}
+	else
+	{
+		// from the start, each gap moves left
+		char *base = &text[0];
+		size_t src = pieces[0].pos, dst = src;
+		for (const Splice & p:pieces)
+		{
+			memmove(base + dst, base + src, p.pos - src);
+			dst += p.pos - src;
+			memcpy(base + dst, p.text, p.size);
+			dst += p.size;
+			src = p.pos + p.len;
+		}
+		memmove(base + dst, base + src, old_size - src);
+		text.resize(new_size);
+	}
+}
+
+// Replace the pieces of the buffer. Statistics come from the bytes around
+// each piece and the index from the pieces; nothing rescans the rest of
+// the buffer.
+static void splice(const std::vector < Splice > &pieces)
+{
+	Memory::Scope memory(Memory::BUFFER);
+	size_t n = pieces.size();
+	if (n == 0)
+		return;
+
+	size_t old_size = filebuf.size();
+	size_t new_size = old_size;
+	size_t words = docstats.words, chars = docstats.chars;
+	bool text_ends_blank = true;	// the last piece's text, as it will be
+
+	for (size_t i = 0; i < n; i++)
+	{
+		const Splice & p = pieces[i];
+		size_t end = p.pos + p.len;
+		size_t next = (i + 1 < n) ? pieces[i + 1].pos : old_size;
+		if (p.pos > old_size || p.len > old_size - p.pos || next < end)
+			throw std::runtime_error("Attempted to replace overlapping or missing text.");
+
+		new_size += p.size - p.len;
+		chars += count_chars(p.text, p.size) - count_chars(filebuf.data() + p.pos, p.len);
+
+		// whether a word starts can change from the piece up to the
+		// byte after it, or up to the next piece when they touch
+		words -= count_word_starts(filebuf, p.pos, std::min(end + 1, next));
+
+		bool touches = i > 0 && p.pos == pieces[i - 1].pos + pieces[i - 1].len;
+		bool prev_blank = touches ? text_ends_blank : p.pos == 0 || is_blank(filebuf[p.pos - 1]);
+		for (size_t k = 0; k < p.size; k++)
+		{
+			bool blank = is_blank(p.text[k]);
+			words += prev_blank && !blank;
+			prev_blank = blank;
+		}
+		text_ends_blank = prev_blank;
+		if (end < next)
+			words += prev_blank && !is_blank(filebuf[end]);
+	}
+
+	size_t first_line = buflines.line_of(pieces[0].pos);
+	size_t last_line = buflines.line_of(pieces[n - 1].pos + pieces[n - 1].len);
+
+	Registers::detach();	// rare enough not to work out which moved
+	splice_text(filebuf, pieces);
+	buflines.spliced(pieces);
+	size_t new_last = buflines.line_of(pieces[n - 1].pos + pieces[n - 1].len + new_size - old_size);
+
+	docstats.words = words;
+	docstats.chars = chars;
+	docstats.modified = true;
+	Search::forget();
+
+	Highlight::edited(first_line, last_line - first_line, new_last - first_line);
+}
+
+// Apply a step forwards (do, redo) or backwards (undo); returns where its
+// first piece begins afterwards
+static size_t apply(const Change & step, bool forward)
+{
+	size_t n = step.at.size();
+
+	if (n == 1)		// typing, keep to the incremental updates
+	{
+		const std::string & out = forward ? *step.removed : *step.inserted;
+		const std::string & in = forward ? *step.inserted : *step.removed;
+		erase_text(step.at[0], out.size());
+		insert_text(step.at[0], in.data(), in.size());
+		return step.at[0];
+	}
+
+	const std::string & inserted = *step.inserted;
+	bool each = !step.sizes.empty();
+	std::vector < Splice > pieces(n);
+	size_t shift = 0, from = 0, put = 0;
+	for (size_t i = 0; i < n; i++)
+	{
+		size_t size = each ? step.sizes[i] : inserted.size();
+		const char *text = inserted.data() + (each ? put : 0);
+		if (forward)
+			pieces[i] = Splice { step.at[i], step.lens[i], text, size };
+		else		// where the step left them, earlier ones moved them
+			pieces[i] = Splice { step.at[i] + shift, size, step.removed->data() + from, step.lens[i] };
+		shift += size - step.lens[i];
+		from += step.lens[i];
+		put += size;
+	}
+	splice(pieces);
+	return step.at[0];
+}
+
+// Take the old pieces and make the step
+static size_t replace_step(Change & step)
+{
+	const std::vector < size_t > &at = step.at;
+	const std::vector < size_t > &lens = step.lens;
+	if (at.size() != lens.size())
+		throw std::runtime_error("Attempted to replace pieces without their lengths.");
+	if (at.empty())
+		return 0;
+
+	size_t total = 0;
+	for (size_t i = 0; i < at.size(); i++)
+	{
+		if (at[i] > filebuf.size() || lens[i] > filebuf.size() - at[i] ||
+		    (i > 0 && at[i] < at[i - 1] + lens[i - 1]))
+			throw std::runtime_error("Attempted to replace overlapping or missing text.");
+		total += lens[i];
+	}
+	std::string removed;
+	removed.reserve(total);
+	for (size_t i = 0; i < at.size(); i++)
+		removed.append(filebuf, at[i], lens[i]);
+	step.removed = std::make_shared < const std::string > (std::move(removed));
+
+	size_t n = at.size();
+	apply(step, true);
+	redo_steps.clear();
+	undo_steps.push_back(std::move(step));
+	typing = false;
+	return n;
+}
+
+size_t buffer_replace(const std::vector < size_t > &at, const std::vector < size_t > &lens, const std::string & text)
+{
+	Change step;
+	step.at = at;
+	step.lens = lens;
+	step.inserted = std::make_shared < const std::string > (text);
+	return replace_step(step);
+}
+
+size_t buffer_replace(const std::vector < size_t > &at, const std::vector < size_t > &lens,
+		      const std::string & texts, const std::vector < size_t > &sizes)
+{
+	size_t total = 0;
+	for (size_t size:sizes)
+		total += size;
+	if (sizes.size() != at.size() || total != texts.size())
+		throw std::runtime_error("Attempted to replace pieces without their texts.");
+
+	Change step;
+	step.at = at;
+	step.lens = lens;
+	step.sizes = sizes;
+	step.inserted = std::make_shared < const std::string > (texts);
+	return replace_step(step);
+}
+
+size_t buffer_undo()
+{
+	if (undo_steps.empty())
+		return std::string::npos;
+
+	Change step = std::move(undo_steps.back());
+	undo_steps.pop_back();
+	size_t pos = apply(step, false) + step.lens[0];
+	redo_steps.push_back(std::move(step));
+	typing = false;
+	return pos;
+}
+
+size_t buffer_redo()
+{
+	if (redo_steps.empty())
+		return std::string::npos;
+
+	Change step = std::move(redo_steps.back());
+	redo_steps.pop_back();
+	size_t pos = apply(step, true) + (step.sizes.empty() ? step.inserted->size() : step.sizes[0]);
+	undo_steps.push_back(std::move(step));
+	typing = false;
+	return pos;
+}
+
+size_t buffer_line_length(size_t line)
+{
+	if (line >= buflines.count())
+		return 0;
+
+	size_t len = buflines.length(line);
+	if (len > 0 && filebuf[buflines.start(line) + len - 1] == '\r')
+		len--;		// DOS line ending, the CR is not editable text
+	return len;
+}
+
+size_t buffer_offset(size_t line, size_t col)
+{
+	if (line >= buflines.count())
+		return filebuf.size();
+
+	return buflines.start(line) + std::min(col, buffer_line_length(line));
+}
@@ -42,5 +42,7 @@
 
 // #define HAVE_CLIPBOARD 1 // clipboard support
 
+// #define USE_TRACE 1 // time the editor, written to edit-trace.json on F12 and exit
+
 // only use these if you REALLY have to, and has_colors is not working
 // #define FORCE_COLOR_ON
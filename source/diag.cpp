@@ -29,374 +29,240 @@
 
 #include "edit.h"
 
-
-// returns true if the dialog displayed
-// returns false if fallback was used
-
-// Function to show fatal error message has 
-// FALSE -> [R]isks understood, continue anyway, OR 
-// TRUE -> PRESS ANY OTHER KEY TO TERMINATE.
-bool show_fatal(const std::string & title, const std::string & message)
+#include <chrono>
+
+// The message boxes differ only in their color, their title, their last
+// line and what the key that closes them means; this is all the rest.
+// The message is wrapped as far as it is scrolled through, one layout
+// for every width the box had, and only the rows in view are drawn, so a
+// box costs the same however long its message is. Up, Down, PgUp and
+// PgDn scroll, Left and Right do nothing, any other key closes it.
+// Returns that key, or ERR if the box could not be made.
+static int dialog(const std::string & title, int color, const char *footer, const std::string & message)
 {
-	WINDOW *errWindow = newwin(scr_max_y - 4, scr_max_x - 4, 2, 2);
+	Memory::Scope memory(Memory::DIALOG);
+	WINDOW *win = newwin(scr_max_y - 4, scr_max_x - 4, 2, 2);
+	if (!win)
+		return ERR;
 	int prev = curs_set(0);
 
-	if (!errWindow)
-	{
-		std::cerr << "FATAL ERROR (fallback) - " << title << "\n" << message << "\n";
-		return false;
-	}
-
 	// Enable keypad input to capture arrow keys
-	keypad(errWindow, TRUE);
+	keypad(win, TRUE);
 
-	// Draw box around the message window
-	box(errWindow, 0, 0);
-
-	// Set background color for error
 #if HAVE_COLOR
 	if (console_color)
-	{
-		wbkgd(errWindow, COLOR_PAIR(COLOR_PAIR_ERR));
-	}
+		wbkgd(win, COLOR_PAIR(color));
+#else
+	(void)color;
 #endif
 
-	mvwprintw(errWindow, 0, (scr_max_x - title.size() - 7) / 2, "FATAL ERROR: %s", title.c_str());
-
-	size_t max_message_width = scr_max_x - 4;	// Considering the
-	// border (2
-	// on each side)
-	std::vector < std::string > wrapped_lines;
-	wrap_message(message, max_message_width, wrapped_lines);
-
-	size_t total_lines = wrapped_lines.size();
-	size_t y_offset = 1;	// Start printing from the second row (after
-	// the title)
-	size_t view_offset = 0;	// Keeps track of the current scroll position
+	std::unordered_map < size_t, WrappedText > layouts;
+	size_t top = 0;		// offset in message of the first row in view
+	std::string shown;
+	int ch;
 
-	// Initial rendering of the wrapped message
-	for (size_t i = 0; i < scr_max_y - 6 && i + view_offset < total_lines; ++i)
-	{
-		mvwprintw(errWindow, i + y_offset, 1, "%s", wrapped_lines[i + view_offset].c_str());
-	}
-
-	mvwprintw(errWindow, scr_max_y - 6, (scr_max_x - 73) / 2,
-		  "[R]isks understood, continue anyway, OR PRESS ANY OTHER KEY TO TERMINATE.");
-
-	// Allow scrolling with up and down arrows
-	wrefresh(errWindow);
 	while (true)
 	{
-		int ch = wgetch(errWindow);
-
-		// Scroll up or down with the arrow keys
-		if (ch == ERR);
-		else if (ch == KEY_UP && view_offset > 0)
-		{
-			--view_offset;	// Scroll up
-		}
-		else if (ch == KEY_DOWN && view_offset + (scr_max_y - 7) < total_lines)
-		{
-			++view_offset;	// Scroll down
-		}
-		else if (ch == KEY_UP || ch == KEY_LEFT || ch == KEY_DOWN || ch == KEY_LEFT)
+		int rows, cols;
+		getmaxyx(win, rows, cols);
+		size_t width = cols > 2 ? cols - 2 : 1;	// inside the border
+		size_t visible = rows > 3 ? rows - 3 : 0;	// and above the last line
+
+		auto it = layouts.find(width);
+		if (it == layouts.end())
+			it = layouts.emplace(width, WrappedText(message, width)).first;
+		WrappedText & text = it->second;
+		size_t first = text.row_at(top);
+
+		werase(win);
+		box(win, 0, 0);
+		mvwaddnstr(win, 0, std::max(0, (cols - (int)title.size()) / 2), title.c_str(), cols);
+
+		std::string_view row;
+		shown.resize(width);
+		for (size_t i = 0; i < visible && text.row(first + i, row); i++)
+			mvwaddnstr(win, i + 1, 1, shown.data(), WrappedText::shown(row, &shown[0]));
+
+		mvwaddnstr(win, rows - 2, std::max(0, (cols - (int)strlen(footer)) / 2), footer, cols - 2);
+		wrefresh(win);
+
+		ch = wgetch(win);
+		size_t to = first;
+		if (ch == ERR || ch == KEY_LEFT || ch == KEY_RIGHT)
 			continue;
-		else if (std::tolower(ch) == 'r')
-			return false;
-		else
+		else if (ch == KEY_RESIZE)
 		{
-			// Any non-arrow key closes the message box
-			break;	// Exit on any non-arrow key
+			wresize(win, std::max(LINES - 4, 4), std::max(COLS - 4, 4));
+			continue;
 		}
-
-		// Re-render the window with the updated view_offset
-		werase(errWindow);
-		box(errWindow, 0, 0);
-		mvwprintw(errWindow, 0, (scr_max_x - title.size() - 7) / 2, "FATAL ERROR: %s", title.c_str());
-		for (size_t i = 0; i < scr_max_y - 7 && i + view_offset < total_lines; ++i)
+		else if (ch == KEY_UP)
+			to = first > 0 ? first - 1 : 0;
+		else if (ch == KEY_PPAGE)
+			to = first > visible ? first - visible : 0;
+		else if (ch == KEY_DOWN || ch == KEY_NPAGE)
 		{
-			mvwprintw(errWindow, i + y_offset, 1, "%s", wrapped_lines[i + view_offset].c_str());
+			// only as far as the last row reaching the bottom
+			size_t step = (ch == KEY_DOWN) ? 1 : std::max < size_t > (visible, 1);
+			while (step-- > 0 && text.row(to + visible, row))
+				to++;
 		}
+		else
+			break;
 
-		mvwprintw(errWindow, scr_max_y - 6, (scr_max_x - 73) / 2,
-			  "[R]isks understood, continue anyway, OR PRESS ANY OTHER KEY TO TERMINATE.");
-		wrefresh(errWindow);	// Refresh the window with updated
-		// content
+		if (text.row(to, row))
+			top = row.data() - message.data();
 	}
 
-	delwin(errWindow);	// Clean up
+	delwin(win);		// Clean up
 	curs_set(prev);
-
-	return true;
+	return ch;
 }
 
+// returns true if the dialog displayed
+// returns false if fallback was used
 
-// Function to show an error message
-bool show_err(const std::string & title, const std::string & message)
+// Function to show fatal error message has 
+// FALSE -> [R]isks understood, continue anyway, OR 
+// TRUE -> PRESS ANY OTHER KEY TO TERMINATE.
+bool show_fatal(const std::string & title, const std::string & message)
 {
-	WINDOW *errWindow = newwin(scr_max_y - 4, scr_max_x - 4, 2, 2);
-	int prev = curs_set(0);
-
-	if (!errWindow)
+	int ch = dialog("FATAL ERROR: " + title, COLOR_PAIR_ERR,
+			"[R]isks understood, continue anyway, OR PRESS ANY OTHER KEY TO TERMINATE.", message);
+	if (ch == ERR)
 	{
-		std::cerr << "ERROR (fallback) - " << title << "\n" << message << "\n";
+		std::cerr << "FATAL ERROR (fallback) - " << title << "\n" << message << "\n";
 		return false;
 	}
+	return std::tolower(ch) != 'r';
+}
 
-	// Enable keypad input to capture arrow keys
-	keypad(errWindow, TRUE);
-
-	// Draw box around the message window
-	box(errWindow, 0, 0);
-
-	// Set background color for error
-#if HAVE_COLOR
-	if (console_color)
-	{
-		wbkgd(errWindow, COLOR_PAIR(COLOR_PAIR_ERR));
-	}
-#endif
-
-	mvwprintw(errWindow, 0, (scr_max_x - title.size() - 7) / 2, "ERROR: %s", title.c_str());
-
-	size_t max_message_width = scr_max_x - 4;	// Considering the
-	// border (2
-	// on each side)
-	std::vector < std::string > wrapped_lines;
-	wrap_message(message, max_message_width, wrapped_lines);
-
-	size_t total_lines = wrapped_lines.size();
-	size_t y_offset = 1;	// Start printing from the second row (after
-	// the title)
-	size_t view_offset = 0;	// Keeps track of the current scroll position
-
-	// Initial rendering of the wrapped message
-	for (size_t i = 0; i < scr_max_y - 6 && i + view_offset < total_lines; ++i)
-	{
-		mvwprintw(errWindow, i + y_offset, 1, "%s", wrapped_lines[i + view_offset].c_str());
-	}
-
-	mvwprintw(errWindow, scr_max_y - 6, (scr_max_x - 25) / 2, "Press any key to close...");
-
-	// Allow scrolling with up and down arrows
-	wrefresh(errWindow);
-	while (true)
+// Function to show an error message
+bool show_err(const std::string & title, const std::string & message)
+{
+	if (dialog("ERROR: " + title, COLOR_PAIR_ERR, "Press any key to close...", message) == ERR)
 	{
-		int ch = wgetch(errWindow);
-
-		// Scroll up or down with the arrow keys
-		if (ch == ERR);
-		else if (ch == KEY_UP && view_offset > 0)
-		{
-			--view_offset;	// Scroll up
-		}
-		else if (ch == KEY_DOWN && view_offset + (scr_max_y - 7) < total_lines)
-		{
-			++view_offset;	// Scroll down
-		}
-		else if (ch == KEY_UP || ch == KEY_LEFT || ch == KEY_DOWN || ch == KEY_LEFT)
-			continue;
-		else
-		{
-			// Any non-arrow key closes the message box
-			break;	// Exit on any non-arrow key
-		}
-
-		// Re-render the window with the updated view_offset
-		werase(errWindow);
-		box(errWindow, 0, 0);
-		mvwprintw(errWindow, 0, (scr_max_x - title.size() - 7) / 2, "ERROR: %s", title.c_str());
-		for (size_t i = 0; i < scr_max_y - 7 && i + view_offset < total_lines; ++i)
-		{
-			mvwprintw(errWindow, i + y_offset, 1, "%s", wrapped_lines[i + view_offset].c_str());
-		}
-
-		mvwprintw(errWindow, scr_max_y - 6, (scr_max_x - 25) / 2, "Press any key to close...");
-		wrefresh(errWindow);	// Refresh the window with updated
-		// content
+		std::cerr << "ERROR (fallback) - " << title << "\n" << message << "\n";
+		return false;
 	}
-
-	delwin(errWindow);	// Clean up
-	curs_set(prev);
 	return true;
 }
 
 // Function to show a warning message
 bool show_warn(const std::string & title, const std::string & message)
 {
-	WINDOW *warnWindow = newwin(scr_max_y - 4, scr_max_x - 4, 2, 2);
-	int prev = curs_set(0);
-
-	if (!warnWindow)
+	if (dialog("WARNING: " + title, COLOR_PAIR_WARN, "Press any key to close...", message) == ERR)
 	{
 		std::cerr << "ERROR (fallback) - " << title << "\n" << message << "\n";
 		return false;
 	}
-
-	// Enable keypad input to capture arrow keys
-	keypad(warnWindow, TRUE);
-
-	// Draw box around the message window
-	box(warnWindow, 0, 0);
-
-	// Set background color for warning
-#if HAVE_COLOR
-	if (console_color)
-	{
-		wbkgd(warnWindow, COLOR_PAIR(COLOR_PAIR_WARN));
-	}
-#endif
-
-	mvwprintw(warnWindow, 0, (scr_max_x - title.size() - 9) / 2, "WARNING: %s", title.c_str());
-
-	size_t max_message_width = scr_max_x - 4;	// Considering the
-	// border (2
-	// on each side)
-	std::vector < std::string > wrapped_lines;
-	wrap_message(message, max_message_width, wrapped_lines);
-
-	size_t total_lines = wrapped_lines.size();
-	size_t y_offset = 1;	// Start printing from the second row (after
-	// the title)
-	size_t view_offset = 0;	// Keeps track of the current scroll position
-
-	// Initial rendering of the wrapped message
-	for (size_t i = 0; i < scr_max_y - 7 && i + view_offset < total_lines; ++i)
-	{
-		mvwprintw(warnWindow, i + y_offset, 1, "%s", wrapped_lines[i + view_offset].c_str());
-	}
-
-	mvwprintw(warnWindow, scr_max_y - 6, (scr_max_x - 25) / 2, "Press any key to close...");
-
-	// Allow scrolling with up and down arrows
-	wrefresh(warnWindow);
-	while (true)
-	{
-		int ch = wgetch(warnWindow);
-
-		// Scroll up or down with the arrow keys
-		if (ch == ERR);
-		else if (ch == KEY_UP && view_offset > 0)
-		{
-			--view_offset;	// Scroll up
-		}
-		else if (ch == KEY_DOWN && view_offset + (scr_max_y - 7) < total_lines)
-		{
-			++view_offset;	// Scroll down
-		}
-		else if (ch == KEY_UP || ch == KEY_LEFT || ch == KEY_DOWN || ch == KEY_LEFT)
-			continue;
-		else
-		{
-			// Any non-arrow key closes the message box
-			break;	// Exit on any non-arrow key
-		}
-
-		// Re-render the window with the updated view_offset
-		werase(warnWindow);
-		box(warnWindow, 0, 0);
-		mvwprintw(warnWindow, 0, (scr_max_x - title.size() - 9) / 2, "WARNING: %s", title.c_str());
-		for (size_t i = 0; i < scr_max_y - 7 && i + view_offset < total_lines; ++i)
-		{
-			mvwprintw(warnWindow, i + y_offset, 1, "%s", wrapped_lines[i + view_offset].c_str());
-		}
-
-		mvwprintw(warnWindow, scr_max_y - 6, (scr_max_x - 25) / 2, "Press any key to close...");
-		wrefresh(warnWindow);	// Refresh the window with updated
-		// content
-	}
-
-	delwin(warnWindow);	// Clean up
-	curs_set(prev);
 	return true;
 }
 
 // Function to show a normal message
 bool show_norm(const std::string & title, const std::string & message)
 {
-	WINDOW *normWindow = newwin(scr_max_y - 4, scr_max_x - 4, 2, 2);
-	int prev = curs_set(0);
-
-	if (!normWindow)
+	if (dialog(title, COLOR_PAIR_NORMAL, "Press any key to close...", message) == ERR)
 	{
 		std::cerr << "ERROR (fallback) - " << title << "\n" << message << "\n";
 		return false;
 	}
+	return true;
+}
 
-	// Enable keypad input to capture arrow keys
-	keypad(normWindow, TRUE);
-
-	// Draw box around the message window
-	box(normWindow, 0, 0);
+std::string bytes_text(double bytes)
+{
+	char text[32];
+	if (bytes >= 1e9)
+		snprintf(text, sizeof(text), "%.2f GB", bytes / 1e9);
+	else if (bytes >= 1e6)
+		snprintf(text, sizeof(text), "%.1f MB", bytes / 1e6);
+	else
+		snprintf(text, sizeof(text), "%.0f KB", bytes / 1e3);
+	return text;
+}
 
-	// Set background color for normal message
-#if HAVE_COLOR
-	if (console_color)
+bool run_with_progress(const std::string & title, const std::function < void (Progress &) > &job,
+		       const std::function < void (Progress &) > &tick)
+{
+	typedef std::chrono::steady_clock clock;
+	Progress progress;
+	std::atomic < bool > finished(false);
+	auto start = clock::now();
+	std::thread worker([&]()
+			   {
+				   job(progress);
+				   finished = true;
+			   });
+
+	// a quick job never shows a box
+	while (!finished && clock::now() - start < std::chrono::milliseconds(150))
+		std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+	WINDOW *win = NULL;
+	int width = std::min(64, (int)scr_max_x - 4);
+	if (!finished && width > 8)
+		win = newwin(7, width, std::max(0, (int)scr_max_y / 2 - 4), ((int)scr_max_x - width) / 2);
+	int prev = curs_set(0);
+	if (win != NULL)
 	{
-		wbkgd(normWindow, COLOR_PAIR(COLOR_PAIR_NORMAL));
-	}
+		keypad(win, TRUE);
+		wtimeout(win, 10);	// how soon the box goes when the job ends
+#if HAVE_COLOR
+		if (console_color)
+			wbkgd(win, COLOR_PAIR(COLOR_PAIR_NORMAL));
 #endif
-
-	mvwprintw(normWindow, 0, (scr_max_x - title.size() - 1) / 2, "%s", title.c_str());
-
-	size_t max_message_width = scr_max_x - 4;	// Considering the
-	// border (2
-	// on each side)
-	std::vector < std::string > wrapped_lines;
-	wrap_message(message, max_message_width, wrapped_lines);
-
-	size_t total_lines = wrapped_lines.size();
-	size_t y_offset = 1;	// Start printing from the second row (after
-	// the title)
-	size_t view_offset = 0;	// Keeps track of the current scroll position
-
-	// Initial rendering of the wrapped message
-	for (size_t i = 0; i < scr_max_y - 6 && i + view_offset < total_lines; ++i)
-	{
-		mvwprintw(normWindow, i + y_offset, 1, "%s", wrapped_lines[i + view_offset].c_str());
 	}
 
-	mvwprintw(normWindow, scr_max_y - 6, (scr_max_x - 25) / 2, "Press any key to close...");
-
-	// Allow scrolling with up and down arrows
-	wrefresh(normWindow);
-	while (true)
+	auto drawn = clock::time_point();
+	while (!finished && win != NULL)
 	{
-		int ch = wgetch(normWindow);
-
-		// Scroll up or down with the arrow keys
-		if (ch == ERR);
-		else if (ch == KEY_UP && view_offset > 0)
+		if (clock::now() - drawn >= std::chrono::milliseconds(100))
 		{
-			--view_offset;	// Scroll up
-		}
-		else if (ch == KEY_DOWN && view_offset + (scr_max_y - 7) < total_lines)
-		{
-			++view_offset;	// Scroll down
-		}
-		else if (ch == KEY_UP || ch == KEY_LEFT || ch == KEY_DOWN || ch == KEY_LEFT)
-			continue;
-		else
-		{
-			// Any non-arrow key closes the message box
-			break;	// Exit on any non-arrow key
+			drawn = clock::now();
+			if (tick)
+				tick(progress);
+			int cols = getmaxx(win);
+			double seconds = std::chrono::duration < double >(drawn - start).count();
+			double done = progress.done, total = progress.total;
+			double rate = seconds > 0 ? done / seconds : 0;
+
+			werase(win);
+			box(win, 0, 0);
+			mvwaddnstr(win, 0, std::max(0, (cols - (int)title.size() - 2) / 2), (" " + title + " ").c_str(),
+				   cols);
+
+			// the bar, then how much, how fast and how long yet
+			char line[128];
+			int bar = cols - 4;
+			if (total > 0 && bar > 0)
+			{
+				int filled = (int)(bar * std::min(1.0, done / total));
+				mvwaddch(win, 2, 1, '[');
+				for (int i = 0; i < bar; i++)
+					waddch(win, i < filled ? '#' : '.');
+				waddch(win, ']');
+				double left = rate > 0 ? (total - done) / rate : 0;
+				snprintf(line, sizeof(line), "%s of %s, %s/s, %.0f s left", bytes_text(done).c_str(),
+					 bytes_text(total).c_str(), bytes_text(rate).c_str(), std::max(0.0, left));
+			}
+			else
+				snprintf(line, sizeof(line), "%s, %s/s, %.0f s so far", bytes_text(done).c_str(),
+					 bytes_text(rate).c_str(), seconds);
+			mvwaddnstr(win, 3, 2, line, cols - 4);
+			mvwaddnstr(win, 5, 2, progress.cancel ? "Canceling..." : "Press ESC to cancel.", cols - 4);
+			wrefresh(win);
 		}
 
-		// Re-render the window with the updated view_offset
-		werase(normWindow);
-		box(normWindow, 0, 0);
-		mvwprintw(normWindow, 0, (scr_max_x - title.size() - 1) / 2, "%s", title.c_str());
-		for (size_t i = 0; i < scr_max_y - 7 && i + view_offset < total_lines; ++i)
-		{
-			mvwprintw(normWindow, i + y_offset, 1, "%s", wrapped_lines[i + view_offset].c_str());
-		}
-
-		mvwprintw(normWindow, scr_max_y - 6, (scr_max_x - 25) / 2, "Press any key to close...");
-		wrefresh(normWindow);	// Refresh the window with updated
-		// content
+		if (wgetch(win) == 27)
+			progress.cancel = true;
 	}
 
-	delwin(normWindow);	// Clean up
+	worker.join();
+	if (win != NULL)
+	{
+		wtimeout(win, -1);
+		delwin(win);
+	}
 	curs_set(prev);
-	return true;
+	return !progress.cancel;
 }
@@ -0,0 +1,272 @@
+/* 
+   dircache.cpp --- directory listings kept between visits
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#if defined(__linux__)
+#include <sys/inotify.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace DirCache
+{
+	namespace fs = std::filesystem;
+
+	static const size_t CACHED = 256;	// directories, and watches held
+	static const size_t FIRST_BATCH = 256;	// entries; each batch doubles
+	static const size_t LAST_BATCH = 65536;	// up to this
+
+	struct Slot
+	{
+		Listing listing;	// null when it has to be read again
+		int watch = -1;	// inotify watch, or -1 to go by mtime
+		fs::file_time_type mtime;
+		unsigned long long changes = 0;	// seen since the watch began
+		unsigned long long used = 0;
+	};
+
+	static std::mutex lock;
+	static std::unordered_map < std::string, Slot > slots;
+	static unsigned long long ticks = 0;
+
+#if defined(__linux__)
+	static int notify = -2;	// not opened yet; -1 if it could not be
+	static std::unordered_map < int, std::string > watched;
+
+	static void changed(Slot & slot)
+	{
+		slot.listing.reset();
+		slot.changes++;
+	}
+
+	static void unwatch(int wd)
+	{
+		if (wd < 0)
+			return;
+		inotify_rm_watch(notify, wd);
+		watched.erase(wd);
+	}
+
+	// Drop the listings of the directories that changed since last time.
+	// The watches stay, so reading one again costs no more system calls
+	// than reading it the first time did.
+	static void drain()
+	{
+		alignas(struct inotify_event) char buf[4096];
+		while (true)
+		{
+			ssize_t n = ::read(notify, buf, sizeof(buf));
+			if (n <= 0)
+				return;	// EAGAIN: nothing more
+
+			for (char *p = buf; p < buf + n;)
+			{
+				const struct inotify_event *ev = (const struct inotify_event *)p;
+				p += sizeof(struct inotify_event) + ev->len;
+
+				if (ev->mask & IN_Q_OVERFLOW)	// lost count, trust nothing
+				{
+					for (auto & slot:slots)
+						changed(slot.second);
+					continue;
+				}
+				auto w = watched.find(ev->wd);
+				if (w == watched.end())
+					continue;
+				auto s = slots.find(w->second);
+				if (ev->mask & IN_IGNORED)	// the directory went away
+				{
+					if (s != slots.end())
+						slots.erase(s);
+					watched.erase(w);
+				}
+				else if (ev->mask & (IN_MOVE_SELF | IN_DELETE_SELF))
+				{
+					// the watch follows it to its new name; a directory
+					// made under the old one is another, watched anew
+					if (s != slots.end() && s->second.watch == ev->wd)
+						slots.erase(s);
+					unwatch(ev->wd);
+				}
+				else if (s != slots.end())
+					changed(s->second);
+			}
+		}
+	}
+
+	static int watch(const std::string & dir)
+	{
+		if (notify == -2)
+			notify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+		if (notify < 0)
+			return -1;
+
+		int wd = inotify_add_watch(notify, dir.c_str(),
+					   IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF |
+					   IN_MOVE_SELF | IN_ONLYDIR);
+		if (wd >= 0)
+			watched[wd] = dir;
+		return wd;	// out of watches: fall back on mtime
+	}
+#else
+	static void drain()
+	{
+	}
+
+	static int watch(const std::string & dir)
+	{
+		return -1;
+	}
+
+	static void unwatch(int wd)
+	{
+	}
+#endif
+
+	// one key however the path was written
+	static std::string key_of(const std::string & dir)
+	{
+		std::error_code ec;
+		fs::path p = fs::absolute(dir, ec).lexically_normal();
+		if (!p.has_filename() && p.has_parent_path() && p != p.root_path())
+			p = p.parent_path();	// "a/b/" is "a/b"
+		return p.string();
+	}
+
+	static void evict()
+	{
+		auto oldest = slots.begin();
+		for (auto it = slots.begin(); it != slots.end(); ++it)
+		{
+			if (it->second.used < oldest->second.used)
+				oldest = it;
+		}
+		unwatch(oldest->second.watch);
+		slots.erase(oldest);
+	}
+
+	Listing lookup(const std::string & dir, unsigned long long & ticket)
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		drain();
+
+		std::string key = key_of(dir);
+		std::error_code ec;
+		auto it = slots.find(key);
+		if (it != slots.end() && it->second.listing)
+		{
+			Slot & slot = it->second;
+			if (slot.watch >= 0 || fs::last_write_time(key, ec) == slot.mtime)
+			{
+				slot.used = ++ticks;
+				return slot.listing;
+			}
+		}
+
+		if (it == slots.end())
+		{
+			if (slots.size() >= CACHED)
+				evict();
+			it = slots.emplace(key, Slot()).first;
+			it->second.watch = watch(key);	// before reading, to miss nothing
+		}
+		Slot & slot = it->second;
+		slot.mtime = fs::last_write_time(key, ec);
+		slot.used = ++ticks;
+		ticket = slot.changes;
+		return nullptr;
+	}
+
+	void store(const std::string & dir, unsigned long long ticket, const Listing & listing)
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		drain();
+
+		// changed while it was being read, or evicted: keep nothing
+		auto it = slots.find(key_of(dir));
+		if (it == slots.end() || it->second.changes != ticket)
+			return;
+		it->second.listing = listing;
+		it->second.used = ++ticks;
+	}
+
+	// d_type answers is_directory without a stat for most entries. The
+	// batches start small, so the first entries come at once, and double,
+	// so there are few of them in a big directory; a caller that wants to
+	// stop is never kept waiting for more than the last batch.
+	bool read(const std::string & dir, const std::function < bool (std::vector < Entry > &) > &batch)
+	{
+		Memory::Scope memory(Memory::DIRECTORY);
+		std::error_code ec;
+		std::vector < Entry > entries;
+		size_t size = FIRST_BATCH;
+		entries.reserve(size);
+
+		fs::directory_iterator it(dir, ec);
+		for (; !ec && it != fs::directory_iterator(); it.increment(ec))
+		{
+			std::error_code type_ec;
+			Entry entry;
+			entry.name = it->path().filename().string();
+			entry.is_directory = it->is_directory(type_ec);
+			entries.push_back(std::move(entry));
+
+			if (entries.size() == size)
+			{
+				if (!batch(entries))
+					return false;
+				entries.clear();
+				size = std::min(size * 2, LAST_BATCH);
+				entries.reserve(size);
+			}
+		}
+		if (ec)
+			return false;
+		return entries.empty() || batch(entries);
+	}
+
+	Listing list(const std::string & dir)
+	{
+		Memory::Scope memory(Memory::DIRECTORY);
+		unsigned long long ticket;
+		Listing cached = lookup(dir, ticket);
+		if (cached)
+			return cached;
+
+		auto listing = std::make_shared < std::vector < Entry > >();
+		bool whole = read(dir,[&](std::vector < Entry > &entries)
+				  {
+					  std::move(entries.begin(), entries.end(), std::back_inserter(*listing));
+					  return true;
+				  });
+		if (whole)	// unreadable: show what there is, keep nothing
+			store(dir, ticket, listing);
+		return listing;
+	}
+}				// namespace DirCache
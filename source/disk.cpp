@@ -0,0 +1,228 @@
+/* 
+   disk.cpp --- noticing the open file change on disk, and taking it in
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+namespace Disk
+{
+	static const size_t MAX_EDITS = 2000;	// lines a diff matches up, at most
+
+	// what the file held when the buffer last matched it
+	struct Seen
+	{
+		std::string path;
+		bool exists = false;
+		unsigned long long size = 0;
+		std::filesystem::file_time_type mtime;
+		unsigned long long hash = 0;
+	};
+
+	static Seen seen;
+	static bool newer = false;	// it holds what the buffer never took in
+
+	// eight bytes a step, the bytes left one at a time; gigabytes a second
+	static unsigned long long hash_of(const char *p, size_t n)
+	{
+		unsigned long long h = 0x9e3779b97f4a7c15ULL ^ n;
+		size_t i = 0;
+		for (; i + 8 <= n; i += 8)
+		{
+			unsigned long long w;
+			memcpy(&w, p + i, 8);
+			h = (h ^ w) * 0xff51afd7ed558ccdULL;
+			h ^= h >> 32;
+		}
+		for (; i < n; i++)
+			h = (h ^ (unsigned char)p[i]) * 0x100000001b3ULL;
+		return h;
+	}
+
+	static Seen look(const std::string & path)
+	{
+		Seen s;
+		std::error_code ec;
+		s.path = path;
+		s.size = std::filesystem::file_size(path, ec);
+		s.exists = !ec;
+		if (s.exists)
+			s.mtime = std::filesystem::last_write_time(path, ec);
+		return s;
+	}
+
+	void remember(const std::string & path, const std::string & text)
+	{
+		seen = look(path);
+		seen.hash = hash_of(text.data(), text.size());
+		newer = false;
+	}
+
+	void ignore(const std::string & path)
+	{
+		unsigned long long hash = seen.hash;
+		seen = look(path);
+		seen.hash = hash;
+		newer = true;
+	}
+
+	bool stale()
+	{
+		return newer;
+	}
+
+	bool touched(const std::string & path)
+	{
+		if (path != seen.path)
+			return false;
+		Seen now = look(path);
+		return now.exists != seen.exists || now.size != seen.size || now.mtime != seen.mtime;
+	}
+
+	bool changed(const std::string & path, std::string & text, Progress * progress)
+	{
+		Seen now = look(path);
+		if (!readfile(path, text, progress))
+			return false;
+		now.hash = hash_of(text.data(), text.size());
+		if (now.hash != seen.hash)
+			return true;
+
+		seen = now;	// only touched
+		return false;
+	}
+
+	// where every line of text[from, to) begins, and to
+	static std::vector < size_t > line_starts(const std::string & text, size_t from, size_t to)
+	{
+		std::vector < size_t > starts;
+		for (size_t at = from; at < to;)
+		{
+			starts.push_back(at);
+			const char *nl = (const char *)memchr(text.data() + at, '\n', to - at);
+			at = nl ? nl - text.data() + 1 : to;
+		}
+		starts.push_back(to);
+		return starts;
+	}
+
+	void diff(const std::string & old, const std::string & now, std::vector < size_t > &at,
+		  std::vector < size_t > &lens, std::string & texts, std::vector < size_t > &sizes)
+	{
+		// what is the same at both ends is left alone, in whole lines
+		size_t common = std::min(old.size(), now.size());
+		size_t head = 0;
+		while (head < common && old[head] == now[head])
+			head++;
+		while (head > 0 && old[head - 1] != '\n')
+			head--;
+		size_t tail = 0;
+		while (tail < common - head && old[old.size() - 1 - tail] == now[now.size() - 1 - tail])
+			tail++;
+		while (tail > 0 && old[old.size() - tail - 1] != '\n')
+			tail--;
+		if (head == old.size() && head == now.size())
+			return;
+
+		// the lines between, matched up by Myers' diff on their hashes
+		std::vector < size_t > a = line_starts(old, head, old.size() - tail);
+		std::vector < size_t > b = line_starts(now, head, now.size() - tail);
+		int n = a.size() - 1, m = b.size() - 1;
+		std::vector < unsigned long long > ha(n), hb(m);
+		for (int i = 0; i < n; i++)
+			ha[i] = hash_of(old.data() + a[i], a[i + 1] - a[i]);
+		for (int j = 0; j < m; j++)
+			hb[j] = hash_of(now.data() + b[j], b[j + 1] - b[j]);
+		auto same =[&](int i, int j)
+		{
+			return ha[i] == hb[j] && a[i + 1] - a[i] == b[j + 1] - b[j]
+				&& memcmp(old.data() + a[i], now.data() + b[j], a[i + 1] - a[i]) == 0;
+		};
+
+		// v[k] is how far along old the furthest path on diagonal k got;
+		// each round's is kept, from -d - 1 to d + 1, to walk back
+		int most = std::min < int >(n + m, MAX_EDITS);
+		std::vector < int > v(2 * most + 3, 0);
+		int mid = most + 1;
+		std::vector < std::vector < int > > trace;
+		int edits = -1;
+		for (int d = 0; d <= most && edits < 0; d++)
+		{
+			trace.emplace_back(v.begin() + mid - d - 1, v.begin() + mid + d + 2);
+			for (int k = -d; k <= d; k += 2)
+			{
+				int x = (k == -d || (k != d && v[mid + k - 1] < v[mid + k + 1]))? v[mid + k + 1] :
+					v[mid + k - 1] + 1;
+				int y = x - k;
+				while (x < n && y < m && same(x, y))
+					x++, y++;
+				v[mid + k] = x;
+				if (x >= n && y >= m)
+				{
+					edits = d;
+					break;
+				}
+			}
+		}
+
+		// the lines matched, last first; none if they differ too much
+		std::vector < std::pair < int, int > > matched;
+		for (int d = edits, x = n, y = m; d >= 0; d--)
+		{
+			const std::vector < int > &w = trace[d];
+			auto at_k =[&](int k)
+			{
+				return w[k + d + 1];
+			};
+			int k = x - y;
+			int prev_k = (k == -d || (k != d && at_k(k - 1) < at_k(k + 1))) ? k + 1 : k - 1;
+			int prev_x = (d == 0) ? 0 : at_k(prev_k);
+			int prev_y = prev_x - prev_k;
+			if (d == 0)
+				prev_y = 0;
+			while (x > prev_x && y > prev_y)
+				matched.push_back(std::make_pair(--x, --y));
+			x = prev_x;
+			y = prev_y;
+		}
+		matched.push_back(std::make_pair(-1, -1));
+		std::reverse(matched.begin(), matched.end());
+		matched.push_back(std::make_pair(n, m));
+
+		// every gap between matched lines is a piece
+		for (size_t i = 1; i < matched.size(); i++)
+		{
+			int i0 = matched[i - 1].first + 1, i1 = matched[i].first;
+			int j0 = matched[i - 1].second + 1, j1 = matched[i].second;
+			if (i0 == i1 && j0 == j1)
+				continue;
+			at.push_back(a[i0]);
+			lens.push_back(a[i1] - a[i0]);
+			texts.append(now, b[j0], b[j1] - b[j0]);
+			sizes.push_back(b[j1] - b[j0]);
+		}
+	}
+}				// namespace Disk
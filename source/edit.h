@@ -49,23 +49,615 @@
 // file and buffer operations
 #include <fstream>
 
-// expect to handle std::runtime_error if there is a problem whilest reading
+struct Progress;
+
+// expect to handle std::runtime_error if there is a problem whilest reading;
+// with progress, they report how far they got and return false if canceled
 bool readfile(const std::string & file,	// IN
-	      std::string & buffer);	// OUT
+	      std::string & buffer,	// OUT
+	      Progress * progress = NULL);
 bool writefile(const std::string & file,	// IN
-	       const std::string & buffer);	// IN
+	       const std::string & buffer,	// IN
+	       Progress * progress = NULL);
+// where a file the editor keeps between runs goes: name, in the user's
+// cache directory; empty if there is none
+std::string cache_path(const std::string & name);
 size_t getNthDelimWithOffset(std::string & buffer, size_t n, size_t offset, char delim = '\n');
 bool extractSingleLineFromBuf(std::string & result, std::string & buffer, size_t startLine, char delim = '\n');
 bool extractLinesFromBuf(std::vector < std::string > &result,
 			 std::string & buffer, size_t startLine, size_t numLines, char delim = '\n');
 
-// main.cpp
+// buffer.cpp
+// line index and edit primitives over the buffer
+#include <cstring>
+#include <memory>
 extern std::string filebuf;
 extern std::string filename;	// filename path
 
+// len bytes at pos become the size bytes at text; an edit made in many
+// places at once is a list of these, ascending and apart
+struct Splice
+{
+	size_t pos;
+	size_t len;
+	const char *text;
+	size_t size;
+};
+
+// offsets of the first byte of every line; kept in step with filebuf by the
+// buffer_* edit functions instead of rescanning on every keystroke
+class LineIndex
+{
+      public:
+	void build(const std::string & buffer, char delim = '\n');
+	void inserted(size_t pos, const char *text, size_t len, char delim = '\n');
+	void erased(size_t pos, size_t len);
+	void spliced(const std::vector < Splice > &pieces, char delim = '\n');
+
+	size_t count() const
+	{
+		return starts.size();
+	}
+	size_t start(size_t line) const
+	{
+		return starts[line];
+	}
+	size_t end(size_t line) const	// offset of the delimiter, or size
+	{
+		return line + 1 < starts.size()? starts[line + 1] - 1 : total;
+	}
+	size_t length(size_t line) const
+	{
+		return end(line) - start(line);
+	}
+	size_t line_of(size_t offset) const;
+
+	// the whole index, for keeping it elsewhere and taking it back; a
+	// buffer that only grew at its end needs only the bytes from from
+	// indexed again
+	const std::vector < size_t > &offsets() const
+	{
+		return starts;
+	}
+	void assign(std::vector < size_t > &&offsets, size_t size);
+	void extend(const std::string & buffer, size_t from, char delim = '\n');
+
+      private:
+	  std::vector < size_t > starts = { 0 };
+	size_t total = 0;
+};
+
+extern LineIndex buflines;	// index over filebuf
+
+// document statistics, updated by the size of every edit rather than by
+// rescanning the buffer; the line count is buflines.count()
+struct DocStats
+{
+	size_t chars = 0;	// UTF-8 characters
+	size_t words = 0;	// runs of non-whitespace
+	bool modified = false;
+};
+
+extern DocStats docstats;
+size_t count_word_starts(const std::string & buffer, size_t from, size_t to);
+size_t count_chars(const char *text, size_t len);
+
+// linecache.cpp
+// line indexes of large files kept between runs, so that opening one
+// again does not scan it
+namespace LineCache
+{
+	// fill index and stats for the text of path, just read, from what was
+	// kept for it; true if it could, reading only the end of a file that
+	// was appended to since
+	bool restore(const std::string & path, const std::string & text, LineIndex & index, DocStats & stats);
+	void keep(const std::string & path, const std::string & text, const LineIndex & index,
+		  const DocStats & stats);
+}				// namespace LineCache
+
+void buffer_reset();		// filebuf was replaced wholesale (opened a file)
+// open a file; with progress, false if canceled. Throws
+// std::runtime_error, leaving the buffer as it was either way.
+bool buffer_load(const std::string & path, Progress * progress = NULL);
+void buffer_insert(size_t pos, const std::string & text);
+void buffer_append(const char *text, size_t len);	// arrived, not typed: no undo
+void buffer_erase(size_t pos, size_t len);
+// erase or insert as an undo step of its own that shares the text, which
+// is how registers cut and paste without copying it again
+std::shared_ptr < const std::string > buffer_cut(size_t pos, size_t len);
+void buffer_paste(size_t pos, const std::shared_ptr < const std::string > &text);
+// replace the pieces [at[i], at[i] + lens[i]), ascending and apart, with
+// text in one pass over the buffer and as one undo step; the count
+size_t buffer_replace(const std::vector < size_t > &at, const std::vector < size_t > &lens, const std::string & text);
+// the same, piece i becoming the next sizes[i] bytes of texts
+size_t buffer_replace(const std::vector < size_t > &at, const std::vector < size_t > &lens,
+		      const std::string & texts, const std::vector < size_t > &sizes);
+// the bytes of a replace on any text, which the caller checked; its index
+// follows with LineIndex::spliced
+void splice_text(std::string & text, const std::vector < Splice > &pieces);
+size_t buffer_undo();		// where the cursor goes, npos if nothing to undo
+size_t buffer_redo();
+size_t buffer_line_length(size_t line);	// excludes the delimiter and any CR
+size_t buffer_offset(size_t line, size_t col);	// col is clamped to the line
+
+// block.cpp
+// rectangular selections, edited on every line at once
+namespace Block
+{
+	struct Rect
+	{
+		size_t first, last;	// lines, inclusive
+		size_t left, right;	// byte columns, right exclusive
+	};
+
+	std::string text(const Rect & r);	// its rows, joined by '\n'
+	// each of these is one undo step, and returns the lines changed
+	size_t erase(const Rect & r);
+	size_t type(const Rect & r, const std::string & text);	// on every row
+	size_t paste(size_t line, size_t col, const std::string & rows);
+}				// namespace Block
+
+// registers.cpp
+// named registers for cut, copy and paste
+namespace Registers
+{
+	// Text cut or copied. A copy only notes where the text is while the
+	// buffer around it stays the same, and takes the bytes the first time
+	// an edit would change or move them; cut text is the string its undo
+	// step keeps, and a paste shares it with the paste's undo step.
+	struct Register
+	{
+		bool live = false;	// the text is still filebuf[pos, pos + len)
+		size_t pos = 0;
+		size_t len = 0;
+		  std::shared_ptr < const std::string > text;	// otherwise
+		bool block = false;	// rows of a block, pasted one per line
+	};
+
+	extern char current;	// what Cut, Copy and Paste use, a-z or " (unnamed)
+
+	bool valid(char name);
+	size_t size(char name);	// bytes held
+	bool block(char name);	// holds the rows of a block
+	void copy(size_t pos, size_t len);
+	void cut(size_t pos, size_t len);
+	void copy_block(const Block::Rect & r);
+	void cut_block(const Block::Rect & r);
+	size_t paste(size_t pos);	// bytes pasted
+
+	// called by the buffer: filebuf[pos, pos + removed) is about to
+	// become added bytes, or is about to be replaced altogether
+	void edited(size_t pos, size_t removed, size_t added);
+	void detach();
+}				// namespace Registers
+
+// highlight.cpp
+// incremental syntax highlighting
+namespace Highlight
+{
+	enum Class
+	{
+		HL_NORMAL = 0,
+		HL_KEYWORD,
+		HL_COMMENT,
+		HL_STRING,
+		HL_NUMBER,
+		HL_PREPROC
+	};
+
+	void reset(const std::string & path);	// pick a syntax, drop all states
+	// lines [line, line + removed] were replaced by [line, line + added]
+	void edited(size_t line, size_t removed, size_t added);
+	// make sure line states are known up to last, the bottom visible line;
+	// every state above it is needed to know its own
+	void prepare(size_t last);
+	// classes for the bytes [from, to) of a prepared line, the first being
+	// from's; valid until the next call. A long line costs only that part.
+	const unsigned char *colorize(size_t line, const char *text, size_t len, size_t from, size_t to);
+	int attr(unsigned char cls);
+	size_t lexed_lines();	// lines lexed since the last reset (statistics)
+}				// namespace Highlight
+
 // strext.cpp
-std::string trim(const std::string & str);
-bool wrap_message(std::string message, size_t max_width, std::vector < std::string > &wrapped_lines);
+// A message wrapped at a width a row at a time, as far as the rows are
+// asked for, so a long one costs what is shown of it. A row is where it
+// lies in the message; its words are shown one space apart. A newline
+// ends a paragraph and leaves an empty row after it, and a word wider
+// than a row is cut.
+#include <string_view>
+class WrappedText
+{
+      public:
+	WrappedText(std::string_view message, size_t width);
+	bool row(size_t i, std::string_view & row);	// false past the last row
+	size_t row_at(size_t offset);	// the row showing the byte at offset
+	size_t width() const
+	{
+		return cols;
+	}
+	// the row as shown into out, which has room for width() bytes; its length
+	static size_t shown(std::string_view row, char *out);
+
+      private:
+	bool more();
+
+	std::string_view text;
+	size_t cols;
+	size_t next = 0;	// where the next row starts looking
+	  std::vector < std::pair < size_t, size_t > >rows;	// [begin, end) of each
+};
+
+// ASCII case folding by table; std::tolower costs a call a byte, and
+// sorting half a million names makes tens of millions of them
+struct AsciiFold
+{
+	unsigned char to[256];
+	  AsciiFold();
+};
+extern const AsciiFold ascii_fold;
+
+// .git, .svn or .hg: left out of a walk over a tree
+bool is_vcs_dir(const std::string & name);
+
+// pool.cpp
+// a fixed set of worker threads
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <thread>
+class WorkerPool
+{
+      public:
+	explicit WorkerPool(size_t count);	// 0 is taken as 1
+	~WorkerPool();	// runs what is queued, then joins
+
+	void submit(std::function < void () > task);
+	size_t size() const
+	{
+		return threads.size();
+	}
+
+      private:
+	void run();
+
+	std::vector < std::thread > threads;
+	std::deque < std::function < void () > > tasks;
+	std::mutex lock;
+	std::condition_variable wake;
+	bool stopping = false;
+};
+
+WorkerPool & worker_pool();	// shared, one thread per core
+
+// search.cpp
+// literal search over the buffer
+#include <atomic>
+namespace Search
+{
+	// a piece of the buffer; searches walk a list of them and handle
+	// matches across the seams, so the pieces never need to be joined
+	struct Chunk
+	{
+		const char *data;
+		size_t size;
+	};
+	typedef std::vector < Chunk > Chunks;
+
+	// a needle prepared for repeated searching
+	class Literal
+	{
+	      public:
+		Literal(const std::string & needle, bool icase);
+
+		// first match starting at or after from, or npos
+		size_t find(const char *hay, size_t n, size_t from) const;
+		// last match starting before before, or npos
+		size_t rfind(const char *hay, size_t n, size_t before) const;
+		size_t size() const
+		{
+			return needle.size();
+		}
+
+	      private:
+		unsigned char key(unsigned char c) const;
+		bool matches(const char *at) const;
+		size_t horspool(const char *hay, size_t n, size_t from) const;
+		size_t back_horspool(const char *hay, size_t n, size_t before) const;
+
+		  std::string needle;
+		  std::string folded;	// lower cased needle
+		bool icase;
+		size_t rare;	// index of the rarest byte of the needle
+		size_t rare2;	// and of the second rarest
+		size_t shift[256];
+		size_t back_shift[256];
+	};
+
+	Chunks chunks_of(const std::string & buffer);
+	size_t find_next(const Chunks & chunks, const Literal & lit, size_t from);
+	size_t find_prev(const Chunks & chunks, const Literal & lit, size_t before);
+
+	// Every non-overlapping match starting in [from, to), in order. The
+	// range is cut into overlapping pieces searched in parallel on pool;
+	// found() is called on this thread as soon as the pieces before a
+	// match are done, and returns false to stop. False if canceled.
+	bool scan(const Chunks & chunks, const Literal & lit, size_t from, size_t to, WorkerPool & pool,
+		  const std::function < bool (size_t) > &found, const std::atomic < bool > *cancel = NULL);
+	// last match starting before before, searched the same way, or npos
+	size_t scan_back(const Chunks & chunks, const Literal & lit, size_t before, WorkerPool & pool,
+			 const std::atomic < bool > *cancel = NULL);
+
+	// the Search menu's state
+	extern std::string query;
+	extern bool match_case;
+	extern size_t match_pos;	// last match, highlighted on screen
+	extern size_t match_len;
+
+	extern bool use_regex;	// query is a regular expression
+
+	// Find All's matches as (offset, length), in order. A worker fills
+	// them in while the screen shows what has arrived, hence the lock.
+	extern std::vector < std::pair < size_t, size_t > > hits;
+	extern std::mutex hits_lock;
+	extern std::atomic < size_t > counted;	// matches found by the running count
+	extern std::atomic < size_t > scanned;	// bytes a literal search went through
+
+	void forget();		// the buffer changed, drop the match and hits
+
+	// throws std::runtime_error for a bad pattern; cancel, when set
+	// from another thread, stops it early with no match
+	bool find(bool forward, size_t from, const std::atomic < bool > *cancel = NULL);
+	// every non-overlapping match from from on, in order, until found()
+	// returns false; false if canceled
+	bool matches(size_t from, const std::function < bool (size_t, size_t) > &found,
+		     const std::atomic < bool > *cancel = NULL);
+	// count every match of the query, keeping them in hits if asked;
+	// false if canceled
+	bool find_all(bool keep, const std::atomic < bool > *cancel = NULL);
+}				// namespace Search
+
+// isearch.cpp
+// search as you type
+namespace Search
+{
+	// An incremental search from a fixed origin over a buffer that does
+	// not change while it lasts. Each query refines the matches of the
+	// one before it, and going back to a shorter query reuses what was
+	// found for it. Work that does not fit in a frame goes to threads.
+	class Incremental
+	{
+	      public:
+		enum State
+		{
+			FOUND, PENDING, NONE
+		};
+
+		Incremental(const std::string & buffer, size_t origin, bool icase);
+		~Incremental();	// stops and joins the threads
+
+		State update(const std::string & query);	// the query changed
+		State poll();	// when idle: starts threads, picks up what they found
+		size_t match() const;	// first match from the origin on, wrapping
+		size_t count() const;	// all matches, npos while counting
+		// the matches starting in [lo, hi), to highlight
+		void visible(size_t lo, size_t hi, std::vector < std::pair < size_t, size_t > > &out) const;
+
+	      private:
+		struct Job;
+		struct Level;
+
+		void stop(Level & level, bool discard);
+		void start(Level & level, const Level * parent);
+		void resolve(Level & level, const Level * parent);
+		State state();
+		static void run(Job & job, const std::string & buf, const Literal & lit, size_t origin,
+				const Job * parent);
+
+		const std::string & buf;
+		size_t origin;
+		bool icase;
+		  std::vector < Level > levels;
+		  std::vector < std::thread > retired;
+	};
+}				// namespace Search
+
+// regex.cpp
+// regular expressions run by a lazily built DFA
+#include <memory>
+namespace Search
+{
+	// a compiled pattern: . [] [^] * + ? {m,n} | () ^ $ and the escapes
+	// \d \w \s \D \W \S \n \t. Matching is leftmost-longest and linear in
+	// the text. find() grows a cache, so a Regex is for one thread.
+	class Regex
+	{
+	      public:
+		// throws std::runtime_error describing a bad pattern
+		Regex(const std::string & pattern, bool icase);
+		~Regex();
+
+		// leftmost-longest match starting at or after from and before
+		// limit; false if there is none or cancel was raised
+		bool find(const Chunks & chunks, size_t from, size_t & pos, size_t & len,
+			  const std::atomic < bool > *cancel = NULL, size_t limit = std::string::npos);
+
+	      private:
+		struct Program;
+		  std::unique_ptr < Program > prog;
+	};
+}				// namespace Search
+
+// grep.cpp
+// find in files
+namespace Search
+{
+	struct FileHit
+	{
+		std::string path;
+		size_t line;	// from 1
+		size_t column;	// byte offset of the match in its line
+		std::string text;	// the line, or the part around the match
+	};
+
+	// Searches every file under a directory on the worker pool, while
+	// the caller reads the hits found so far. Files go to the pool a few
+	// at a time as the tree is walked and are read a block at a time,
+	// so memory stays the same for any number or size of files; files
+	// that look binary are skipped.
+	class FileSearch
+	{
+	      public:
+		// throws std::runtime_error for a bad pattern
+		FileSearch(const std::string & dir, const std::string & query, bool icase, bool regex);
+		~FileSearch();	// stops and waits for the files being read
+
+		void stop();
+		bool running() const
+		{
+			return !finished;
+		}
+		bool truncated() const	// stopped at HIT_LIMIT hits
+		{
+			return full;
+		}
+		size_t files() const	// searched so far
+		{
+			return searched;
+		}
+		size_t binary_files() const
+		{
+			return skipped;
+		}
+		// lines too long to hold, which a regular expression searched in
+		// parts: a match across two parts is missed, and ^ matches where
+		// a part starts. A literal finds every match in them.
+		size_t split_lines() const
+		{
+			return split;
+		}
+		size_t count() const;
+		FileHit hit(size_t i) const;
+
+		static const size_t HIT_LIMIT = 100000;
+
+	      private:
+		void walk();
+		void search_file(const std::string & path);
+		size_t search_text(const std::string & path, const char *data, size_t n, size_t line, Regex * re,
+				   size_t into, bool & open_hit);
+
+		  std::string root;
+		  std::string query;
+		bool icase;
+		bool regex;
+		  std::unique_ptr < Literal > literal;
+
+		  std::vector < FileHit > hits;
+		mutable std::mutex lock;
+		  std::condition_variable slots;
+		size_t in_flight = 0;	// files handed to the pool and not done
+
+		  std::atomic < bool > canceled { false };
+		  std::atomic < bool > finished { false };
+		  std::atomic < bool > full { false };
+		  std::atomic < size_t > searched { 0 };
+		  std::atomic < size_t > skipped { 0 };
+		  std::atomic < size_t > split { 0 };
+		  std::thread walker;
+	};
+}				// namespace Search
+
+// quickopen.cpp
+// quick open: fuzzy matching over every file under a directory
+namespace QuickOpen
+{
+	// A slice of the index, never changed once made. Each directory's
+	// path is kept once, and every string is in one arena.
+	struct Segment
+	{
+		struct File
+		{
+			uint32_t dir;	// in dirs
+			uint32_t name;	// in arena
+			uint64_t mask;	// the characters of its path, to rule it out fast
+		};
+		std::string arena;	// '\0' terminated strings
+		std::vector < uint32_t > dirs;	// paths from the root, "" for the root
+		std::vector < File > files;
+	};
+	typedef std::vector < std::shared_ptr < const Segment > > Segments;
+	uint64_t mask_of(const char *text, size_t len);	// for File::mask
+
+	// Every file under a directory. One saved by an earlier walk is shown
+	// at once if there is one; either way a walk runs on a thread of its
+	// own, adding segments as it goes if there was none, and replaces it
+	// and saves the result when done.
+	class Index
+	{
+	      public:
+		explicit Index(const std::string & root);
+		~Index();	// stops the walk
+
+		Segments segments() const;	// what there is now
+		// changes when the segments are replaced, not when added to
+		unsigned long long generation() const;
+		bool walking() const
+		{
+			return !finished;
+		}
+		size_t walked() const	// files the walk found so far
+		{
+			return found;
+		}
+
+	      private:
+		void walk();
+		void save(const Segments & segments) const;
+		bool load();
+
+		  std::string dir;
+		  std::string absolute;	// saved with it, to tell roots apart
+		  std::string file;	// where it is saved, "" if nowhere
+		mutable std::mutex lock;
+		Segments current;
+		Segments building;
+		bool loaded = false;
+		unsigned long long generations = 0;
+
+		  std::atomic < bool > canceled { false };
+		  std::atomic < bool > finished { false };
+		  std::atomic < size_t > found { 0 };
+		  std::thread walker;
+	};
+
+	struct Result
+	{
+		int score;
+		uint32_t length;	// of the path
+		uint32_t segment, file;
+	};
+
+	std::string path(const Segments & segments, const Result & r);	// from the root
+
+	// Matches queries as they are typed. A query containing the one
+	// before it in order is only matched against what that one matched,
+	// and only segments it has not seen are searched whole. The pieces
+	// run on the worker pool.
+	class Finder
+	{
+	      public:
+		// the best top matches into out, best first; how many matched
+		size_t search(const Segments & segments, unsigned long long generation, const std::string & text,
+			      size_t top, std::vector < Result > &out);
+
+	      private:
+		  std::string last;	// folded
+		unsigned long long seen_generation = ~0ull;
+		size_t searched = 0;	// segments matched already
+		  std::vector < std::pair < uint32_t, uint32_t > > matched;	// of last
+	};
+}				// namespace QuickOpen
 
 // ui.cpp
 // auto assume HAVE_WIDE and HAVE_COLOR
@@ -94,6 +686,12 @@ bool wrap_message(std::string message, size_t max_width, std::vector < std::stri
 
 #define COLOR_PAIR_MENU_BAR   0x14
 #define COLOR_PAIR_MENU_PRESS 0x15
+
+#define COLOR_PAIR_HL_KEYWORD 0x16	// syntax highlighting
+#define COLOR_PAIR_HL_COMMENT 0x17
+#define COLOR_PAIR_HL_STRING  0x18
+#define COLOR_PAIR_HL_NUMBER  0x19
+#define COLOR_PAIR_HL_PREPROC 0x1a
 #endif
 
 extern size_t scr_max_y;	// max width and height of screen
@@ -107,14 +705,40 @@ void uninit_curs();
 
 void extrnal_refresh_ui();	// refresh from external control
 void display_status(std::string message);
+void status_note(const std::string & note);	// shown once instead of the status
+bool prompt(const std::string & label, std::string & text);	// false if canceled
+void jump_to(size_t offset);	// move the cursor, scrolling it into view
+size_t cursor_offset();
+extern size_t selection_mark;	// where a selection began, npos for none
+bool selection(size_t & from, size_t & to);	// mark to cursor; false if empty
+extern size_t mark_col;		// the mark's column, a block may keep it past the line
+extern bool block_select;	// selections are rectangular (Ctrl-B)
+bool block_selection(Block::Rect & r);	// mark to cursor; false if none
+bool find_and_jump(bool forward, size_t from);	// false if nothing was found
+// run job on a worker thread until it ends or ESC cancels it; false if canceled
+bool run_cancellable(const std::string & label, std::function < void (const std::atomic < bool > &) > job,
+		     std::function < void () > tick = NULL);
+void find_all(bool keep);	// count the query's matches, or with keep, Find All
+void incremental_find();	// search as you type in the status bar
+// replace the query's matches from from on as one undo step; the count,
+// npos if canceled
+size_t replace_all(const std::string & text, size_t from = 0);
+void query_replace(const std::string & text);	// ask at every match
+void find_in_files();		// grep a directory tree, open a hit
+void quick_open();		// fuzzy find a file under the working directory
+void go_to();			// line and column from a prompt
+bool open_file(const std::string & path);	// load it, showing progress and errors
+bool save_file();		// write the buffer to filename, the same way
+void toggle_follow();		// follow the file as it grows (Ctrl-T), or stop
 
+bool draw_frame();		// the whole screen; false if the text could not be shown
 bool mainloop();		// mainloop; displays editor window
 
 // menu.cpp
 // menu elements
 
 // Function to display menus
-bool menu_interact(WINDOW * host_menu, std::string extra_info, bool no_interact = false);
+bool menu_interact(WINDOW * host_menu, const std::string & extra_info, bool no_interact = false);
 
 // diag.cpp
 // dialogs of that not of editing directly persay
@@ -123,6 +747,23 @@ bool show_fatal(const std::string & title, const std::string & message);
 bool show_err(const std::string & title, const std::string & message);
 bool show_warn(const std::string & title, const std::string & message);
 bool show_norm(const std::string & title, const std::string & message);
+std::string bytes_text(double bytes);	// in KB, MB or GB, whichever reads best
+
+// How far a job running on a worker thread got. The job adds to done as
+// it goes, sets total if it knows it, and stops soon after cancel is set.
+struct Progress
+{
+	std::atomic < bool > cancel { false };
+	std::atomic < unsigned long long > done { 0 };
+	std::atomic < unsigned long long > total { 0 };	// 0 if not known
+};
+
+// Run job on a worker thread. Once it has run for a moment a box shows
+// how far it got, how fast and how long it has to go, redrawn at most
+// ten times a second, after tick, if given, had a chance to update it on
+// this thread; ESC cancels it. False if canceled.
+bool run_with_progress(const std::string & title, const std::function < void (Progress &) > &job,
+		       const std::function < void (Progress &) > &tick = NULL);
 namespace FileDialog
 {
 	// Function to navigate to a directory
@@ -138,4 +779,230 @@ namespace FileDialog
 	  std::string getdrive(int y = 1, int x = 1, bool instruction = true);
 }				// namespace FileDialog
 
+// dircache.cpp
+// directory listings kept between visits; a listing is read again once the
+// directory changes, which inotify tells on Linux and its modification
+// time elsewhere
+#include <unordered_map>
+namespace DirCache
+{
+	struct Entry
+	{
+		std::string name;
+		bool is_directory = false;
+	};
+	typedef std::shared_ptr < const std::vector < Entry > > Listing;
+
+	// the entries of dir, in the order the system gives them; empty if it
+	// cannot be read
+	Listing list(const std::string & dir);
+
+	// The same in parts, for reading elsewhere: lookup gives the listing
+	// if it is cached, and otherwise a ticket for storing it once read,
+	// which stores nothing if the directory changed in the meantime. read
+	// hands the entries over a batch at a time, and stops when batch
+	// returns false; false if it stopped or dir could not be read.
+	Listing lookup(const std::string & dir, unsigned long long & ticket);
+	void store(const std::string & dir, unsigned long long ticket, const Listing & listing);
+	bool read(const std::string & dir, const std::function < bool (std::vector < Entry > &) > &batch);
+}				// namespace DirCache
+
+// stream.cpp
+// a pipe or the input read into the buffer as it arrives
+namespace Stream
+{
+	// Empty the buffer and start reading path into it, "-" being the
+	// input. It is read on a thread and shown as it comes; past a limit
+	// the buffer stops growing and all of the input goes to a temporary
+	// file instead, to be opened once it ended.
+	void open(const std::string & path);
+	// Follow path as tail -f does, from from, where the buffer's copy of
+	// it ends: what is appended to it is added to the buffer as it comes,
+	// read a block at a time. inotify says when on Linux; elsewhere its
+	// size is looked at a few times a second.
+	void follow(const std::string & path, unsigned long long from);
+	bool active();		// still reading, or text waiting to be taken
+	bool following();	// active, by follow
+	bool pending();		// more arrived than one take adds
+	void take();		// what arrived into the buffer; notes the end
+	// the input went past the limit and the buffer still holds only its
+	// start: the file was not opened, or could not be kept in full
+	bool truncated();
+	// stop reading, before the buffer is replaced; or without replaced,
+	// leaving it as it is
+	void close(bool replaced = true);
+}				// namespace Stream
+
+// disk.cpp
+// the open file changing on disk, and the least it takes to catch up
+namespace Disk
+{
+	// what path holds on disk, text, as it was just read or written: its
+	// size, modification time and a hash of text
+	void remember(const std::string & path, const std::string & text);
+	// path changed and the user kept the buffer as it was; from now on
+	// stale() until remember() is called again
+	void ignore(const std::string & path);
+	bool stale();
+	// its size or time is not what was remembered; only a stat
+	bool touched(const std::string & path);
+	// read path into text and compare its hash; false if it holds what
+	// was remembered, after which it is no longer touched(), or if
+	// reading was canceled. Throws std::runtime_error.
+	bool changed(const std::string & path, std::string & text, Progress * progress = NULL);
+	// the pieces that turn old into now for buffer_replace, whole lines
+	// matched up by Myers' diff; a single piece where they differ in too
+	// many places to be worth it
+	void diff(const std::string & old, const std::string & now, std::vector < size_t > &at,
+		  std::vector < size_t > &lens, std::string & texts, std::vector < size_t > &sizes);
+}				// namespace Disk
+
+// batch.cpp
+// edits run from a script over files, without the screen
+namespace Batch
+{
+	// One command of a script, one to a line:
+	//   goto LINE[:COLUMN]     from 1, $ for the last line
+	//   insert TEXT            at the cursor, which ends up after it
+	//   delete [COUNT]         whole lines from the cursor's, default 1
+	//   s/PATTERN/TEXT/[gi]    the first match from the cursor, or every
+	//                          one with g; & in TEXT is the match. The
+	//                          text from the cursor to its end is one
+	//                          subject, not a line at a time: ^ and $
+	//                          match at every line, and a \n in PATTERN
+	//                          crosses one
+	//   write [PATH]           the text so far, to the file it came from
+	//                          or to PATH; - is the output
+	// TEXT takes \n, \t and \\; a line starting with # is a comment.
+	struct Command
+	{
+		enum Kind
+		{
+			GOTO, INSERT, DELETE, SUBSTITUTE, WRITE
+		} kind;
+		size_t line = 0;	// GOTO, 0 for the last line
+		size_t column = 1;
+		size_t count = 1;	// DELETE
+		std::string text;	// INSERT and SUBSTITUTE, the path for WRITE
+		std::string pattern;	// SUBSTITUTE
+		std::vector < size_t > matches;	// where in text the match goes
+		bool global = false;
+		bool icase = false;
+	};
+	typedef std::vector < Command > Script;
+
+	// throws std::runtime_error naming the line that is wrong
+	Script parse(const std::string & source);
+	// Run script over text, read from name ("-" for the input); a write
+	// to the output goes to out. Throws std::runtime_error.
+	void apply(const Script & script, const std::string & name, std::string & text, std::string & out);
+
+	// edit --batch [-j JOBS] [-e COMMAND]... [-f SCRIPT] [FILE]...: the
+	// files are edited on JOBS threads, one per core by default, and
+	// what they write to the output comes out in their order as soon as
+	// it can; a script that writes nothing writes each file there. With
+	// no files the input is edited. The exit status, as for main().
+	int run(int argc, char **argv);
+}				// namespace Batch
+
+// memory.cpp
+// What each part of the editor holds. Every allocation is charged to the
+// part the thread making it works for, as a Scope says, and freeing it
+// takes it off the same part's count.
+namespace Memory
+{
+	enum Tag
+	{
+		OTHER, BUFFER, LINES, DISPLAY, DIALOG, DIRECTORY, SEARCH, TAGS
+	};
+
+	struct Stats
+	{
+		unsigned long long live;	// bytes held now
+		unsigned long long peak;	// the most held at once
+		unsigned long long allocations;	// ever
+		unsigned long long last_frame;	// allocations in the last frame
+	};
+
+	// charges what this thread allocates to tag until it goes
+	class Scope
+	{
+	      public:
+		explicit Scope(Tag tag);
+		~Scope();
+
+	      private:
+		Tag prev;
+	};
+
+	Stats stats(Tag tag);
+	const char *name(Tag tag);
+	unsigned long long allocations();	// so far, of every part
+	// a frame ended: counts its allocations, and logs them a line a
+	// second to EDIT_MEMORY_LOG if it names a file
+	void frame();
+	std::string report();	// for the Memory Report dialog
+}				// namespace Memory
+
+// frame.cpp
+// Memory for what drawing a frame needs only while it draws: taken by
+// moving a pointer, given back all at once when the next frame starts,
+// so that drawing the screen allocates nothing once it has drawn a few.
+namespace Frame
+{
+	void *allocate(size_t size);	// until the next reset()
+	char *format(const char *fmt, ...);	// printf into the arena
+	void reset();		// the frame is over; draw_frame calls it
+	size_t used();		// this frame
+	size_t capacity();
+
+}				// namespace Frame
+
+// trace.cpp
+// Where the time goes. TRACE_SCOPE(name) times the rest of the block it is
+// in, and TRACE_FUNCTION() the function, into a ring of the latest events
+// kept for each thread; F12 and leaving write them out as Chrome trace
+// events, to open in chrome://tracing or Perfetto. Both are nothing unless
+// USE_TRACE is set in config.h or on the command line.
+#if USE_TRACE
+#define TRACE_JOIN(a, b) a##b
+#define TRACE_NAME(line) TRACE_JOIN(trace_scope_, line)
+#define TRACE_SCOPE(name) Trace::Scope TRACE_NAME(__LINE__)(name)
+#define TRACE_FUNCTION() TRACE_SCOPE(__func__)
+namespace Trace
+{
+	struct Event
+	{
+		const char *name;	// a literal; it is not copied
+		unsigned long long begin, end;	// nanoseconds since the start
+		unsigned tid;
+	};
+
+	unsigned long long now();
+	void record(const char *name, unsigned long long begin, unsigned long long end);
+	// the events so far as Chrome trace JSON to path; false if it could
+	// not be written
+	bool dump(const std::string & path);
+
+	class Scope
+	{
+	      public:
+		explicit Scope(const char *name):name(name), begin(now())
+		{
+		}
+		~Scope()
+		{
+			record(name, begin, now());
+		}
+
+	      private:
+		const char *name;
+		unsigned long long begin;
+	};
+}				// namespace Trace
+#else
+#define TRACE_SCOPE(name)
+#define TRACE_FUNCTION()
+#endif
+
 #endif
@@ -30,9 +30,13 @@
 
 using namespace std;
 
+// bytes read or written between looks at progress, a few milliseconds' worth
+static const size_t CHUNK = 4 << 20;
+
 // Function to read a file and store its contents in a buffer
-bool readfile(const std::string & file, std::string & buffer)
+bool readfile(const std::string & file, std::string & buffer, Progress * progress)
 {
+	TRACE_FUNCTION();
 	std::ifstream infile(file);
 
 	buffer = "";		// clear buffer
@@ -44,7 +48,36 @@ bool readfile(const std::string & file, std::string & buffer)
 		return false;
 	}
 
-	buffer.assign(std::istreambuf_iterator < char >(infile), std::istreambuf_iterator < char >());
+	// in large reads where the size is known, rather than a byte at a time
+	infile.seekg(0, std::ios::end);
+	std::streamoff size = infile.tellg();
+	infile.seekg(0, std::ios::beg);
+	if (size > 0)
+	{
+		if (progress)
+			progress->total = size;
+		buffer.resize((size_t)size);
+		size_t got = 0;
+		while (got < (size_t)size)
+		{
+			if (progress && progress->cancel)
+			{
+				std::string().swap(buffer);
+				return false;
+			}
+			infile.read(&buffer[got], std::min(CHUNK, (size_t)size - got));
+			size_t n = (size_t)infile.gcount();
+			if (n == 0)
+				break;	// text mode may read less
+			got += n;
+			if (progress)
+				progress->done += n;
+		}
+		buffer.resize(got);
+		infile.clear(infile.rdstate() & ~(std::ios::failbit | std::ios::eofbit));
+	}
+	else
+		buffer.assign(std::istreambuf_iterator < char >(infile), std::istreambuf_iterator < char >());
 
 	// Check for I/O errors
 	if (infile.bad())
@@ -56,10 +89,24 @@ bool readfile(const std::string & file, std::string & buffer)
 	return true;
 }
 
-// Function to write a buffer to a file
-bool writefile(const std::string & file, const std::string & buffer)
+// Function to write a buffer to a file. A save that can be canceled is
+// written beside the file and renamed over it once whole, so canceling
+// leaves the file as it was.
+bool writefile(const std::string & file, const std::string & buffer, Progress * progress)
 {
-	std::ofstream outfile(file, std::ios::trunc | std::ios::binary);
+	TRACE_FUNCTION();
+	std::error_code ec;
+	std::string target = file;
+	if (progress)
+	{
+		std::filesystem::path real = std::filesystem::canonical(file, ec);	// through links
+		if (!ec)
+			target = real.string();
+		progress->total = buffer.size();
+	}
+	std::string out_name = progress ? target + ".saving" : file;
+
+	std::ofstream outfile(out_name, std::ios::trunc | std::ios::binary);
 
 	// Throw an exception if the file cannot be opened
 	if (!outfile.is_open())
@@ -68,18 +115,63 @@ bool writefile(const std::string & file, const std::string & buffer)
 		return false;
 	}
 
-	outfile.write(buffer.c_str(), buffer.size());
+	for (size_t at = 0; at < buffer.size() && !outfile.bad(); at += CHUNK)
+	{
+		if (progress && progress->cancel)
+		{
+			outfile.close();
+			std::filesystem::remove(out_name, ec);
+			return false;
+		}
+		size_t n = std::min(CHUNK, buffer.size() - at);
+		outfile.write(buffer.data() + at, n);
+		if (progress)
+			progress->done += n;
+	}
+	outfile.close();
 
 	// Check for I/O errors
-	if (outfile.bad())
+	if (outfile.fail())
 	{
+		if (progress)
+			std::filesystem::remove(out_name, ec);
 		throw std::runtime_error("I/O error occurred while writing to the file: " + file);
 		return false;
 	}
 
+	if (progress)
+	{
+		// the new file keeps the old one's permissions
+		std::filesystem::file_status was = std::filesystem::status(target, ec);
+		if (!ec && std::filesystem::exists(was))
+			std::filesystem::permissions(out_name, was.permissions(), ec);
+		std::filesystem::rename(out_name, target, ec);
+		if (ec)
+		{
+			std::filesystem::remove(out_name, ec);
+			throw std::runtime_error("Could not replace the file: " + file);
+		}
+	}
+
 	return true;
 }
 
+std::string cache_path(const std::string & name)
+{
+	std::string base;
+	const char *env;
+	if ((env = getenv("XDG_CACHE_HOME")) != NULL && *env)
+		base = env;
+	else if ((env = getenv("LOCALAPPDATA")) != NULL && *env)
+		base = env;
+	else if ((env = getenv("HOME")) != NULL && *env)
+		base = std::string(env) + "/.cache";
+	else
+		return "";
+
+	return base + "/edit/" + name;
+}
+
 bool extractLinesFromBuf(vector < string > &result, std::string & buffer, size_t startLine, size_t numLines, char delim)
 {
 	if (startLine < 0)
@@ -31,190 +31,507 @@
 namespace FileDialog
 {
 	namespace fs = std::filesystem;
-	struct FileData
+	typedef DirCache::Entry Entry;
+
+	// The entries of a directory, read on a worker a batch at a time so
+	// the first rows show before the last are read. The worker also keeps
+	// them sorted, directories first, and filtered by what was typed; the
+	// dialog only copies out the rows it draws.
+	class Lister
 	{
-		std::string path;
-		bool selected = false;
-		bool is_directory = false;
+	      public:
+		explicit Lister(const std::string & dir);
+		~Lister();	// stops reading
+
+		void filter(const std::string & text);	// a substring, any case
+		size_t rows();	// in view
+		size_t total();	// read so far
+		bool complete();
+		unsigned long long version();	// changes whenever the view does
+		// row i of the view, and which entry it is
+		bool row(size_t i, Entry & entry, size_t & index);
+		size_t find(size_t index);	// the row of an entry, npos if hidden
+
+	      private:
+		void work();
+		bool before(uint32_t a, uint32_t b) const;
+		void merge(size_t from);
+		void publish();
+
+		  std::string dir;
+		  std::mutex lock;
+		  std::condition_variable wake;
+		  DirCache::Listing all;	// appended to by the worker, under lock
+		  std::vector < uint32_t > order;	// all of it sorted, the worker's own
+		  std::vector < uint32_t > view;	// order, filtered; under lock
+		  std::string pattern;
+		unsigned long long patterns = 0;	// filter() calls
+		unsigned long long versions = 0;
+		bool done = false;
+		bool stop = false;
+		  std::thread worker;
 	};
 
-	  std::string current_dir = ".";
-	  std::vector < FileData > files;
+	Lister::Lister(const std::string & dir):dir(dir), all(std::make_shared < std::vector < Entry > >())
+	{
+		worker = std::thread(&Lister::work, this);
+	}
 
-	int current_selection = 0;
-	int start_row = 0;	// Start of the file list
+	Lister::~Lister()
+	{
+		{
+			std::lock_guard < std::mutex > guard(lock);
+			stop = true;
+		}
+		wake.notify_all();
+		worker.join();
+	}
 
-	// Function to navigate to a directory
-	void navigate_to_dir(const std::string & dir)
+	void Lister::filter(const std::string & text)
 	{
-		current_dir = fs::path(dir).lexically_normal().string();
-		files.clear();
-		if (fs::exists(current_dir) && fs::is_directory(current_dir))
 		{
-		      for (const auto & entry:fs::directory_iterator(current_dir))
+			std::lock_guard < std::mutex > guard(lock);
+			pattern = text;
+			patterns++;
+		}
+		wake.notify_all();
+	}
+
+	size_t Lister::rows()
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		return view.size();
+	}
+
+	size_t Lister::total()
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		return all->size();
+	}
+
+	bool Lister::complete()
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		return done;
+	}
+
+	unsigned long long Lister::version()
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		return versions;
+	}
+
+	bool Lister::row(size_t i, Entry & entry, size_t & index)
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		if (i >= view.size())
+			return false;
+		index = view[i];
+		entry = (*all)[index];
+		return true;
+	}
+
+	size_t Lister::find(size_t index)
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		auto it = std::find(view.begin(), view.end(), index);
+		return it == view.end() ? std::string::npos : it - view.begin();
+	}
+
+	// directories first, then by name in any case
+	bool Lister::before(uint32_t a, uint32_t b) const
+	{
+		const Entry & x = (*all)[a];
+		const Entry & y = (*all)[b];
+		if (x.is_directory != y.is_directory)
+			return x.is_directory;
+
+		const unsigned char *p = (const unsigned char *)x.name.data();
+		const unsigned char *q = (const unsigned char *)y.name.data();
+		size_t n = std::min(x.name.size(), y.name.size());
+		for (size_t i = 0; i < n; i++)
+		{
+			if (p[i] != q[i] && ascii_fold.to[p[i]] != ascii_fold.to[q[i]])
+				return ascii_fold.to[p[i]] < ascii_fold.to[q[i]];
+		}
+		if (x.name.size() != y.name.size())
+			return x.name.size() < y.name.size();
+		return x.name < y.name;
+	}
+
+	// Sort the entries from from on and merge them into the order, which
+	// costs no more than one pass over it per batch
+	void Lister::merge(size_t from)
+	{
+		size_t mid = order.size();
+		for (size_t i = from; i < all->size(); i++)
+			order.push_back((uint32_t) i);
+
+		auto less =[this](uint32_t a, uint32_t b)
+		{
+			return before(a, b);
+		};
+		std::sort(order.begin() + mid, order.end(), less);
+		std::inplace_merge(order.begin(), order.begin() + mid, order.end(), less);
+	}
+
+	// Filter the order by the latest pattern and show it
+	void Lister::publish()
+	{
+		std::string text;
+		unsigned long long version;
+		{
+			std::lock_guard < std::mutex > guard(lock);
+			text = pattern;
+			version = patterns;
+		}
+		for (char &c:text)
+			c = ascii_fold.to[(unsigned char)c];
+
+		std::vector < uint32_t > shown;
+		if (text.empty())
+			shown = order;
+		else
+		{
+		      for (uint32_t i:order)
 			{
-				FileData file_data;
-				file_data.path = entry.path().string();
-				file_data.is_directory = fs::is_directory(entry);
-				files.push_back(file_data);
+				const std::string & name = (*all)[i].name;
+				auto at = std::search(name.begin(), name.end(), text.begin(), text.end(),[](char c, char t)
+						      {
+							      return ascii_fold.to[(unsigned char)c] == (unsigned char)t;
+						      });
+				if (at != name.end())
+					shown.push_back(i);
 			}
 		}
+
+		std::lock_guard < std::mutex > guard(lock);
+		view.swap(shown);
+		versions++;
+		if (patterns != version)
+			wake.notify_all();	// typed on meanwhile, go again
 	}
 
-	// Function to display the file dialog and handle navigation
-	std::string file_dialog(WINDOW * win, const std::string & title, const std::string & message, bool isSave)
+	// Only the worker writes all and order, so it reads them without the
+	// lock; the dialog reads them under it.
+	void Lister::work()
 	{
-		int rows, cols;
-		getmaxyx(win, rows, cols);
+		Memory::Scope memory(Memory::DIRECTORY);
+		unsigned long long ticket = 0;
+		DirCache::Listing cached = DirCache::lookup(dir, ticket);
+		if (cached)
+		{
+			{
+				std::lock_guard < std::mutex > guard(lock);
+				all = cached;
+			}
+			// what this stored is sorted already, which takes a pass
+			// to see rather than a sort
+			order.resize(all->size());
+			for (size_t i = 0; i < order.size(); i++)
+				order[i] = (uint32_t) i;
+			if (!std::is_sorted(order.begin(), order.end(),[this](uint32_t a, uint32_t b)
+					    {
+						    return before(a, b);
+					    }))
+			{
+				order.clear();
+				merge(0);
+			}
+			publish();
+		}
+		else
+		{
+			auto growing = std::make_shared < std::vector < Entry > >();
+			{
+				std::lock_guard < std::mutex > guard(lock);
+				all = growing;
+			}
+			bool whole = DirCache::read(dir,[&](std::vector < Entry > &batch)
+						    {
+							    size_t from = growing->size();
+							    {
+								    std::lock_guard < std::mutex > guard(lock);
+								    if (stop)
+									    return false;
+								    std::move(batch.begin(), batch.end(),
+									      std::back_inserter(*growing));
+							    }
+							    merge(from);
+							    publish();
+							    return true;
+						    });
+			if (whole)	// in order, for the next visit
+			{
+				auto sorted = std::make_shared < std::vector < Entry > >();
+				sorted->reserve(order.size());
+			      for (uint32_t i:order)
+					sorted->push_back((*growing)[i]);
+				DirCache::store(dir, ticket, sorted);
+			}
+		}
 
-		// Ensure that we can show at least one file
-		int max_visible_files = rows - 3;	// 2 for the title and 
-							// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// message, 1
-		// for padding
-		if (max_visible_files <= 0)
+		unsigned long long seen;
 		{
-			return "";	// Invalid state, cannot show files
+			std::lock_guard < std::mutex > guard(lock);
+			done = true;
+			versions++;
+			seen = patterns;
 		}
 
+		// from here on only the filter changes
+		while (true)
+		{
+			std::unique_lock < std::mutex > guard(lock);
+			wake.wait(guard,[&]()
+				  {
+					  return stop || patterns != seen;
+				  });
+			if (stop)
+				return;
+			seen = patterns;
+			guard.unlock();
+			publish();
+		}
+	}
+
+	std::string current_dir = ".";
+	std::unique_ptr < Lister > lister;
+	std::string typed;		// filters the list
+	std::vector < bool > marked;	// by entry, toggled with space
+
+	int current_selection = 0;
+	int start_row = 0;	// Start of the file list
+
+	// Function to navigate to a directory
+	void navigate_to_dir(const std::string & dir)
+	{
+		current_dir = fs::path(dir).lexically_normal().string();
+		typed.clear();
+		marked.clear();
+		current_selection = 0;
 		start_row = 0;
 
-		while (true)
+		// a directory seen before and unchanged is not read again, and
+		// one that is shows its first entries as soon as they are read
+		lister.reset();
+		lister.reset(new Lister(current_dir));
+	}
+
+	static void draw(WINDOW * win, const std::string & title, const std::string & message, int max_visible_files)
+	{
+		int rows, cols;
+		getmaxyx(win, rows, cols);
+
+		werase(win);
+		box(win, 0, 0);
+		mvwprintw(win, 0, (cols - title.size()) / 2, "%s", title.c_str());
+		mvwprintw(win, 1, 1, "%s", message.c_str());
+
+		// only the rows on screen are copied out of the list
+		std::string prefix = (fs::path(current_dir) / "").string();
+		for (int i = start_row; i < start_row + max_visible_files; ++i)
 		{
-			werase(win);
-			keypad(win, true);
-			box(win, 0, 0);
+			Entry entry;
+			size_t index;
+			if (!lister->row(i, entry, index))
+				break;
 
-			mvwprintw(win, 0, (cols - title.size()) / 2, title.c_str());
-			mvwprintw(win, 1, 1, message.c_str());
+			bool is_selected = index < marked.size() && marked[index];
+			std::string display =
+				(entry.is_directory ? "DIR " : (is_selected ? "[x] " : "[ ] ")) + prefix + entry.name;
+			if ((int)display.size() > cols - 2)
+				display.resize(cols - 2);
+
+			if (i == current_selection)
+				wattron(win, A_REVERSE);
+			mvwprintw(win, i - start_row + 2, 1, "%s", display.c_str());
+			if (i == current_selection)
+				wattroff(win, A_REVERSE);
+		}
 
-			if (files.size() == 0)
-			{
-				WINDOW *errwin = newwin(4, 21, 1, 1);
-				if (errwin == NULL)
-					return "";
+		char status[128];
+		snprintf(status, sizeof(status), " %zu of %zu%s ", lister->rows(), lister->total(),
+			 lister->complete() ? "" : ", reading");
+		mvwprintw(win, rows - 1, 2, "%s", status);
+		if (!typed.empty())
+			wprintw(win, " Filter: %s ", typed.c_str());
+
+		wrefresh(win);
+	}
+
+	static void no_files()
+	{
+		WINDOW *errwin = newwin(4, 21, 1, 1);
+		if (errwin == NULL)
+			return;
 
 #if HAVE_COLOR
 
-				if (console_color)
-					wbkgd(errwin, COLOR_PAIR(COLOR_PAIR_ERR));
+		if (console_color)
+			wbkgd(errwin, COLOR_PAIR(COLOR_PAIR_ERR));
 
 #endif
 
-				werase(errwin);
-				box(errwin, 0, 0);
+		werase(errwin);
+		box(errwin, 0, 0);
 
-				mvwprintw(errwin, 0, 5, "Fatal Error");
-				mvwprintw(errwin, 1, 1, "No files to display");
-				mvwprintw(errwin, 2, 1, "dir: %14s", current_dir.c_str());
+		mvwprintw(errwin, 0, 5, "Fatal Error");
+		mvwprintw(errwin, 1, 1, "No files to display");
+		mvwprintw(errwin, 2, 1, "dir: %14s", current_dir.c_str());
 
-				wrefresh(errwin);
+		wrefresh(errwin);
 
-				int prev = curs_set(0);
-				wgetch(errwin);
-				curs_set(prev);
+		int prev = curs_set(0);
+		wgetch(errwin);
+		curs_set(prev);
 
-				delwin(errwin);
-				return "";
-			}
+		delwin(errwin);
+	}
+
+	// Function to display the file dialog and handle navigation
+	std::string file_dialog(WINDOW * win, const std::string & title, const std::string & message, bool isSave)
+	{
+		Memory::Scope memory(Memory::DIRECTORY);
+		int rows, cols;
+		getmaxyx(win, rows, cols);
+
+		// Ensure that we can show at least one file
+		int max_visible_files = rows - 3;	// 2 for the title and
+		// message, 1 for padding
+		if (max_visible_files <= 0)
+		{
+			return "";	// Invalid state, cannot show files
+		}
+
+		std::string result;
+		keypad(win, true);
+		wtimeout(win, 50);	// to draw rows as they are read
+		int prev = curs_set(0);
 
-			// Display the files in the window with scrolling
-			for (int i = start_row;
-			     i < std::min(start_row + max_visible_files, static_cast < int >(files.size())); ++i)
+		size_t chosen = std::string::npos;	// the entry the cursor is on
+		unsigned long long drawn = 0;
+		bool dirty = true;
+		while (true)
+		{
+			unsigned long long version = lister->version();
+			if (version != drawn)
 			{
-				bool is_selected = files[i].selected;
-				bool is_directory = files[i].is_directory;
-				std::string display =
-					(is_directory ? "DIR " : (is_selected ? "[x] " : "[ ] ")) + files[i].path;
+				// sorting new entries in moves the rows; the cursor
+				// stays on its entry
+				size_t at = (chosen == std::string::npos) ? std::string::npos : lister->find(chosen);
+				if (at != std::string::npos)
+					current_selection = (int)at;
+				drawn = version;
+				dirty = true;
+			}
 
-				if (i == current_selection)
-				{
-					wattron(win, A_REVERSE);
-					mvwprintw(win, i - start_row + 2, 1, display.c_str());
-					wattroff(win, A_REVERSE);
-				}
-				else
-				{
-					mvwprintw(win, i - start_row + 2, 1, display.c_str());
-				}
+			int count = (int)lister->rows();
+			if (lister->complete() && lister->total() == 0)
+			{
+				no_files();
+				break;
 			}
+			current_selection = std::max(0, std::min(current_selection, count - 1));
+			if (current_selection < start_row)
+				start_row = current_selection;
+			else if (current_selection >= start_row + max_visible_files)
+				start_row = current_selection - max_visible_files + 1;
+
+			if (dirty)
+				draw(win, title, message, max_visible_files);
+			dirty = false;
 
-			wrefresh(win);
-			int prev = curs_set(0);
 			int ch = wgetch(win);
-			curs_set(prev);
-			switch (ch)
+			if (ch == ERR)
+				continue;	// nothing typed, see if more was read
+			dirty = true;
+
+			Entry entry;
+			size_t index = std::string::npos;
+			bool on_row = lister->row(current_selection, entry, index);
+
+			if (ch == KEY_UP)
+				current_selection--;
+			else if (ch == KEY_DOWN)
+				current_selection++;
+			else if (ch == KEY_PPAGE)
+				current_selection -= max_visible_files;
+			else if (ch == KEY_NPAGE)
+				current_selection += max_visible_files;
+			else if (ch == KEY_HOME)
+				current_selection = 0;
+			else if (ch == KEY_END)
+				current_selection = count - 1;
+			else if (ch == '\r' || ch == '\n')
 			{
-			case KEY_UP:
-				if (current_selection > 0)
+				if (!on_row)
+					continue;
+				std::string path = (fs::path(current_dir) / entry.name).string();
+				if (entry.is_directory)
 				{
-					--current_selection;
-					if (current_selection < start_row)
-					{
-						--start_row;
-					}
+					// Navigate into the directory
+					navigate_to_dir(path);
+					chosen = std::string::npos;
+					drawn = 0;
+					continue;
 				}
+				// If it's a file, return the selected path
+				result = path;
 				break;
-			case KEY_DOWN:
-				if (current_selection < (int)files.size() - 1)
-				{
-					++current_selection;
-					if (current_selection >= start_row + max_visible_files)
-					{
-						++start_row;
-					}
-				}
-				break;
-			case '\r':
-			case '\n':
-				{
-					FileData & selected = files[current_selection];
-
-					if (selected.is_directory)
-					{
-						// Navigate into the directory
-						navigate_to_dir(selected.path);
-						start_row = 0;
-						current_selection = 0;
-					}
-					else
-					{
-						// If it's a file, return the
-						// selected path
-						return selected.path;
-					}
-					break;
-				}
-			case KEY_BACKSPACE:
-			case 8:	// ascii backspace
-			case 27:	// Escape key (to navigate out of
-				// directory)
+			}
+			else if ((ch == KEY_BACKSPACE || ch == 8 || ch == 127 || ch == 27) && !typed.empty())
+			{
+				// backspace takes back a letter, escape the filter
+				if (ch == 27)
+					typed.clear();
+				else
+					typed.pop_back();
+				lister->filter(typed);
+				chosen = std::string::npos;
+				current_selection = 0;
+				continue;
+			}
+			else if (ch == KEY_BACKSPACE || ch == 8 || ch == 127 || ch == 27)
+			{
+				// Escape key (to navigate out of directory)
 				if (fs::exists(fs::path(current_dir).parent_path()))
 				{
 					navigate_to_dir(fs::path(current_dir).parent_path().string());
-					start_row = 0;
-					current_selection = 0;
+					chosen = std::string::npos;
+					drawn = 0;
 				}
+				continue;
+			}
+			else if (ch == 24)	// Ctrl-X, cancel
 				break;
-			case 'q':	// Exit on 'q'
-				return "";	// Return empty string to
-				// indicate
-				// cancellation
-			case ' ':	// Toggle selection on spacebar
-				files[current_selection].selected = !files[current_selection].selected;
-				break;
-			default:
-				break;
+			else if (ch == ' ')	// Toggle selection on spacebar
+			{
+				if (on_row)
+				{
+					if (marked.size() <= index)
+						marked.resize(index + 1);
+					marked[index] = !marked[index];
+				}
 			}
+			else if (ch > ' ' && ch < 256)	// type ahead
+			{
+				typed += (char)ch;
+				lister->filter(typed);
+				chosen = std::string::npos;
+				current_selection = 0;
+				continue;
+			}
+
+			current_selection = std::max(0, std::min(current_selection, count - 1));
+			if (lister->row(current_selection, entry, index))
+				chosen = index;
 		}
+
+		wtimeout(win, -1);
+		curs_set(prev);
+		lister.reset();	// stop reading
+		return result;
 	}
 
 	std::string open(WINDOW * win, std::string dir)
@@ -0,0 +1,119 @@
+/* 
+   frame.cpp --- memory for drawing a frame, given back all at once
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <cstdarg>
+
+namespace Frame
+{
+	static const size_t ALIGN = 16;
+
+	// The blocks the arena hands out from, the last one current. They
+	// come from malloc, so the allocation counts see only the arena
+	// growing; a frame that needed more than one block leaves one big
+	// enough for all of it at the reset.
+	struct Block
+	{
+		char *data;
+		size_t size;
+	};
+
+	static std::vector < Block > blocks;
+	static size_t used_in_block = 0;	// of the last block
+	static size_t used_before = 0;	// in the blocks before it
+
+	void *allocate(size_t size)
+	{
+		size = (size + ALIGN - 1) & ~(ALIGN - 1);
+		if (blocks.empty() || used_in_block + size > blocks.back().size)
+		{
+			size_t want = std::max < size_t > (blocks.empty()? 16384 : blocks.back().size * 2, size);
+			char *data = (char *)malloc(want);
+			if (data == NULL)
+				throw std::bad_alloc();
+			if (!blocks.empty())
+				used_before += used_in_block;
+			{
+				Memory::Scope memory(Memory::DISPLAY);
+				blocks.push_back(Block { data, want });
+			}
+			used_in_block = 0;
+		}
+
+		void *p = blocks.back().data + used_in_block;
+		used_in_block += size;
+		return p;
+	}
+
+	char *format(const char *fmt, ...)
+	{
+		va_list args, again;
+		va_start(args, fmt);
+		va_copy(again, args);
+		int n = vsnprintf(NULL, 0, fmt, args);
+		va_end(args);
+
+		char *out = (char *)allocate(n > 0 ? n + 1 : 1);
+		vsnprintf(out, n > 0 ? n + 1 : 1, fmt, again);
+		va_end(again);
+		return out;
+	}
+
+	void reset()
+	{
+		if (blocks.size() > 1)
+		{
+			size_t total = 0;
+			for (const Block & b:blocks)
+			{
+				total += b.size;
+				free(b.data);
+			}
+			blocks.clear();	// keeps its room, allocates nothing
+			char *data = (char *)malloc(total);
+			if (data != NULL)
+				blocks.push_back(Block { data, total });
+		}
+		used_in_block = 0;
+		used_before = 0;
+	}
+
+	size_t used()
+	{
+		return used_before + used_in_block;
+	}
+
+	size_t capacity()
+	{
+		size_t total = 0;
+		for (const Block & b:blocks)
+			total += b.size;
+		return total;
+	}
+}				// namespace Frame
@@ -0,0 +1,299 @@
+/* 
+   grep.cpp --- find in files
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <cstdio>
+
+namespace Search
+{
+	namespace fs = std::filesystem;
+
+	static const size_t SNIFF = 8000;	// bytes looked at for a NUL, as git does
+	static const size_t BLOCK = 1 << 20;	// read from a file at a time
+	static const size_t LINE_LIMIT = 16 << 20;	// a longer line is searched in parts
+	static const size_t EXCERPT = 160;	// bytes of a matching line kept
+	static const size_t BATCH = 64;	// files to a task
+
+	// Last newline in data[0, n), or NULL; looked for from the end, where
+	// it is close by
+	static const char *last_newline(const char *data, size_t n)
+	{
+		while (n > 0)
+		{
+			if (data[--n] == '\n')
+				return data + n;
+		}
+		return NULL;
+	}
+
+	FileSearch::FileSearch(const std::string & dir, const std::string & query, bool icase, bool regex)
+	:root(dir), query(query), icase(icase), regex(regex)
+	{
+		if (regex)
+			Regex check(query, icase);	// each file compiles its own
+		else
+			literal.reset(new Literal(query, icase));
+
+		walker = std::thread(&FileSearch::walk, this);
+	}
+
+	FileSearch::~FileSearch()
+	{
+		stop();
+		walker.join();
+	}
+
+	void FileSearch::stop()
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		canceled = true;
+		slots.notify_all();
+	}
+
+	size_t FileSearch::count() const
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		return hits.size();
+	}
+
+	FileHit FileSearch::hit(size_t i) const
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		return hits[i];
+	}
+
+	// Hand the files to the pool as the walk finds them, a batch at a time
+	// and never more than a couple of batches per thread, so a tree of
+	// millions of files is never held as a list
+	void FileSearch::walk()
+	{
+		Memory::Scope memory(Memory::SEARCH);
+		WorkerPool & pool = worker_pool();
+		const size_t window = 2 * pool.size();
+
+		std::vector < std::string > batch;
+		auto hand_over =[&]()
+		{
+			{
+				std::unique_lock < std::mutex > guard(lock);
+				slots.wait(guard,[&]()
+					   {
+						   return in_flight < window || canceled;
+					   });
+				if (canceled)
+					return;
+				in_flight++;
+			}
+			pool.submit([this, paths = std::move(batch)]()
+				    {
+					    for (const std::string & path:paths)
+					    {
+						    if (canceled)
+							    break;
+						    search_file(path);
+					    }
+					    std::lock_guard < std::mutex > guard(lock);
+					    in_flight--;
+					    slots.notify_all();
+				    });
+			batch.clear();
+		};
+
+		std::error_code ec;
+		fs::recursive_directory_iterator it(root, fs::directory_options::skip_permission_denied, ec);
+		for (; !ec && it != fs::recursive_directory_iterator() && !canceled; it.increment(ec))
+		{
+			std::error_code type_ec;
+			if (it->is_directory(type_ec))
+			{
+				if (is_vcs_dir(it->path().filename().string()))
+					it.disable_recursion_pending();
+				continue;
+			}
+			if (!it->is_regular_file(type_ec))
+				continue;
+
+			batch.push_back(it->path().string());
+			if (batch.size() == BATCH)
+				hand_over();
+		}
+		if (!batch.empty() && !canceled)
+			hand_over();
+
+		// the tasks point at this, wait for them whether done or stopped
+		std::unique_lock < std::mutex > guard(lock);
+		slots.wait(guard,[&]()
+			   {
+				   return in_flight == 0;
+			   });
+		finished = true;
+	}
+
+	void FileSearch::search_file(const std::string & path)
+	{
+		Memory::Scope memory(Memory::SEARCH);
+		FILE *file = fopen(path.c_str(), "rb");
+		if (file == NULL)
+			return;
+
+		std::unique_ptr < Regex > re;
+		if (regex)
+			re.reset(new Regex(query, icase));
+
+		// whole lines are searched; the unfinished last one of a block
+		// waits for the next. The buffer stays with the pool's thread,
+		// most files are small and would not fill it anyway.
+		thread_local std::vector < char > buffer;
+		size_t kept = 0;
+		size_t line = 1;
+		size_t into = 0;	// how far into its line the buffer starts
+		bool open_hit = false;	// and that line has its hit
+		bool first = true;
+		while (!canceled)
+		{
+			if (buffer.size() < kept + BLOCK)
+				buffer.resize(kept + BLOCK);
+			size_t got = fread(buffer.data() + kept, 1, BLOCK, file);
+			size_t size = kept + got;
+			bool eof = got < BLOCK;
+
+			if (first)
+			{
+				first = false;
+				if (memchr(buffer.data(), '\0', std::min(size, SNIFF)) != NULL)
+				{
+					skipped++;
+					fclose(file);
+					return;
+				}
+			}
+
+			size_t upto = size;
+			bool part = false;	// of a line too long to keep whole
+			if (!eof)
+			{
+				const char *nl = last_newline(buffer.data(), size);
+				if (nl != NULL)
+					upto = nl - buffer.data() + 1;
+				else if (size < LINE_LIMIT)
+				{
+					kept = size;
+					continue;
+				}
+				else
+					part = true;
+			}
+
+			line = search_text(path, buffer.data(), upto, line, re.get(), into, open_hit);
+			kept = size - upto;
+			if (part)
+			{
+				// a literal across the cut is found in the next part; a
+				// regular expression has no such bound, so it is counted
+				if (regex && into == 0)
+					split++;
+				else if (!regex)
+					kept = std::min(size, std::max < size_t > (literal->size(), 1) - 1);
+				into += size - kept;
+			}
+			else
+				into = 0;
+			memmove(buffer.data(), buffer.data() + size - kept, kept);
+			if (eof)
+				break;
+		}
+
+		// a very long line grew it, give that back
+		if (buffer.size() > 2 * BLOCK)
+			std::vector < char >().swap(buffer);
+
+		fclose(file);
+		searched++;
+	}
+
+	// Report the first match on each line of data, which starts at line
+	// line, into bytes into it; returns the line after the last one.
+	// open_hit says the line data starts in has its hit already, and
+	// then whether the line it ends in without a newline has.
+	size_t FileSearch::search_text(const std::string & path, const char *data, size_t n, size_t line, Regex * re,
+				       size_t into, bool & open_hit)
+	{
+		Chunks chunks = { Chunk { data, n } };
+		const char *counted = data;	// lines are counted up to here
+		size_t pos = 0;
+
+		if (open_hit)
+		{
+			const char *nl = (const char *)memchr(data, '\n', n);
+			pos = nl ? nl - data + 1 : n;
+			open_hit = nl == NULL;
+		}
+
+		while (pos < n && !canceled)
+		{
+			size_t at, len;
+			if (re != NULL)
+			{
+				if (!re->find(chunks, pos, at, len, &canceled) || at >= n)
+					break;
+			}
+			else if ((at = literal->find(data, n, pos)) == std::string::npos)
+				break;
+
+			line += std::count(counted, data + at, '\n');
+			counted = data + at;
+
+			const char *begin = last_newline(data, at);
+			size_t start = begin ? begin - data + 1 : 0;
+			const char *finish = (const char *)memchr(data + at, '\n', n - at);
+			size_t end = finish ? finish - data : n;
+
+			// keep some of what comes before a match far into its line
+			size_t from = (at - start > EXCERPT / 4) ? at - EXCERPT / 4 : start;
+			FileHit hit { path, line, at - start + (start == 0 ? into : 0),
+				std::string(data + from, std::min(end, from + EXCERPT) - from) };
+
+			{
+				std::lock_guard < std::mutex > guard(lock);
+				if (hits.size() >= HIT_LIMIT)
+				{
+					full = true;
+					canceled = true;
+					slots.notify_all();
+					break;
+				}
+				hits.push_back(std::move(hit));
+			}
+			open_hit = finish == NULL;
+			pos = end + 1;	// one hit for a line
+		}
+
+		return line + std::count(counted, data + n, '\n');
+	}
+}				// namespace Search
@@ -0,0 +1,498 @@
+/* 
+   highlight.cpp --- incremental, lexer based syntax highlighting
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+// Every line keeps the lexer state it ends in. An edit only throws away the
+// states from the edited line on, and prepare() lexes forward from there until
+// a freshly computed state matches the one cached before the edit. Past that
+// point nothing can have changed, so the rest of the cache stays valid. Lines
+// below the screen are never lexed until they are scrolled to.
+//
+// A line can be hundreds of megabytes long, minified JSON or a log written
+// without newlines. Lexing such a line notes where the lexer was every
+// STEP bytes, and coloring the part of it on the screen lexes from the
+// last of those marks before it to the screen's edge, so a frame costs
+// the same wherever in the line it is.
+
+namespace Highlight
+{
+	enum State
+	{
+		ST_NORMAL = 0,
+		ST_COMMENT,	// inside an unterminated block comment
+		ST_STRING,	// string continued with a backslash
+		ST_PREPROC,	// preprocessor line continued with a backslash
+		ST_UNKNOWN = 0xff
+	};
+
+	struct Syntax
+	{
+		const char *line_comment;	// NULL if none
+		bool block_comment;	// /* ... */
+		bool hash_comment;	// # ... to the end of the line
+		bool hash_preproc;	// # at the start of a line is a directive
+		const char *const *keywords;	// NULL terminated
+	};
+
+	const char *const c_keywords[] = {
+		"auto", "bool", "break", "case", "catch", "char", "class", "const", "constexpr", "continue",
+		"default", "delete", "do", "double", "else", "enum", "explicit", "extern", "false", "final",
+		"float", "for", "friend", "goto", "if", "inline", "int", "long", "namespace", "new",
+		"noexcept", "nullptr", "operator", "override", "private", "protected", "public", "return",
+		"short", "signed", "sizeof", "static", "struct", "switch", "template", "this", "throw",
+		"true", "try", "typedef", "typename", "union", "unsigned", "using", "virtual", "void",
+		"volatile", "while", "NULL", "var", "let", "function", "import", "package", "fn", "func",
+		NULL
+	};
+
+	const char *const script_keywords[] = {
+		"if", "then", "else", "elif", "fi", "for", "while", "do", "done", "case", "esac", "in",
+		"function", "return", "def", "class", "import", "from", "as", "and", "or", "not", "is",
+		"None", "True", "False", "true", "false", "yes", "no", "on", "off", "null", "export",
+		"local", "with", "try", "except", "finally", "lambda", "pass", "break", "continue",
+		NULL
+	};
+
+	const Syntax syntax_c = { "//", true, false, true, c_keywords };
+	const Syntax syntax_script = { NULL, false, true, false, script_keywords };
+
+	const Syntax *syntax = NULL;	// NULL for plain text
+
+	std::vector < unsigned char >end_state;	// state at the end of each line
+	size_t dirty_from = std::string::npos;	// first line with a stale state
+	size_t frontier = 0;	// lines from here on were never lexed
+	size_t converge_after = 0;	// states may only converge from here on
+	size_t lexed = 0;
+
+	std::vector < unsigned char >line_classes;	// reused by colorize()
+
+	const size_t LONG_LINE = 1 << 16;	// lines this long are colored a part at a time
+	const size_t STEP = 1024;	// bytes between marks
+	const size_t LOOKAHEAD = 64;	// lexed past a part, so a word there is not cut short
+
+	// where the lexer of a long line was between tokens, and in what state
+	struct Mark
+	{
+		size_t at;
+		unsigned char state;
+	};
+	struct Marks
+	{
+		unsigned char start;	// the state the line was lexed from
+		  std::vector < Mark > marks;
+	};
+	std::unordered_map < size_t, Marks > long_lines;
+
+	bool is_ident(unsigned char c)
+	{
+		return std::isalnum(c) || c == '_';
+	}
+
+	bool is_keyword(const char *word, size_t len)
+	{
+		for (const char *const *kw = syntax->keywords; *kw != NULL; kw++)
+		{
+			if (strlen(*kw) == len && memcmp(*kw, word, len) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	// Lex one line starting in the given state, returns the state at its
+	// end. When cls is not NULL, the class of every byte from from on is
+	// stored into it, cls[0] being the one at from. A lexer that stopped
+	// at a mark goes on from it: from is the mark and state its state.
+	// Lexing stops once it reaches stop, the state returned then means
+	// nothing; marks, if given, get a mark every STEP bytes.
+	unsigned char lex_line(const char *s, size_t n, unsigned char state, unsigned char *cls,
+			       size_t from = 0, size_t stop = std::string::npos, std::vector < Mark > *marks = NULL)
+	{
+		size_t i = from;
+		size_t next = from + STEP;	// the next mark
+		auto paint =[&](size_t start, size_t end, unsigned char c)
+		{
+			if (cls)
+				memset(cls + (start - from), c, end - start);
+		};
+
+		// skip the line terminator, it never changes the state
+		while (n > 0 && (s[n - 1] == '\n' || s[n - 1] == '\r'))
+			n--;
+
+		if (state == ST_PREPROC)
+		{
+			paint(i, std::max(i, n), HL_PREPROC);
+			return (n > 0 && s[n - 1] == '\\') ? ST_PREPROC : ST_NORMAL;
+		}
+
+		// directives and hash comments only count as the first token,
+		// and marks are only made after it
+		size_t first = 0;
+		while (from == 0 && first < n && (s[first] == ' ' || s[first] == '\t'))
+			first++;
+
+		while (i < n && i < stop)
+		{
+			if (marks && i >= next && i > first)
+			{
+				marks->push_back(Mark { i, state });
+				next = i + STEP;
+			}
+
+			// a comment or string as long as the line still gets its
+			// marks: the scan stops at the next and goes on after it
+			size_t end = (marks && next > i) ? std::min(n, next) : n;
+
+			if (state == ST_COMMENT)
+			{
+				size_t start = i;
+				while (i < end && !(s[i] == '*' && i + 1 < n && s[i + 1] == '/'))
+					i++;
+				if (i < end)
+				{
+					i += 2;
+					state = ST_NORMAL;
+				}
+				paint(start, i, HL_COMMENT);
+				continue;
+			}
+
+			if (state == ST_STRING)
+			{
+				size_t start = i;
+				while (i < end && s[i] != '"')
+				{
+					if (s[i] == '\\')
+						i++;
+					i++;
+				}
+				if (i >= end && end < n)
+				{
+					paint(start, i, HL_STRING);
+					continue;
+				}
+				if (i >= n)
+				{
+					paint(start, n, HL_STRING);
+					return (s[n - 1] == '\\') ? ST_STRING : ST_NORMAL;
+				}
+				i++;
+				state = ST_NORMAL;
+				paint(start, i, HL_STRING);
+				continue;
+			}
+
+			unsigned char c = s[i];
+
+			if (c == '#' && i == first && (syntax->hash_preproc || syntax->hash_comment))
+			{
+				bool preproc = syntax->hash_preproc;
+				paint(i, n, preproc ? HL_PREPROC : HL_COMMENT);
+				if (preproc && s[n - 1] == '\\')
+					return ST_PREPROC;
+				return ST_NORMAL;
+			}
+			if (c == '#' && syntax->hash_comment)
+			{
+				paint(i, n, HL_COMMENT);
+				return ST_NORMAL;
+			}
+			if (syntax->line_comment && c == syntax->line_comment[0]
+			    && i + 1 < n && s[i + 1] == syntax->line_comment[1])
+			{
+				paint(i, n, HL_COMMENT);
+				return ST_NORMAL;
+			}
+			if (syntax->block_comment && c == '/' && i + 1 < n && s[i + 1] == '*')
+			{
+				paint(i, i + 2, HL_COMMENT);
+				i += 2;
+				state = ST_COMMENT;
+				continue;
+			}
+			if (c == '"')
+			{
+				paint(i, i + 1, HL_STRING);
+				i++;
+				state = ST_STRING;
+				continue;
+			}
+			if (c == '\'')
+			{
+				// single quoted strings never continue to the next line
+				size_t start = i++;
+				while (i < n && s[i] != '\'')
+				{
+					if (s[i] == '\\')
+						i++;
+					i++;
+				}
+				i = std::min(i + 1, n);
+				paint(start, i, HL_STRING);
+				continue;
+			}
+			if (std::isdigit(c))
+			{
+				size_t start = i;
+				while (i < n && (is_ident(s[i]) || s[i] == '.'))
+					i++;
+				paint(start, i, HL_NUMBER);
+				continue;
+			}
+			if (is_ident(c))
+			{
+				size_t start = i;
+				while (i < n && is_ident(s[i]))
+					i++;
+				paint(start, i, is_keyword(s + start, i - start) ? HL_KEYWORD : HL_NORMAL);
+				continue;
+			}
+
+			paint(i, i + 1, HL_NORMAL);
+			i++;
+		}
+
+		return state;
+	}
+
+	// Pick a syntax from the file name
+	const Syntax *syntax_for(const std::string & path)
+	{
+		std::string ext = std::filesystem::path(path).extension().string();
+		std::string name = std::filesystem::path(path).filename().string();
+		std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+
+		const char *c_like[] = { ".c", ".h", ".cpp", ".hpp", ".cc", ".cxx", ".hh", ".java", ".js",
+			".ts", ".cs", ".go", ".rs", ".css", ".json", NULL
+		};
+		const char *scripts[] = { ".sh", ".py", ".conf", ".cfg", ".ini", ".yaml", ".yml", ".toml",
+			".properties", ".cmake", ".pl", ".rb", NULL
+		};
+
+		for (const char **e = c_like; *e != NULL; e++)
+		{
+			if (ext == *e)
+				return &syntax_c;
+		}
+		for (const char **e = scripts; *e != NULL; e++)
+		{
+			if (ext == *e)
+				return &syntax_script;
+		}
+		if (name == "Makefile" || name == "CMakeLists.txt" || name == "Dockerfile")
+			return &syntax_script;
+
+		return NULL;
+	}
+
+	void reset(const std::string & path)
+	{
+		syntax = syntax_for(path);
+		end_state.assign(buflines.count(), ST_UNKNOWN);
+		dirty_from = 0;
+		frontier = 0;
+		converge_after = 0;
+		lexed = 0;
+		long_lines.clear();
+	}
+
+	void edited(size_t line, size_t removed, size_t added)
+	{
+		if (end_state.size() != buflines.count() + removed - added)
+		{
+			reset(filename);	// out of step, start over
+			return;
+		}
+
+		// the old state of the region's last line stays at its new last
+		// line, that is where the lexer compares against it
+		end_state.erase(end_state.begin() + line, end_state.begin() + line + removed);
+		end_state.insert(end_state.begin() + line, added, ST_UNKNOWN);
+
+		if (frontier > line + removed)
+			frontier = frontier + added - removed;
+		else if (frontier > line)
+			frontier = line + 1;
+
+		// an earlier edit further down the buffer moved with this one
+		if (converge_after > line + removed)
+			converge_after = converge_after + added - removed;
+		converge_after = std::max(converge_after, line + added);
+
+		if (dirty_from == std::string::npos || dirty_from > line)
+			dirty_from = line;
+
+		// the marks of the lines from here on are lost with their numbers
+		for (auto it = long_lines.begin(); it != long_lines.end();)
+			it = (it->first >= line) ? long_lines.erase(it) : std::next(it);
+	}
+
+	void prepare(size_t last)
+	{
+		if (syntax == NULL || end_state.empty() || dirty_from == std::string::npos || dirty_from > last)
+			return;
+		TRACE_SCOPE("Highlight::prepare");
+
+		last = std::min(last, end_state.size() - 1);
+
+		size_t line = dirty_from;
+		unsigned char state = (line == 0) ? (unsigned char)ST_NORMAL : end_state[line - 1];
+
+		while (line <= last)
+		{
+			const char *text = filebuf.data() + buflines.start(line);
+			size_t len = buflines.length(line);
+			if (len >= LONG_LINE)
+			{
+				// as it is lexed anyway, note its marks on the way
+				Marks & m = long_lines[line];
+				m.start = state;
+				m.marks.clear();
+				state = lex_line(text, len, state, NULL, 0, std::string::npos, &m.marks);
+			}
+			else
+				state = lex_line(text, len, state, NULL);
+			lexed++;
+
+			unsigned char old = end_state[line];
+			end_state[line] = state;
+
+			// everything below is exactly as it was before the edit,
+			// carry on from the first line that was never lexed
+			if (line < frontier && line >= converge_after && old == state)
+			{
+				converge_after = 0;
+				line = frontier;
+				if (line < end_state.size())
+					state = end_state[line - 1];
+				continue;
+			}
+			line++;
+		}
+
+		if (line >= frontier)
+		{
+			frontier = line;
+			converge_after = 0;	// the edit was lexed through
+		}
+		else
+		{
+			// lines from here on still hold states from before the
+			// edit, only they can be compared against
+			converge_after = std::max(converge_after, line);
+		}
+
+		// the rest is lexed once it is visible
+		dirty_from = (line < end_state.size())? line : std::string::npos;
+	}
+
+	const unsigned char *colorize(size_t line, const char *text, size_t len, size_t from, size_t to)
+	{
+		to = std::min(to, len);
+		from = std::min(from, to);
+		if (syntax == NULL || line >= end_state.size())
+		{
+			if (line_classes.size() < to - from)
+				line_classes.resize(to - from);
+			memset(line_classes.data(), HL_NORMAL, to - from);
+			return line_classes.data();
+		}
+
+		unsigned char state = (line == 0) ? (unsigned char)ST_NORMAL : end_state[line - 1];
+		if (state == ST_UNKNOWN)
+			state = ST_NORMAL;	// not prepared, best effort
+
+		// a long line is lexed from its last mark before from, up to a
+		// little past to
+		size_t begin = 0, end = len;
+		if (len >= LONG_LINE)
+		{
+			auto it = long_lines.find(line);
+			if (it == long_lines.end() || it->second.start != state)
+			{
+				if (long_lines.size() >= 256)
+					long_lines.clear();	// a file of such lines, keep the visible ones
+				Marks & m = long_lines[line];
+				m.start = state;
+				m.marks.clear();
+				lex_line(text, len, state, NULL, 0, std::string::npos, &m.marks);
+				it = long_lines.find(line);
+			}
+			const std::vector < Mark > &marks = it->second.marks;
+			auto mark = std::upper_bound(marks.begin(), marks.end(), from,[](size_t at, const Mark & m)
+						     {
+							     return at < m.at;
+						     });
+			if (mark != marks.begin())
+			{
+				--mark;
+				begin = mark->at;
+				state = mark->state;
+			}
+			end = std::min(len, to + LOOKAHEAD);
+		}
+
+		if (line_classes.size() < end - begin)
+			line_classes.resize(end - begin);
+		memset(line_classes.data(), HL_NORMAL, end - begin);
+		lex_line(text, end, state, line_classes.data(), begin, to);
+		return line_classes.data() + (from - begin);
+	}
+
+	int attr(unsigned char cls)
+	{
+#if HAVE_COLOR
+		if (!console_color)
+			return (cls == HL_KEYWORD || cls == HL_PREPROC) ? (int)A_BOLD : (int)A_NORMAL;
+
+		switch (cls)
+		{
+		case HL_KEYWORD:
+			return COLOR_PAIR(COLOR_PAIR_HL_KEYWORD) | A_BOLD;
+		case HL_COMMENT:
+			return COLOR_PAIR(COLOR_PAIR_HL_COMMENT);
+		case HL_STRING:
+			return COLOR_PAIR(COLOR_PAIR_HL_STRING);
+		case HL_NUMBER:
+			return COLOR_PAIR(COLOR_PAIR_HL_NUMBER);
+		case HL_PREPROC:
+			return COLOR_PAIR(COLOR_PAIR_HL_PREPROC);
+		default:
+			return A_NORMAL;
+		}
+#else
+		return (cls == HL_KEYWORD || cls == HL_PREPROC) ? (int)A_BOLD : (int)A_NORMAL;
+#endif
+	}
+
+	size_t lexed_lines()
+	{
+		return lexed;
+	}
+}				// namespace Highlight
@@ -0,0 +1,376 @@
+/* 
+   isearch.cpp --- search as you type
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <chrono>
+
+// Each query typed so far is a level. A match of a longer query is also
+// a match of every prefix of it, so a new level is found from the one
+// before: its current match is checked first, then its full list if
+// that is known, and only then the buffer itself, a window at a time
+// until the frame budget runs out. Every level also has a job on its
+// own thread that lists all its matches, which is what the next level
+// refines and what backspace comes back to.
+//
+// Matches here may overlap: "aa" in "aaa" is at 0 and 1. Refining needs
+// them all, the greedy non-overlapping ones are not a superset.
+
+namespace Search
+{
+	const double FRAME_BUDGET_US = 8000;	// leaves the rest of a frame to draw
+	const size_t WINDOW = 4 << 20;	// bytes searched between budget checks
+	const size_t KEEP_LIMIT = 1 << 23;	// matches listed per level, 64 MB
+
+	typedef std::chrono::steady_clock isearch_clock;
+
+	struct Incremental::Job
+	{
+		std::atomic < bool > cancel { false };
+		std::atomic < bool > done { false };
+		std::atomic < bool > have_first { false };
+		size_t first = std::string::npos;	// set before have_first
+		std::atomic < size_t > count { 0 };
+		std::vector < size_t > all;	// every match, in order, if kept
+		bool kept = true;
+		std::thread thread;
+	};
+
+	struct Incremental::Level
+	{
+		std::string query;
+		bool resolved = false;
+		size_t current = std::string::npos;	// first match from the origin on, wrapping
+		std::shared_ptr < Job > job;
+	};
+
+	// First match starting in [from, to), or npos. The buffer is looked
+	// at a window at a time; if more() then says stop, resume is where
+	// to carry on from, else it is to.
+	static size_t find_in(const std::string & buf, const Literal & lit, size_t from, size_t to,
+			      const std::function < bool () > &more, size_t & resume)
+	{
+		size_t m = lit.size();
+		while (from < to)
+		{
+			size_t stop = std::min(to, from + WINDOW);
+			size_t at = lit.find(buf.data(), std::min(buf.size(), stop + m - 1), from);
+			if (at != std::string::npos)
+			{
+				resume = at + 1;
+				return at;
+			}
+			from = stop;
+			if (from < to && !more())
+			{
+				resume = from;
+				return std::string::npos;
+			}
+		}
+		resume = to;
+		return std::string::npos;
+	}
+
+	static bool matches_at(const std::string & buf, const Literal & lit, size_t at)
+	{
+		return at + lit.size() <= buf.size() && lit.find(buf.data() + at, lit.size(), 0) == 0;
+	}
+
+	// List every match, the ones from the origin on first so the current
+	// match is known early, from the parent's list if it has one
+	void Incremental::run(Job & job, const std::string & buf, const Literal & lit, size_t origin,
+			      const Job * parent)
+	{
+		std::vector < size_t > after, before;
+		auto add =[&](size_t pos)
+		{
+			if (!job.have_first.load())	// the first from the origin on, or the first of all
+			{
+				job.first = pos;
+				job.have_first = true;
+			}
+			job.count++;
+			if (job.kept && after.size() + before.size() >= KEEP_LIMIT)
+			{
+				job.kept = false;
+				std::vector < size_t > ().swap(after);
+				std::vector < size_t > ().swap(before);
+			}
+			if (job.kept)
+				(pos >= origin ? after : before).push_back(pos);
+		};
+		auto more =[&]()
+		{
+			return !job.cancel.load();
+		};
+
+		if (parent != NULL)
+		{
+			auto split = std::lower_bound(parent->all.begin(), parent->all.end(), origin);
+			for (auto it = split; it != parent->all.end() && more(); ++it)
+				if (matches_at(buf, lit, *it))
+					add(*it);
+			for (auto it = parent->all.begin(); it != split && more(); ++it)
+				if (matches_at(buf, lit, *it))
+					add(*it);
+		}
+		else
+		{
+			size_t resume;
+			for (size_t p = origin, at; (at = find_in(buf, lit, p, buf.size(), more, resume)) != std::string::npos;
+			     p = resume)
+				add(at);
+			for (size_t p = 0, at; more() && (at = find_in(buf, lit, p, origin, more, resume)) != std::string::npos;
+			     p = resume)
+				add(at);
+		}
+		if (job.cancel)
+			return;
+
+		if (job.kept)
+		{
+			before.insert(before.end(), after.begin(), after.end());
+			job.all.swap(before);
+		}
+		job.have_first = true;	// npos if there was no match at all
+		job.done = true;
+	}
+
+	Incremental::Incremental(const std::string & buffer, size_t origin, bool icase):buf(buffer),
+		origin(std::min(origin, buffer.size())), icase(icase)
+	{
+	}
+
+	Incremental::~Incremental()
+	{
+		for (Level & l:levels)
+			stop(l, true);
+		for (std::thread & t:retired)
+			t.join();
+	}
+
+	// Cancel a level's job if it is still running, or with discard, drop
+	// it either way. The threads are joined when the search ends.
+	void Incremental::stop(Level & level, bool discard)
+	{
+		if (level.job && (discard || !level.job->done))
+		{
+			level.job->cancel = true;
+			retired.push_back(std::move(level.job->thread));
+			level.job.reset();
+		}
+	}
+
+	void Incremental::start(Level & level, const Level * parent)
+	{
+		if (level.job)
+			return;
+
+		auto job = std::make_shared < Job > ();
+		auto lit = std::make_shared < Literal > (level.query, icase);
+		std::shared_ptr < Job > from;
+		if (parent != NULL && parent->job && parent->job->done && parent->job->kept)
+			from = parent->job;
+
+		const std::string & b = buf;
+		size_t o = origin;
+		job->thread = std::thread([job, lit, from, &b, o]()
+					  {
+						  run(*job, b, *lit, o, from.get());
+					  });
+		level.job = job;
+	}
+
+	// Find a level's current match from its parent's, or by itself,
+	// until the budget runs out
+	void Incremental::resolve(Level & level, const Level * parent)
+	{
+		Literal lit(level.query, icase);
+		auto start = isearch_clock::now();
+		auto more =[&]()
+		{
+			return std::chrono::duration < double, std::micro > (isearch_clock::now() - start).count() < FRAME_BUDGET_US;
+		};
+		size_t resume;
+
+		if (parent != NULL && parent->resolved)
+		{
+			size_t p = parent->current;
+			if (p == std::string::npos || matches_at(buf, lit, p))
+			{
+				level.current = p;	// no match can come before it
+				level.resolved = true;
+				return;
+			}
+
+			// the parent's list, from its current match on
+			if (parent->job && parent->job->done && parent->job->kept)
+			{
+				const std::vector < size_t > &all = parent->job->all;
+				auto split = std::lower_bound(all.begin(), all.end(), origin);
+				size_t checked = 0;
+				for (size_t pass = 0; pass < 2; pass++)
+				{
+					auto first = pass == 0 ? split : all.begin();
+					auto last = pass == 0 ? all.end() : split;
+					for (auto it = first; it != last; ++it)
+					{
+						if (matches_at(buf, lit, *it))
+						{
+							level.current = *it;
+							level.resolved = true;
+							return;
+						}
+						if (++checked % 4096 == 0 && !more())
+							return;
+					}
+				}
+				level.current = std::string::npos;
+				level.resolved = true;
+				return;
+			}
+
+			// the buffer, but nothing between the origin and the
+			// parent's match can match the longer query either
+			size_t to = (p >= origin) ? buf.size() : origin;
+			size_t at = find_in(buf, lit, p, to, more, resume);
+			bool finished = (at != std::string::npos || resume == to);
+			if (at == std::string::npos && finished && p >= origin)
+			{
+				at = find_in(buf, lit, 0, origin, more, resume);
+				finished = (at != std::string::npos || resume == origin);
+			}
+			if (finished)
+			{
+				level.current = at;
+				level.resolved = true;
+			}
+			return;
+		}
+
+		size_t at = find_in(buf, lit, origin, buf.size(), more, resume);
+		bool finished = (at != std::string::npos || resume == buf.size());
+		if (at == std::string::npos && finished)
+		{
+			at = find_in(buf, lit, 0, origin, more, resume);
+			finished = (at != std::string::npos || resume == origin);
+		}
+		if (finished)	// else out of time, the job will find it
+		{
+			level.current = at;
+			level.resolved = true;
+		}
+	}
+
+	Incremental::State Incremental::update(const std::string & query)
+	{
+		// keep the levels that are still prefixes of the query
+		size_t keep = 0;
+		while (keep < levels.size() && query.compare(0, levels[keep].query.size(), levels[keep].query) == 0
+		       && levels[keep].query.size() <= query.size())
+			keep++;
+		for (size_t i = keep; i < levels.size(); i++)
+			stop(levels[i], true);
+		levels.resize(keep);
+
+		// jobs for queries left behind are not worth the time now
+		for (size_t i = 0; i + 1 < levels.size(); i++)
+			stop(levels[i], false);
+
+		if (query.empty())
+			return NONE;
+
+		if (levels.empty() || levels.back().query != query)
+		{
+			Level level;
+			level.query = query;
+			levels.push_back(level);
+			const Level *parent = (levels.size() > 1) ? &levels[levels.size() - 2] : NULL;
+			resolve(levels.back(), parent);
+		}
+
+		return state();
+	}
+
+	// Starting a thread can cost a keystroke its frame, so the job for a
+	// query only starts once typing pauses
+	Incremental::State Incremental::poll()
+	{
+		if (levels.empty())
+			return NONE;
+
+		start(levels.back(), levels.size() > 1 ? &levels[levels.size() - 2] : NULL);
+		return state();
+	}
+
+	Incremental::State Incremental::state()
+	{
+		if (levels.empty())
+			return NONE;
+
+		Level & top = levels.back();
+		if (!top.resolved && top.job && top.job->have_first.load())
+		{
+			top.current = top.job->first;
+			top.resolved = true;
+		}
+		if (!top.resolved)
+			return PENDING;
+		return (top.current == std::string::npos) ? NONE : FOUND;
+	}
+
+	size_t Incremental::match() const
+	{
+		return levels.empty() ? std::string::npos : levels.back().current;
+	}
+
+	size_t Incremental::count() const
+	{
+		if (levels.empty())
+			return 0;
+		const Level & top = levels.back();
+		return (top.job && top.job->done) ? top.job->count.load() : std::string::npos;
+	}
+
+	void Incremental::visible(size_t lo, size_t hi, std::vector < std::pair < size_t, size_t > > &out) const
+	{
+		out.clear();
+		if (levels.empty())
+			return;
+
+		Literal lit(levels.back().query, icase);
+		size_t resume;
+		auto never =[]()
+		{
+			return true;
+		};
+		hi = std::min(hi, buf.size());
+		for (size_t p = lo, at; (at = find_in(buf, lit, p, hi, never, resume)) != std::string::npos; p = resume)
+			out.push_back(std::make_pair(at, lit.size()));
+	}
+}				// namespace Search
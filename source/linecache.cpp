@@ -0,0 +1,215 @@
+/* 
+   linecache.cpp --- line indexes kept between runs
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <cstdio>
+#include <filesystem>
+
+namespace LineCache
+{
+	namespace fs = std::filesystem;
+
+	static const size_t KEEP_MIN = 8 << 20;	// smaller files are scanned in no time
+	static const uint32_t FORMAT = 1;	// of the kept index
+	static const size_t SAMPLES = 64, SAMPLE = 4096;
+
+	// What a kept index was made from. The hash is of samples spread
+	// over the text, not of all of it: hashing a whole large file would
+	// cost what scanning it does. With the size and the modification
+	// time it tells a file that changed from one that did not; that the
+	// samples of the old length still match is what says a file that
+	// grew was only appended to.
+	struct Head
+	{
+		uint64_t size;
+		int64_t mtime;
+		uint64_t hash;
+		uint64_t chars, words;
+	};
+
+	static uint64_t sampled(const std::string & text, size_t size)
+	{
+		uint64_t hash = 0xcbf29ce484222325ull;	// FNV-1a
+		auto mix =[&](size_t from, size_t to)
+		{
+			for (size_t i = from; i < to; i++)
+				hash = (hash ^ (unsigned char)text[i]) * 0x100000001b3ull;
+		};
+		if (size <= SAMPLES * SAMPLE)
+			mix(0, size);
+		else
+		{
+			// the first and the last samples are the ends of the text
+			for (size_t i = 0; i < SAMPLES; i++)
+			{
+				size_t at = (size - SAMPLE) / (SAMPLES - 1) * i;
+				if (i == SAMPLES - 1)
+					at = size - SAMPLE;
+				mix(at, at + SAMPLE);
+			}
+		}
+		return hash ^ size;
+	}
+
+	// one kept index for each path, in the user's cache directory
+	static std::string kept_for(const std::string & path, std::string & absolute)
+	{
+		std::error_code ec;
+		absolute = fs::absolute(path, ec).lexically_normal().string();
+		char name[64];
+		snprintf(name, sizeof(name), "lines-%016llx.idx",
+			 (unsigned long long)std::hash < std::string > ()(absolute));
+		return cache_path(name);
+	}
+
+	static bool stat(const std::string & path, uint64_t & size, int64_t & mtime)
+	{
+		std::error_code ec;
+		size = fs::file_size(path, ec);
+		if (ec)
+			return false;
+		mtime = fs::last_write_time(path, ec).time_since_epoch().count();
+		return !ec;
+	}
+
+	// the head of a kept index for absolute, leaving in at its offsets
+	static bool read_head(FILE * in, const std::string & absolute, Head & head)
+	{
+		uint32_t magic[3];
+		uint64_t n;
+		if (fread(magic, sizeof(magic), 1, in) != 1 || magic[0] != 0x494c4445 || magic[1] != FORMAT
+		    || magic[2] != sizeof(size_t) || fread(&n, sizeof(n), 1, in) != 1 || n != absolute.size())
+			return false;
+		std::string name(n, '\0');
+		return fread(&name[0], 1, n, in) == n && name == absolute && fread(&head, sizeof(head), 1, in) == 1;
+	}
+
+	bool restore(const std::string & path, const std::string & text, LineIndex & index, DocStats & stats)
+	{
+		Memory::Scope memory(Memory::LINES);
+		Head now;
+		if (text.size() < KEEP_MIN || !stat(path, now.size, now.mtime) || now.size != text.size())
+			return false;	// small, or changed while it was read
+
+		std::string absolute, file = kept_for(path, absolute);
+		if (file.empty())
+			return false;
+		FILE *in = fopen(file.c_str(), "rb");
+		if (in == NULL)
+			return false;
+
+		Head was;
+		bool ok = read_head(in, absolute, was);
+		bool same = ok && was.size == now.size && was.mtime == now.mtime && was.hash == sampled(text, now.size);
+		bool grew = ok && !same && was.size > 0 && was.size < now.size && was.hash == sampled(text, was.size);
+
+		std::vector < size_t > starts;
+		uint64_t n = 0;
+		if (same || grew)
+		{
+			ok = fread(&n, sizeof(n), 1, in) == 1 && n > 0 && n <= was.size + 1;
+			if (ok)
+			{
+				starts.resize(n);
+				ok = fread(starts.data(), sizeof(size_t), n, in) == n;
+			}
+		}
+		fclose(in);
+		if (!(same || grew) || !ok)
+			return false;
+
+		// the offsets must at least be lines of this text; a few of
+		// them spread over it are checked
+		ok = starts[0] == 0 && starts.back() <= was.size;
+		for (size_t i = 1; ok && i < n; i += std::max < size_t > (1, n / SAMPLES))
+			ok = starts[i] > starts[i - 1] && text[starts[i] - 1] == '\n';
+		if (!ok)
+			return false;
+
+		index.assign(std::move(starts), was.size);
+		stats.chars = was.chars;
+		stats.words = was.words;
+		if (grew)
+		{
+			// only what was appended is new
+			index.extend(text, was.size);
+			stats.chars += count_chars(text.data() + was.size, text.size() - was.size);
+			stats.words += count_word_starts(text, was.size, text.size());
+		}
+		return true;
+	}
+
+	void keep(const std::string & path, const std::string & text, const LineIndex & index, const DocStats & stats)
+	{
+		Head head;
+		if (text.size() < KEEP_MIN || !stat(path, head.size, head.mtime) || head.size != text.size())
+			return;
+		head.hash = sampled(text, head.size);
+		head.chars = stats.chars;
+		head.words = stats.words;
+
+		std::string absolute, file = kept_for(path, absolute);
+		if (file.empty())
+			return;
+
+		// nothing to do if what is kept is this already
+		FILE *in = fopen(file.c_str(), "rb");
+		if (in != NULL)
+		{
+			Head was;
+			bool current = read_head(in, absolute, was) && was.size == head.size && was.mtime == head.mtime
+				&& was.hash == head.hash;
+			fclose(in);
+			if (current)
+				return;
+		}
+
+		std::error_code ec;
+		fs::create_directories(fs::path(file).parent_path(), ec);
+		std::string temp = file + ".new";
+		FILE *out = fopen(temp.c_str(), "wb");
+		if (out == NULL)
+			return;
+
+		uint32_t magic[3] = { 0x494c4445, FORMAT, sizeof(size_t) };	// "EDLI"
+		uint64_t n = absolute.size();
+		const std::vector < size_t > &starts = index.offsets();
+		uint64_t lines = starts.size();
+		bool ok = fwrite(magic, sizeof(magic), 1, out) == 1 && fwrite(&n, sizeof(n), 1, out) == 1
+			&& fwrite(absolute.data(), 1, n, out) == n && fwrite(&head, sizeof(head), 1, out) == 1
+			&& fwrite(&lines, sizeof(lines), 1, out) == 1
+			&& fwrite(starts.data(), sizeof(size_t), lines, out) == lines;
+		ok = (fclose(out) == 0) && ok;
+
+		if (ok)
+			fs::rename(temp, file, ec);
+		if (!ok || ec)
+			fs::remove(temp, ec);
+	}
+}				// namespace LineCache
@@ -28,29 +28,34 @@
 
 #include "edit.h"
 
-std::string filebuf = "";
-std::string filename;		// filename path
-
-#if USE_DOS_PATH
-bool useCRLF = true;
-#else
-bool useCRLF = false;
-#endif
+#include <unistd.h>
 
 int main(int argc, char **argv)
 {
+	// scripted edits need no screen
+	if (argc >= 2 && strcmp(argv[1], "--batch") == 0)
+		return Batch::run(argc - 2, argv + 2);
+
 	init_curs();
 
-	if (argc == 2)
+	// "-", a FIFO or text piped in is read as it arrives
+	std::error_code ec;
+	bool piped = (argc == 1 && !isatty(0));
+	if (piped || (argc == 2 && (strcmp(argv[1], "-") == 0 || std::filesystem::is_fifo(argv[1], ec))))
+	{
+		if (!piped && strcmp(argv[1], "-") == 0 && isatty(0))
+			show_err("Nothing to read", "The input is the terminal; pipe something into the editor instead.");
+		else
+			Stream::open(piped ? "-" : argv[1]);
+	}
+	else if (argc == 2)
 	{
-		try
+		// read into buffer at first; a new file is made by saving, but
+		// one that was not read is not saved over
+		if (!open_file(argv[1]) && !std::filesystem::exists(argv[1]))
 		{
 			filename = argv[1];
-			readfile(filename, filebuf);	// read into buffer at first
-		}
-		catch(const std::runtime_error & ex)
-		{
-			show_err("Error whilest reading file!", ex.what());
+			buffer_reset();
 		}
 	}
 	else
@@ -67,5 +72,8 @@ int main(int argc, char **argv)
 	}
 
 	uninit_curs();
+#if USE_TRACE
+	Trace::dump("edit-trace.json");
+#endif
 	return 0;
 }
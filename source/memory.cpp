@@ -0,0 +1,308 @@
+/* 
+   memory.cpp --- what each part of the editor holds in memory
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <new>
+
+namespace Memory
+{
+	// before every block, so that freeing it knows whose it was and how
+	// big; 16 bytes keep the block aligned as malloc's are
+	struct Header
+	{
+		unsigned long long size;
+		unsigned tag;
+		unsigned pad;
+	};
+
+	static thread_local Tag current = OTHER;
+
+	// One thread's counts. Only that thread writes them, so they take no
+	// locked instructions; what a part holds is the sum over all threads,
+	// and may be negative in one that freed what another allocated. A
+	// thread that ends leaves its counts to the next one to start.
+	struct Counts
+	{
+		std::atomic < long long > live[TAGS];
+		std::atomic < unsigned long long > count[TAGS];
+		std::atomic < bool > owned;
+		bool shared;	// written by any thread: atomically
+		Counts *next;
+	};
+
+	static std::atomic < Counts * >threads { NULL };
+	static Counts late = { {}, {}, {true}, true, NULL };	// threads that are ending
+	static thread_local Counts *mine = NULL;
+	static std::atomic < unsigned long long > peak[TAGS];
+	static unsigned long long frame_start[TAGS], last_frame[TAGS];
+
+	static const size_t LARGE = 1 << 20;	// the peak is looked at on these
+
+	static const char *names[TAGS] = {
+		"Other", "Buffer and undo", "Line index", "Display", "Dialogs", "Directory listings", "Search"
+	};
+
+	struct Release
+	{
+		~Release()
+		{
+			mine->owned = false;
+			mine = &late;
+		}
+	};
+
+	static Counts *adopt()
+	{
+		static thread_local Release release;	// hands them on at the end
+		(void)release;
+
+		for (Counts * c = threads.load(); c != NULL; c = c->next)
+		{
+			bool owned = false;
+			if (c->owned.compare_exchange_strong(owned, true))
+				return mine = c;
+		}
+
+		void *room = malloc(sizeof(Counts));	// not new, which counts
+		if (room == NULL)
+			return mine = &late;
+		Counts *c = new(room) Counts();
+		c->owned = true;
+		c->next = threads.load();
+		while (!threads.compare_exchange_weak(c->next, c))
+			continue;
+		return mine = c;
+	}
+
+	template < typename T > static void add(std::atomic < T > &n, T by, bool shared)
+	{
+		if (shared)
+			n.fetch_add(by, std::memory_order_relaxed);
+		else
+			n.store(n.load(std::memory_order_relaxed) + by, std::memory_order_relaxed);
+	}
+
+	static long long held(Tag tag)
+	{
+		long long n = late.live[tag].load(std::memory_order_relaxed);
+		for (Counts * c = threads.load(); c != NULL; c = c->next)
+			n += c->live[tag].load(std::memory_order_relaxed);
+		return n;
+	}
+
+	// what tag holds now, and the most it held if that is more
+	static unsigned long long sample(Tag tag)
+	{
+		long long now = std::max(held(tag), 0LL);
+		unsigned long long was = peak[tag].load(std::memory_order_relaxed);
+		while ((unsigned long long)now > was
+		       && !peak[tag].compare_exchange_weak(was, now, std::memory_order_relaxed))
+			continue;
+		return now;
+	}
+
+	static void *take(size_t size)
+	{
+		Header *h = (Header *) malloc(sizeof(Header) + size);
+		if (h == NULL)
+			return NULL;
+		h->size = size;
+		h->tag = current;
+
+		Counts *c = mine ? mine : adopt();
+		add < long long >(c->live[current], size, c->shared);
+		add < unsigned long long >(c->count[current], 1, c->shared);
+		if (size >= LARGE)
+			sample(current);
+		return h + 1;
+	}
+
+	static void give(void *p)
+	{
+		if (p == NULL)
+			return;
+		Header *h = (Header *) p - 1;
+		Counts *c = mine ? mine : adopt();
+		add < long long >(c->live[h->tag], -(long long)h->size, c->shared);
+		free(h);
+	}
+
+	Scope::Scope(Tag tag):prev(current)
+	{
+		current = tag;
+	}
+
+	Scope::~Scope()
+	{
+		current = prev;
+	}
+
+	static unsigned long long allocated(Tag tag)
+	{
+		unsigned long long n = late.count[tag].load(std::memory_order_relaxed);
+		for (Counts * c = threads.load(); c != NULL; c = c->next)
+			n += c->count[tag].load(std::memory_order_relaxed);
+		return n;
+	}
+
+	Stats stats(Tag tag)
+	{
+		Stats s;
+		s.live = sample(tag);
+		s.peak = peak[tag].load(std::memory_order_relaxed);
+		s.allocations = allocated(tag);
+		s.last_frame = last_frame[tag];
+		return s;
+	}
+
+	const char *name(Tag tag)
+	{
+		return names[tag];
+	}
+
+	unsigned long long allocations()
+	{
+		unsigned long long n = 0;
+		for (int t = 0; t < TAGS; t++)
+			n += allocated((Tag) t);
+		return n;
+	}
+
+	std::string report()
+	{
+		std::string out;
+		unsigned long long held = 0, frame = 0;
+		for (int t = 0; t < TAGS; t++)
+		{
+			Stats s = stats((Tag) t);
+			held += s.live;
+			frame += s.last_frame;
+			out += std::string(names[t]) + ": " + bytes_text(s.live) + " held, " + bytes_text(s.peak) +
+				" at most; " + std::to_string(s.allocations) + " allocations, " + std::to_string(s.last_frame) +
+				" in the last frame.\n";
+		}
+		return "In all " + bytes_text(held) + " held, with " + std::to_string(frame) +
+			" allocations in the last frame.\n\n" + out;
+	}
+
+	// EDIT_MEMORY_LOG names a file that gets a line a second of what each
+	// part holds, its peak and its allocations in the last frame
+	static void log()
+	{
+		static FILE *out = NULL;
+		static bool opened = false;
+		static std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now(), last;
+		if (!opened)
+		{
+			opened = true;
+			const char *path = getenv("EDIT_MEMORY_LOG");
+			if (path != NULL && *path)
+				out = fopen(path, "a");
+		}
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (out == NULL || now - last < std::chrono::seconds(1))
+			return;
+		last = now;
+
+		fprintf(out, "%.1f", std::chrono::duration < double >(now - start).count());
+		for (int t = 0; t < TAGS; t++)
+		{
+			Stats s = stats((Tag) t);
+			fprintf(out, " | %s %llu %llu %llu", names[t], s.live, s.peak, s.last_frame);
+		}
+		fprintf(out, "\n");
+		fflush(out);
+	}
+
+	void frame()
+	{
+		for (int t = 0; t < TAGS; t++)
+		{
+			unsigned long long n = allocated((Tag) t);
+			last_frame[t] = n - frame_start[t];
+			frame_start[t] = n;
+			sample((Tag) t);
+		}
+		log();
+	}
+}				// namespace Memory
+
+// every allocation of the program is counted
+void *operator new(size_t size)
+{
+	void *p = Memory::take(size);
+	if (p == NULL)
+		throw std::bad_alloc();
+	return p;
+}
+
+void *operator new[](size_t size)
+{
+	return operator new(size);
+}
+
+void *operator new(size_t size, const std::nothrow_t &) noexcept
+{
+	return Memory::take(size);
+}
+
+void *operator new[](size_t size, const std::nothrow_t &) noexcept
+{
+	return Memory::take(size);
+}
+
+void operator delete(void *p) noexcept
+{
+	Memory::give(p);
+}
+
+void operator delete[](void *p) noexcept
+{
+	Memory::give(p);
+}
+
+void operator delete(void *p, size_t) noexcept
+{
+	Memory::give(p);
+}
+
+void operator delete[](void *p, size_t) noexcept
+{
+	Memory::give(p);
+}
+
+void operator delete(void *p, const std::nothrow_t &) noexcept
+{
+	Memory::give(p);
+}
+
+void operator delete[](void *p, const std::nothrow_t &) noexcept
+{
+	Memory::give(p);
+}
@@ -40,21 +40,46 @@ std::vector < std::string > mainMenuItems = {
 std::vector < std::string > fileSubmenuItems = {
 	"(back)",
 	"Open",
+	"Quick Open...  Ctrl-P",
 	"Save",
 	"Save As",
+	"( ) Follow End  Ctrl-T",
 	"Exit"
 };
 
 std::vector < std::string > editSubmenuItems = {
 	"(back)",
+	"Undo  Ctrl-U",
+	"Redo  Ctrl-R",
 	"Cut",
 	"Copy",
-	"Paste"
+	"Paste",
+	"Select All",
+	"( ) Block Select  Ctrl-B",
+	"Register: \""
 #if not HAVE_CLIPBOARD		// cannot sink to system clipboard
 		, "More info... (limitations)"
 #endif
 };
 
+std::vector < std::string > searchSubmenuItems = {
+	"(back)",
+	"Find...",
+	"Find as You Type  Ctrl-F",
+	"Find Regex...",
+	"Find Next      F3",
+	"Find Previous  Shift-F3",
+	"Find All",
+	"Count All",
+	"Find in Files...",
+	"Replace...",
+	"Replace All...",
+	"( ) Match Case",
+	"Go to Line:Column...  Ctrl-L"
+};
+
+std::string replacement;	// what Replace... last put in
+
 std::vector < std::string > optionsSubmenuItems = {
 	"(back)",
 	"About Edit",
@@ -64,11 +89,12 @@ std::vector < std::string > optionsSubmenuItems = {
 #else
 	"( ) DOS Line Endings (CRLF)",
 #endif
-	" x  Status Bar"
+	" x  Status Bar",
+	"Memory Report..."
 };
 
 // Function to display editing menu
-void display_menu(WINDOW * win, size_t highlight, int pair_selected, std::string extra_info = "")
+void display_menu(WINDOW * win, size_t highlight, int pair_selected, const std::string & extra_info = "")
 {
 	int x = getmaxx(win);	// max legnth
 
@@ -102,7 +128,13 @@ void display_menu(WINDOW * win, size_t highlight, int pair_selected, std::string
 #endif
 	}
 
-	mvwprintw(win, 0, x - 1 - extra_info.size(), "%s", extra_info.c_str());
+	// the end of a path too long for what is left of the bar
+	int room = x - 1 - (int)offset_x;
+	if ((int)extra_info.size() <= room)
+		mvwprintw(win, 0, x - 1 - extra_info.size(), "%s", extra_info.c_str());
+	else if (room > 3)
+		mvwprintw(win, 0, offset_x, "%s",
+			  Frame::format("...%s", extra_info.c_str() + extra_info.size() - (room - 3)));
 
 	wrefresh(win);
 }
@@ -150,8 +182,74 @@ void display_floating_menu(WINDOW * window, int highlight, int pair_selected, st
 	wrefresh(window);
 }
 
-bool menu_interact(WINDOW * host_menu, std::string extra_info, bool no_interact)
+// Drop down a submenu under the menu bar at column x and let the user pick
+// an item. Returns the item (1 based), 1 "(back)" on KEY_LEFT or ESC, and 0
+// on ERR.
+size_t floating_select(std::vector < std::string > &items, int x)
+{
+	size_t width = 0;
+	for (const std::string & item:items)
+		width = std::max(width, item.size());
+
+	WINDOW *floatingWin = newwin(items.size() + 2, width + 2, 1, x);
+
+	if (floatingWin == NULL)
+	{
+		show_err("Failed to open window.", "Will close the program, afterwards.");
+		return 0;
+	}
+
+#if HAVE_COLOR
+	if (console_color)
+		wbkgd(floatingWin, COLOR_PAIR(COLOR_PAIR_MENU_BAR));
+#endif
+
+	size_t fselection = 1;
+	bool done = false;
+	while (!done)
+	{
+		display_floating_menu(floatingWin, fselection, COLOR_PAIR_SELECTED, items);
+
+		keypad(floatingWin, true);
+		int prev = curs_set(0);
+		int ch = wgetch(floatingWin);
+		curs_set(prev);
+
+		if (ch == ERR)
+		{
+			show_err("Unexpected ERR Recieved",
+				 "Something bad happened, and after closing this message, the program will quit.");
+			fselection = 0;
+			done = true;
+		}
+		else if (ch == KEY_LEFT || ch == 27)
+		{
+			fselection = 1;
+			done = true;
+		}
+		else if (ch == '\r' || ch == '\n')
+		{
+			done = true;
+		}
+		else if (ch == KEY_UP)
+		{
+			if (fselection > 1)
+				fselection--;
+		}
+		else if (ch == KEY_DOWN)
+		{
+			if (fselection < items.size())
+				fselection++;
+		}
+	}
+
+	delwin(floatingWin);
+	return fselection;
+}
+
+bool menu_interact(WINDOW * host_menu, const std::string & extra_info, bool no_interact)
 {
+	TRACE_FUNCTION();
 	display_menu(host_menu, 0, COLOR_PAIR_SELECTED, extra_info);
 	// void display_menu(WINDOW * win, size_t highlight, int pair_normal,
 	// int
@@ -195,7 +293,11 @@ bool menu_interact(WINDOW * host_menu, std::string extra_info, bool no_interact)
 			if (selection == 1)	// File
 			{
 				// to do
-				WINDOW *floatingWin = newwin(7, 9, 1, 2);
+				fileSubmenuItems[6] = Stream::following()? "(x) Follow End  Ctrl-T" : "( ) Follow End  Ctrl-T";
+				size_t width = 0;
+			      for (const std::string & item:fileSubmenuItems)
+					width = std::max(width, item.size());
+				WINDOW *floatingWin = newwin(fileSubmenuItems.size() + 2, width + 2, 1, 2);
 
 #if HAVE_COLOR
 				if (console_color)
@@ -288,28 +390,26 @@ bool menu_interact(WINDOW * host_menu, std::string extra_info, bool no_interact)
 					std::string drive = FileDialog::getdrive(3, 3, false);
 
 					display_status
-						(" ENTER -> confirm; Q -> cancel; UP, DOWN -> navigation; ESC -> Parent directory");
+						(" ENTER -> confirm; Ctrl-X -> cancel; UP, DOWN -> navigation; type to filter; ESC -> Parent directory");
 					std::string tmp_filename = FileDialog::open(filediag, drive);
 
 					if (tmp_filename == "")
 						return true;	// Do nothing
 					// if canceled
 
-					try
-					{
-						readfile(tmp_filename, filebuf);
-						filename = tmp_filename;
-					}
-					catch(const std::runtime_error & ex)
-					{
-						show_err("Error whilest reading file!", ex.what());
-					}
+					open_file(tmp_filename);
 
 					delwin(filediag);
 					curs_set(prev);
 					return true;
 				}
-				else if (fselection == 3)	// Save
+				else if (fselection == 3)	// Quick Open
+				{
+					quick_open();
+					curs_set(prev);
+					return true;
+				}
+				else if (fselection == 4)	// Save
 				{
 					if (filename == "")
 					{
@@ -319,25 +419,23 @@ bool menu_interact(WINDOW * host_menu, std::string extra_info, bool no_interact)
 						return true;
 					}
 
-					try
-					{
-						writefile(filename, filebuf);
-					}
-					catch(const std::runtime_error & ex)
-					{
-						show_err("Error whilest reading file!", ex.what());
-					}
-
+					save_file();
 					return true;
 				}
-				else if (fselection == 4)	// Save As
+				else if (fselection == 5)	// Save As
 				{
 					show_err("Not implemented yet",
 						 "The module required for this function to work has not been implemented yet. \n\nThus this module is unuseable, making for a quite dumb editor.");
 					curs_set(prev);
 					return true;
 				}
-				else if (fselection == 5)	// Exit
+				else if (fselection == 6)	// Follow End
+				{
+					toggle_follow();
+					curs_set(prev);
+					return true;
+				}
+				else if (fselection == 7)	// Exit
 				{
 					// show_norm("Exit menu called", "The
 					// exit button was
@@ -348,18 +446,205 @@ bool menu_interact(WINDOW * host_menu, std::string extra_info, bool no_interact)
 			}
 			else if (selection == 2)	// Edit
 			{
-				show_warn("Not implemented yet.",
-					  "Registers for the clipboard have not been implemented yet. Please wait 'till 1.0.0.0.");
+				editSubmenuItems[7] = block_select ? "(x) Block Select  Ctrl-B" : "( ) Block Select  Ctrl-B";
+				size_t eselection = floating_select(editSubmenuItems, 8);
+
+				if (eselection == 0)	// ERR
+					return false;
+				else if (eselection == 2 || eselection == 3)	// Undo or Redo
+				{
+					size_t pos = (eselection == 2) ? buffer_undo() : buffer_redo();
+					if (pos == std::string::npos)
+						status_note(eselection == 2 ? " Nothing to undo." : " Nothing to redo.");
+					else
+						jump_to(pos);
+					curs_set(prev);
+					return true;
+				}
+				else if ((eselection == 4 || eselection == 5) && block_select)	// of a block
+				{
+					Block::Rect r;
+					if (!block_selection(r) || r.left == r.right)
+						status_note(" Nothing is selected. Hold Shift and use the arrows to select.");
+					else
+					{
+						if (eselection == 4)
+						{
+							Registers::cut_block(r);
+							jump_to(buffer_offset(r.first, r.left));
+						}
+						else
+							Registers::copy_block(r);
+						status_note(" " + std::to_string(r.last - r.first + 1) + " lines by " +
+							    std::to_string(r.right - r.left) + " columns " +
+							    (eselection == 4 ? "cut to" : "copied to") + " register " +
+							    Registers::current + ".");
+					}
+					selection_mark = std::string::npos;
+					curs_set(prev);
+					return true;
+				}
+				else if (eselection == 4 || eselection == 5)	// Cut or Copy
+				{
+					size_t from, to;
+					if (!::selection(from, to))	// the menu's own selection hides it
+						status_note(" Nothing is selected. Hold Shift and use the arrows to select.");
+					else
+					{
+						if (eselection == 4)
+						{
+							Registers::cut(from, to - from);
+							jump_to(from);
+						}
+						else
+							Registers::copy(from, to - from);
+						status_note(" " + std::to_string(to - from) + " bytes " +
+							    (eselection == 4 ? "cut to" : "copied to") + " register " +
+							    Registers::current + ".");
+					}
+					selection_mark = std::string::npos;
+					curs_set(prev);
+					return true;
+				}
+				else if (eselection == 6)	// Paste
+				{
+					size_t at = cursor_offset();
+					size_t n = Registers::paste(at);
+					if (n == 0)
+						status_note(std::string(" Register ") + Registers::current + " is empty.");
+					else if (!Registers::block(Registers::current))
+						jump_to(at + n);	// a block leaves the cursor at its corner
+					selection_mark = std::string::npos;
+					curs_set(prev);
+					return true;
+				}
+				else if (eselection == 7)	// Select All
+				{
+					block_select = false;
+					selection_mark = 0;
+					jump_to(filebuf.size());
+					curs_set(prev);
+					return true;
+				}
+				else if (eselection == 8)	// Block Select
+				{
+					block_select = !block_select;
+					curs_set(prev);
+					return true;
+				}
+				else if (eselection == 9)	// Register
+				{
+					std::string name(1, Registers::current);
+					if (prompt(" Register, a to z or \" for the unnamed one: ", name))
+					{
+						if (name.size() == 1 && Registers::valid(name[0]))
+						{
+							Registers::current = name[0];
+							editSubmenuItems[8] = "Register: " + name;
+						}
+						else
+							show_warn("No such register", "Registers are named a to z, and \" is the unnamed one.");
+					}
+					curs_set(prev);
+					return true;
+				}
+				else if (eselection == 10)	// More info
+				{
+					show_norm("Registers",
+						  "Cut, Copy and Paste use the editor's own registers, not the system clipboard, so text cannot be pasted into other programs.");
+				}
 			}
 			else if (selection == 3)	// Search
 			{
-				show_warn("Not implemented yet.",
-					  "Search has not been implemented yet. Such a feature would have to wait 'till 1.0.0.0.");
+				size_t sselection = floating_select(searchSubmenuItems, 14);
+
+				if (sselection == 0)	// ERR
+					return false;
+				else if (sselection == 3)	// Find as You Type
+				{
+					incremental_find();
+					curs_set(prev);
+					return true;
+				}
+				else if (sselection == 2 || sselection == 4)	// Find... or Find Regex...
+				{
+					bool regex = (sselection == 4);
+					std::string text = Search::query;
+					if (prompt(regex ? " Find regex: " : " Find: ", text) && !text.empty())
+					{
+						Search::query = text;
+						Search::use_regex = regex;
+						find_and_jump(true, cursor_offset());
+					}
+					curs_set(prev);
+					return true;
+				}
+				else if (sselection == 5)	// Find Next
+				{
+					find_and_jump(true, cursor_offset() + 1);
+					curs_set(prev);
+					return true;
+				}
+				else if (sselection == 6)	// Find Previous
+				{
+					find_and_jump(false, cursor_offset());
+					curs_set(prev);
+					return true;
+				}
+				else if (sselection == 7 || sselection == 8)	// Find All or Count All
+				{
+					if (Search::query.empty())
+						show_warn("Nothing to find", "Use Find... or Find Regex... to say what to look for.");
+					else
+						find_all(sselection == 7);
+					curs_set(prev);
+					return true;
+				}
+				else if (sselection == 9)	// Find in Files...
+				{
+					find_in_files();
+					curs_set(prev);
+					return true;
+				}
+				else if (sselection == 10 || sselection == 11)	// Replace... or Replace All...
+				{
+					// a regex query stays one, Find Regex... says so
+					std::string text = Search::query;
+					if (prompt(Search::use_regex ? " Replace regex: " : " Replace: ", text) && !text.empty()
+					    && prompt(" With: ", replacement))
+					{
+						Search::query = text;
+						if (sselection == 10)
+							query_replace(replacement);
+						else
+							replace_all(replacement);
+					}
+					curs_set(prev);
+					return true;
+				}
+				else if (sselection == 12)	// Match Case
+				{
+					Search::match_case = !Search::match_case;
+					searchSubmenuItems[11] = Search::match_case ? "(x) Match Case" : "( ) Match Case";
+				}
+				else if (sselection == 13)	// Go to Line:Column...
+				{
+					go_to();
+					curs_set(prev);
+					return true;
+				}
 			}
 			else if (selection == 4)	// Options
 			{
-				show_warn("Not implemented yet.",
-					  "Word wrapping has not been implemented yet. Other options are disabled for use.");
+				size_t oselection = floating_select(optionsSubmenuItems, 22);
+
+				if (oselection == 0)	// ERR
+					return false;
+				else if (oselection == 6)	// Memory Report
+					show_norm("Memory Report", Memory::report());
+				else if (oselection != 1)
+					show_warn("Not implemented yet.",
+						  "Word wrapping has not been implemented yet. Other options are disabled for use.");
 			}
 			else	// ERR
 			{
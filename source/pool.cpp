@@ -0,0 +1,84 @@
+/* 
+   pool.cpp --- a fixed set of worker threads
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+WorkerPool::WorkerPool(size_t count)
+{
+	if (count == 0)
+		count = 1;
+	for (size_t i = 0; i < count; i++)
+		threads.emplace_back(&WorkerPool::run, this);
+}
+
+WorkerPool::~WorkerPool()
+{
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		stopping = true;
+	}
+	wake.notify_all();
+	for (std::thread & t:threads)
+		t.join();
+}
+
+void WorkerPool::submit(std::function < void () > task)
+{
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		tasks.push_back(std::move(task));
+	}
+	wake.notify_one();
+}
+
+void WorkerPool::run()
+{
+	while (true)
+	{
+		std::function < void () > task;
+		{
+			std::unique_lock < std::mutex > guard(lock);
+			wake.wait(guard,[this]()
+				  {
+					  return stopping || !tasks.empty();
+				  });
+			if (tasks.empty())
+				return;	// stopping, and nothing left to do
+			task = std::move(tasks.front());
+			tasks.pop_front();
+		}
+		task();
+	}
+}
+
+// One pool for the whole editor, a thread per core
+WorkerPool & worker_pool()
+{
+	static WorkerPool pool(std::thread::hardware_concurrency());
+	return pool;
+}
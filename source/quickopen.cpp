@@ -0,0 +1,488 @@
+/* 
+   quickopen.cpp --- fuzzy matching over every file under a directory
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+
+namespace QuickOpen
+{
+	namespace fs = std::filesystem;
+
+	static const size_t SEGMENT = 65536;	// files in a segment, at most
+	static const int SEAL_MS = 100;	// a first index shows what it has this often
+	static const size_t ARENA_LIMIT = 0xF0000000u;	// offsets are 32 bits
+	static const uint32_t FORMAT = 1;	// of the saved index
+
+	// One bit for each letter and digit, the rest of the bytes share the
+	// others. A path without every bit of the query cannot match it, which
+	// turns most of an index away without looking at a byte of it.
+	uint64_t mask_of(const char *text, size_t len)
+	{
+		uint64_t mask = 0;
+		for (size_t i = 0; i < len; i++)
+		{
+			unsigned char c = ascii_fold.to[(unsigned char)text[i]];
+			if (c >= 'a' && c <= 'z')
+				mask |= 1ull << (c - 'a');
+			else if (c >= '0' && c <= '9')
+				mask |= 1ull << (26 + c - '0');
+			else
+				mask |= 1ull << (36 + c % 28);
+		}
+		return mask;
+	}
+
+	// where a saved index for root goes: the user's cache directory, one
+	// file per root
+	static std::string cache_file(const std::string & root)
+	{
+		char name[64];
+		snprintf(name, sizeof(name), "quickopen-%016llx.idx",
+			 (unsigned long long)std::hash < std::string > ()(root));
+		return cache_path(name);
+	}
+
+	Index::Index(const std::string & root):dir(root)
+	{
+		std::error_code ec;
+		absolute = fs::absolute(root, ec).lexically_normal().string();
+		file = cache_file(absolute);
+		loaded = load();
+		walker = std::thread(&Index::walk, this);
+	}
+
+	Index::~Index()
+	{
+		canceled = true;
+		walker.join();
+	}
+
+	Segments Index::segments() const
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		return current;
+	}
+
+	unsigned long long Index::generation() const
+	{
+		std::lock_guard < std::mutex > guard(lock);
+		return generations;
+	}
+
+	// Every regular file but those of version control, a segment at a
+	// time. Without a saved index the segments show as they are made;
+	// with one, it is shown until the walk is done and then replaced.
+	void Index::walk()
+	{
+		Memory::Scope memory(Memory::SEARCH);
+		auto seg = std::make_shared < Segment > ();
+		std::unordered_map < std::string, uint32_t > dir_ids;
+		std::vector < uint64_t > dir_masks;
+		std::string last_parent;
+		uint32_t last_dir = 0;
+		auto sealed = std::chrono::steady_clock::now();
+
+		auto seal =[&]()
+		{
+			if (seg->files.empty())
+				return;
+			std::lock_guard < std::mutex > guard(lock);
+			building.push_back(seg);
+			if (!loaded)
+				current = building;
+			seg = std::make_shared < Segment > ();
+			sealed = std::chrono::steady_clock::now();
+			dir_ids.clear();
+			dir_masks.clear();
+			last_parent.clear();
+		};
+
+		std::error_code ec;
+		fs::recursive_directory_iterator it(dir, fs::directory_options::skip_permission_denied, ec);
+		for (; !ec && it != fs::recursive_directory_iterator() && !canceled; it.increment(ec))
+		{
+			std::error_code type_ec;
+			if (it->is_directory(type_ec))
+			{
+				if (is_vcs_dir(it->path().filename().string()))
+					it.disable_recursion_pending();
+				continue;
+			}
+			if (!it->is_regular_file(type_ec))
+				continue;
+
+			std::string name = it->path().filename().string();
+			std::string parent = it->path().parent_path().string();
+			if (seg->arena.size() + parent.size() + name.size() + 2 > ARENA_LIMIT)
+				seal();
+
+			// files of a directory mostly come together; the map
+			// catches those its subdirectories came between
+			if (seg->files.empty() || parent != last_parent)
+			{
+				auto known = dir_ids.find(parent);
+				if (known != dir_ids.end())
+					last_dir = known->second;
+				else
+				{
+					// relative to the root, which is "" itself
+					std::string rel = parent.size() > dir.size() ? parent.substr(dir.size()) : "";
+					size_t skip = rel.find_first_not_of(fs::path::preferred_separator == '/' ? "/" : "/\\");
+					rel.erase(0, std::min(skip, rel.size()));
+
+					last_dir = (uint32_t) seg->dirs.size();
+					seg->dirs.push_back((uint32_t) seg->arena.size());
+					seg->arena.append(rel).push_back('\0');
+					dir_masks.push_back(mask_of(rel.data(), rel.size()));
+					dir_ids.emplace(parent, last_dir);
+				}
+				last_parent = parent;
+			}
+
+			Segment::File f;
+			f.dir = last_dir;
+			f.name = (uint32_t) seg->arena.size();
+			f.mask = dir_masks[last_dir] | mask_of(name.data(), name.size());
+			seg->arena.append(name).push_back('\0');
+			seg->files.push_back(f);
+			found++;
+
+			if (seg->files.size() == SEGMENT)
+				seal();
+			else if (!loaded && seg->files.size() % 1024 == 0 &&
+				 std::chrono::steady_clock::now() - sealed > std::chrono::milliseconds(SEAL_MS))
+				seal();
+		}
+		if (!canceled)
+		{
+			seal();
+			std::lock_guard < std::mutex > guard(lock);
+			if (loaded)	// the saved one is out of date now
+				generations++;
+			current = building;
+		}
+		if (!canceled)
+			save(segments());
+		finished = true;
+	}
+
+	// The saved index is the segments as they are in memory, after the
+	// root they are of; it is only ever read back by the build that wrote
+	// it, so it is in this machine's byte order. Written to the side and
+	// renamed, so a reader never sees half of one.
+	template < typename T > static bool put(FILE * out, const std::vector < T > &v)
+	{
+		uint64_t n = v.size();
+		return fwrite(&n, sizeof(n), 1, out) == 1 && (n == 0 || fwrite(v.data(), sizeof(T), n, out) == n);
+	}
+
+	template < typename T > static bool get(FILE * in, std::vector < T > &v, uint64_t limit)
+	{
+		uint64_t n;
+		if (fread(&n, sizeof(n), 1, in) != 1 || n > limit)
+			return false;
+		v.resize(n);
+		return n == 0 || fread(v.data(), sizeof(T), n, in) == n;
+	}
+
+	void Index::save(const Segments & segments) const
+	{
+		if (file.empty())
+			return;
+		std::error_code ec;
+		fs::create_directories(fs::path(file).parent_path(), ec);
+
+		std::string temp = file + ".new";
+		FILE *out = fopen(temp.c_str(), "wb");
+		if (out == NULL)
+			return;
+
+		uint32_t head[2] = { 0x4f514445, FORMAT };	// "EDQO"
+		bool ok = fwrite(head, sizeof(head), 1, out) == 1
+			&& put(out, std::vector < char >(absolute.begin(), absolute.end()));
+		uint64_t n = segments.size();
+		ok = ok && fwrite(&n, sizeof(n), 1, out) == 1;
+		for (const auto & seg:segments)
+		{
+			ok = ok && put(out, std::vector < char >(seg->arena.begin(), seg->arena.end()))
+				&& put(out, seg->dirs) && put(out, seg->files);
+		}
+		ok = (fclose(out) == 0) && ok;
+
+		if (ok)
+			fs::rename(temp, file, ec);
+		if (!ok || ec)
+			fs::remove(temp, ec);
+	}
+
+	// false, and nothing loaded, for any file that is not a whole index of
+	// this root in this format
+	bool Index::load()
+	{
+		Memory::Scope memory(Memory::SEARCH);
+		if (file.empty())
+			return false;
+		FILE *in = fopen(file.c_str(), "rb");
+		if (in == NULL)
+			return false;
+
+		Segments segments;
+		uint32_t head[2];
+		std::vector < char >root;
+		uint64_t n = 0;
+		bool ok = fread(head, sizeof(head), 1, in) == 1 && head[0] == 0x4f514445 && head[1] == FORMAT
+			&& get(in, root, 1 << 16) && std::string(root.begin(), root.end()) == absolute
+			&& fread(&n, sizeof(n), 1, in) == 1 && n < (1u << 24);
+		for (uint64_t i = 0; ok && i < n; i++)
+		{
+			auto seg = std::make_shared < Segment > ();
+			std::vector < char >arena;
+			ok = get(in, arena, ARENA_LIMIT) && get(in, seg->dirs, ARENA_LIMIT)
+				&& get(in, seg->files, SEGMENT);
+			seg->arena.assign(arena.begin(), arena.end());
+
+			// everything must point inside the arena
+		      for (uint32_t d:seg->dirs)
+				ok = ok && d < seg->arena.size();
+		      for (const Segment::File & f:seg->files)
+				ok = ok && f.dir < seg->dirs.size() && f.name < seg->arena.size();
+			ok = ok && (seg->arena.empty() || seg->arena.back() == '\0');
+			segments.push_back(seg);
+		}
+		fclose(in);
+		if (!ok)
+			return false;
+
+		current = segments;
+		return true;
+	}
+
+	// Match the folded query against a path backwards, each character of
+	// it as late as it can be, so the name has the most of it; a score, or
+	// -1 if the path does not have the query's characters in order.
+	// Matches at the start of a word, in a run and in the name score
+	// higher. The path is read where it lies, its directory and its name
+	// apart, as copying it out costs more than matching it.
+	static int score(const char *dir, size_t dlen, const char *name, size_t nlen, const std::string & query)
+	{
+		size_t name_at = dlen > 0 ? dlen + 1 : 0;
+		auto at =[&](size_t p) -> unsigned char
+		{
+			return p >= name_at ? name[p - name_at] : p < dlen ? dir[p] : '/';
+		};
+
+		int total = 0;
+		size_t pos = name_at + nlen;
+		size_t later = std::string::npos;	// what the next character matched
+		for (size_t k = query.size(); k-- > 0;)
+		{
+			unsigned char q = query[k];
+			while (pos > name_at && ascii_fold.to[(unsigned char)name[pos - 1 - name_at]] != q)
+				pos--;
+			if (pos <= name_at && pos > dlen && ascii_fold.to['/'] != q)
+				pos--;
+			while (pos <= dlen && pos > 0 && ascii_fold.to[(unsigned char)dir[pos - 1]] != q)
+				pos--;
+			if (pos == 0)
+				return -1;
+			size_t p = --pos;
+
+			total += 1;
+			if (later == p + 1)
+				total += 8;	// a run
+			else if (later != std::string::npos)
+				total -= std::min < size_t > (later - p - 1, 4);	// a gap
+			unsigned char before = p > 0 ? at(p - 1) : '/';
+			if (before == '/' || before == '\\' || before == '_' || before == '-' || before == '.' ||
+			    before == ' ' || (std::islower(before) && std::isupper(at(p))))
+				total += 6;	// starts a word
+			if (p >= name_at)
+				total += 3;
+			later = p;
+		}
+		return total;
+	}
+
+	// the path of a file relative to the root, and where its name begins
+	static size_t path_of(const Segment & seg, const Segment::File & f, std::string & path)
+	{
+		const char *dir = seg.arena.data() + seg.dirs[f.dir];
+		path.assign(dir);
+		if (!path.empty())
+			path += fs::path::preferred_separator;
+		size_t name_at = path.size();
+		path.append(seg.arena.data() + f.name);
+		return name_at;
+	}
+
+	std::string path(const Segments & segments, const Result & r)
+	{
+		std::string out;
+		path_of(*segments[r.segment], segments[r.segment]->files[r.file], out);
+		return out;
+	}
+
+	// best first; then shorter, then in the order of the walk
+	static bool better(const Result & a, const Result & b)
+	{
+		if (a.score != b.score)
+			return a.score > b.score;
+		if (a.length != b.length)
+			return a.length < b.length;
+		return a.segment != b.segment ? a.segment < b.segment : a.file < b.file;
+	}
+
+	size_t Finder::search(const Segments & segments, unsigned long long generation, const std::string & text,
+			      size_t top, std::vector < Result > &out)
+	{
+		std::string query;
+		for (char c:text)
+		{
+			if (c != ' ')	// spaces only separate words for the eye
+				query += (char)ascii_fold.to[(unsigned char)c];
+		}
+
+		// a longer query matches a subset of what a shorter one it
+		// contains in order matched, on the segments that one saw
+		bool refine = generation == seen_generation && !last.empty()
+			&& score("", 0, query.data(), query.size(), last) >= 0;
+		if (!refine)
+		{
+			matched.clear();
+			searched = 0;
+		}
+		seen_generation = generation;
+		last = query;
+
+		// the pieces of work: runs of the earlier matches, then whole
+		// segments it has not seen
+		struct Piece
+		{
+			size_t from, to;	// in matched, or in a segment's files
+			size_t segment;	// npos for matched
+		};
+		std::vector < Piece > pieces;
+		const size_t RUN = 16384;
+		for (size_t i = 0; i < matched.size(); i += RUN)
+			pieces.push_back(Piece { i, std::min(matched.size(), i + RUN), std::string::npos });
+		for (size_t s = searched; s < segments.size(); s++)
+		{
+			size_t n = segments[s]->files.size();
+			for (size_t i = 0; i < n; i += RUN)
+				pieces.push_back(Piece { i, std::min(n, i + RUN), s });
+		}
+		searched = segments.size();
+
+		uint64_t qmask = mask_of(query.data(), query.size());
+		std::vector < std::vector < std::pair < uint32_t, uint32_t > > > found(pieces.size());
+		std::vector < std::vector < Result > > best(pieces.size());
+
+		// every piece keeps its own best, so merging them is cheap
+		auto work =[&](size_t k)
+		{
+			const Piece & piece = pieces[k];
+			auto consider =[&](uint32_t s, uint32_t i)
+			{
+				const Segment & seg = *segments[s];
+				const Segment::File & f = seg.files[i];
+				if ((qmask & ~f.mask) != 0)
+					return;
+				const char *dir = seg.arena.data() + seg.dirs[f.dir];
+				const char *name = seg.arena.data() + f.name;
+				size_t dlen = strlen(dir), nlen = strlen(name);
+				int sc = score(dir, dlen, name, nlen, query);
+				if (sc < 0)
+					return;
+				found[k].push_back(std::make_pair(s, i));
+
+				Result r = { sc, (uint32_t) (dlen + (dlen > 0) + nlen), s, i };
+				std::vector < Result > &heap = best[k];
+				if (heap.size() < top)
+				{
+					heap.push_back(r);
+					std::push_heap(heap.begin(), heap.end(), better);
+				}
+				else if (top > 0 && better(r, heap.front()))
+				{
+					std::pop_heap(heap.begin(), heap.end(), better);
+					heap.back() = r;
+					std::push_heap(heap.begin(), heap.end(), better);
+				}
+			};
+			if (piece.segment == std::string::npos)
+			{
+				for (size_t j = piece.from; j < piece.to; j++)
+					consider(matched[j].first, matched[j].second);
+			}
+			else
+			{
+				for (size_t j = piece.from; j < piece.to; j++)
+					consider((uint32_t) piece.segment, (uint32_t) j);
+			}
+		};
+
+		WorkerPool & pool = worker_pool();
+		std::mutex lock;
+		std::condition_variable done;
+		size_t left = pieces.size();
+		for (size_t k = 0; k < pieces.size(); k++)
+		{
+			pool.submit([&, k]()
+				    {
+					    work(k);
+					    std::lock_guard < std::mutex > guard(lock);
+					    if (--left == 0)
+						    done.notify_all();
+				    });
+		}
+		{
+			std::unique_lock < std::mutex > guard(lock);
+			done.wait(guard,[&]()
+				  {
+					  return left == 0;
+				  });
+		}
+
+		std::vector < std::pair < uint32_t, uint32_t > > all;
+		out.clear();
+		for (size_t k = 0; k < pieces.size(); k++)
+		{
+			all.insert(all.end(), found[k].begin(), found[k].end());
+			out.insert(out.end(), best[k].begin(), best[k].end());
+		}
+		matched.swap(all);
+
+		std::sort(out.begin(), out.end(), better);
+		if (out.size() > top)
+			out.resize(top);
+		return matched.size();
+	}
+}				// namespace QuickOpen
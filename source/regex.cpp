@@ -0,0 +1,1036 @@
+/* 
+   regex.cpp --- regular expressions run by a lazily built DFA
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <bitset>
+#include <map>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// The pattern is parsed into a tree, compiled into a Thompson NFA, and run
+// as a DFA whose states are built the first time they are reached. Every
+// byte of text costs one table lookup once the states it needs exist, so
+// there is no backtracking and the time is linear in the text.
+//
+// A match is found in two passes, each linear: forwards to where the
+// leftmost-longest match ends, then backwards from there to where it
+// starts. That is the match POSIX tools report.
+
+namespace Search
+{
+	typedef std::bitset < 256 > ByteSet;
+
+	// Parse tree
+	struct Node
+	{
+		enum Type
+		{
+			SET, CAT, ALT, STAR, PLUS, QUEST, REPEAT, BOL, EOL, EMPTY
+		} type;
+		ByteSet set;
+		std::vector < int >kids;
+		int min = 0, max = 0;	// REPEAT, max < 0 for no limit
+	};
+
+	const int REPEAT_LIMIT = 1000;
+	const size_t NFA_LIMIT = 100000;	// states
+	const size_t DFA_LIMIT = 4096;	// cached states before starting over
+
+	class Parser
+	{
+	      public:
+		Parser(const std::string & pattern, bool icase, std::vector < Node > &nodes):re(pattern), icase(icase),
+			nodes(nodes)
+		{
+		}
+
+		int parse()
+		{
+			int root = parse_alt();
+			if (pos < re.size())
+				fail("unmatched ')'");
+			return root;
+		}
+
+	      private:
+		const std::string & re;
+		bool icase;
+		std::vector < Node > &nodes;
+		size_t pos = 0;
+
+		void fail(const std::string & why)
+		{
+			throw std::runtime_error("Bad regular expression at offset " + std::to_string(pos) + ": " + why +
+						 ".");
+		}
+
+		int add(Node::Type type)
+		{
+			Node n;
+			n.type = type;
+			nodes.push_back(n);
+			return nodes.size() - 1;
+		}
+
+		int add_set(const ByteSet & set)
+		{
+			int n = add(Node::SET);
+			nodes[n].set = set;
+			if (icase)
+			{
+				for (int c = 'a'; c <= 'z'; c++)
+				{
+					if (nodes[n].set[c] || nodes[n].set[c - 'a' + 'A'])
+					{
+						nodes[n].set[c] = true;
+						nodes[n].set[c - 'a' + 'A'] = true;
+					}
+				}
+			}
+			return n;
+		}
+
+		int parse_alt()
+		{
+			int left = parse_cat();
+			while (pos < re.size() && re[pos] == '|')
+			{
+				pos++;
+				int alt = add(Node::ALT);
+				int right = parse_cat();
+				nodes[alt].kids = { left, right };
+				left = alt;
+			}
+			return left;
+		}
+
+		int parse_cat()
+		{
+			std::vector < int >kids;
+			while (pos < re.size() && re[pos] != '|' && re[pos] != ')')
+				kids.push_back(parse_repeat());
+
+			if (kids.empty())
+				return add(Node::EMPTY);
+			if (kids.size() == 1)
+				return kids[0];
+
+			int cat = add(Node::CAT);
+			nodes[cat].kids = kids;
+			return cat;
+		}
+
+		// {m}, {m,} or {m,n}; anything else is a plain '{'
+		bool parse_braces(int &min, int &max)
+		{
+			size_t p = pos + 1;
+			auto number =[&](int &out)
+			{
+				size_t start = p;
+				out = 0;
+				while (p < re.size() && std::isdigit((unsigned char)re[p]) && out <= REPEAT_LIMIT)
+					out = out * 10 + (re[p++] - '0');
+				return p > start;
+			};
+
+			if (!number(min))
+				return false;
+			max = min;
+			if (p < re.size() && re[p] == ',')
+			{
+				p++;
+				if (!number(max))
+					max = -1;
+			}
+			if (p >= re.size() || re[p] != '}')
+				return false;
+
+			if (min > REPEAT_LIMIT || max > REPEAT_LIMIT || (max >= 0 && max < min))
+				fail("bad repeat count");
+			pos = p + 1;
+			return true;
+		}
+
+		int parse_repeat()
+		{
+			int atom = parse_atom();
+			while (pos < re.size())
+			{
+				char c = re[pos];
+				Node::Type type;
+				int min = 0, max = 0;
+
+				if (c == '*')
+					type = Node::STAR;
+				else if (c == '+')
+					type = Node::PLUS;
+				else if (c == '?')
+					type = Node::QUEST;
+				else if (c == '{' && parse_braces(min, max))
+					type = Node::REPEAT;
+				else
+					break;
+
+				if (type != Node::REPEAT)
+					pos++;
+				int rep = add(type);
+				nodes[rep].kids = { atom };
+				nodes[rep].min = min;
+				nodes[rep].max = max;
+				atom = rep;
+			}
+			return atom;
+		}
+
+		ByteSet class_escape(char c, bool & ok)
+		{
+			ByteSet set;
+			ok = true;
+			switch (c)
+			{
+			case 'd':
+			case 'D':
+				for (int i = '0'; i <= '9'; i++)
+					set[i] = true;
+				break;
+			case 'w':
+			case 'W':
+				for (int i = 0; i < 256; i++)
+					set[i] = std::isalnum(i) || i == '_';
+				break;
+			case 's':
+			case 'S':
+				for (const char *s = " \t\n\r\f\v"; *s; s++)
+					set[(unsigned char)*s] = true;
+				break;
+			default:
+				ok = false;
+				return set;
+			}
+			if (std::isupper((unsigned char)c))
+				set.flip();
+			return set;
+		}
+
+		unsigned char literal_escape(char c)
+		{
+			switch (c)
+			{
+			case 'n':
+				return '\n';
+			case 't':
+				return '\t';
+			case 'r':
+				return '\r';
+			case 'f':
+				return '\f';
+			case 'v':
+				return '\v';
+			case '0':
+				return '\0';
+			default:
+				if (std::isalnum((unsigned char)c))
+					fail(std::string("unknown escape \\") + c);
+				return c;
+			}
+		}
+
+		int parse_class()
+		{
+			ByteSet set;
+			bool negate = false;
+
+			pos++;	// [
+			if (pos < re.size() && re[pos] == '^')
+			{
+				negate = true;
+				pos++;
+			}
+
+			bool first = true;
+			while (pos < re.size() && (re[pos] != ']' || first))
+			{
+				first = false;
+				unsigned char lo = re[pos++];
+
+				if (lo == '\\')
+				{
+					if (pos >= re.size())
+						fail("trailing backslash");
+					bool ok;
+					ByteSet cls = class_escape(re[pos], ok);
+					if (ok)
+					{
+						pos++;
+						set |= cls;
+						continue;
+					}
+					lo = literal_escape(re[pos++]);
+				}
+
+				unsigned char hi = lo;
+				if (pos + 1 < re.size() && re[pos] == '-' && re[pos + 1] != ']')
+				{
+					pos++;
+					hi = re[pos++];
+					if (hi == '\\')
+					{
+						if (pos >= re.size())
+							fail("trailing backslash");
+						hi = literal_escape(re[pos++]);
+					}
+					if (hi < lo)
+						fail("bad character range");
+				}
+				for (int c = lo; c <= hi; c++)
+					set[c] = true;
+			}
+
+			if (pos >= re.size())
+				fail("missing ']'");
+			pos++;	// ]
+
+			if (negate)
+			{
+				if (icase)
+				{
+					// fold before flipping, or [^a] would still
+					// match 'A'
+					int n = add_set(set);
+					set = nodes[n].set;
+					nodes.pop_back();
+				}
+				set.flip();
+				set['\n'] = false;	// never runs across lines
+			}
+			return add_set(set);
+		}
+
+		int parse_atom()
+		{
+			if (pos >= re.size())
+				fail("expected an expression");
+
+			char c = re[pos];
+			ByteSet set;
+
+			switch (c)
+			{
+			case '(':
+				{
+					pos++;
+					if (re.compare(pos, 2, "?:") == 0)
+						pos += 2;
+					int inner = parse_alt();
+					if (pos >= re.size() || re[pos] != ')')
+						fail("missing ')'");
+					pos++;
+					return inner;
+				}
+			case '[':
+				return parse_class();
+			case '.':
+				pos++;
+				set.set();
+				set['\n'] = false;
+				return add_set(set);
+			case '^':
+				pos++;
+				return add(Node::BOL);
+			case '$':
+				pos++;
+				return add(Node::EOL);
+			case '*':
+			case '+':
+			case '?':
+				fail("nothing to repeat");
+				break;
+			case '\\':
+				{
+					pos++;
+					if (pos >= re.size())
+						fail("trailing backslash");
+					bool ok;
+					set = class_escape(re[pos], ok);
+					if (!ok)
+						set[literal_escape(re[pos])] = true;
+					pos++;
+					return add_set(set);
+				}
+			}
+
+			pos++;
+			set[(unsigned char)c] = true;
+			return add_set(set);
+		}
+	};
+
+	// Thompson NFA
+	struct NState
+	{
+		enum Op
+		{
+			OP_SET, OP_SPLIT, OP_EMPTY, OP_BOL, OP_EOL, OP_MATCH
+		} op;
+		int out = -1, out1 = -1;
+		int set = -1;
+	};
+
+	struct Nfa
+	{
+		std::vector < NState > states;
+		std::vector < ByteSet > sets;
+		int start = -1;
+	};
+
+	class Compiler
+	{
+	      public:
+		Compiler(const std::vector < Node > &nodes, bool reverse, Nfa & nfa):nodes(nodes), reverse(reverse),
+			nfa(nfa)
+		{
+		}
+
+		void compile(int root)
+		{
+			Frag f = build(root);
+			int match = add(NState::OP_MATCH);
+			patch(f.outs, match);
+			nfa.start = f.start;
+		}
+
+	      private:
+		typedef std::vector < std::pair < int, int > >Outs;	// (state, which)
+		struct Frag
+		{
+			int start;
+			Outs outs;
+		};
+
+		const std::vector < Node > &nodes;
+		bool reverse;	// compile for matching right to left
+		Nfa & nfa;
+
+		int add(NState::Op op)
+		{
+			if (nfa.states.size() >= NFA_LIMIT)
+				throw std::runtime_error("Regular expression is too large.");
+			NState s;
+			s.op = op;
+			nfa.states.push_back(s);
+			return nfa.states.size() - 1;
+		}
+
+		void patch(const Outs & outs, int to)
+		{
+			for (const auto & o:outs)
+			{
+				if (o.second == 0)
+					nfa.states[o.first].out = to;
+				else
+					nfa.states[o.first].out1 = to;
+			}
+		}
+
+		Frag single(NState::Op op)
+		{
+			int s = add(op);
+			return Frag { s, Outs { {s, 0} } };
+		}
+
+		Frag star(const Frag & body)
+		{
+			int s = add(NState::OP_SPLIT);
+			nfa.states[s].out = body.start;
+			patch(body.outs, s);
+			return Frag { s, Outs { {s, 1} } };
+		}
+
+		Frag quest(const Frag & body)
+		{
+			int s = add(NState::OP_SPLIT);
+			nfa.states[s].out = body.start;
+			Outs outs = body.outs;
+			outs.push_back({ s, 1 });
+			return Frag { s, outs };
+		}
+
+		Frag cat(Frag a, const Frag & b)
+		{
+			patch(a.outs, b.start);
+			a.outs = b.outs;
+			return a;
+		}
+
+		Frag build(int n)
+		{
+			const Node & node = nodes[n];
+
+			switch (node.type)
+			{
+			case Node::SET:
+				{
+					Frag f = single(NState::OP_SET);
+					nfa.sets.push_back(node.set);
+					nfa.states[f.start].set = nfa.sets.size() - 1;
+					return f;
+				}
+			case Node::EMPTY:
+				return single(NState::OP_EMPTY);
+			case Node::BOL:	// a reversed ^ looks at what follows
+				return single(reverse ? NState::OP_EOL : NState::OP_BOL);
+			case Node::EOL:
+				return single(reverse ? NState::OP_BOL : NState::OP_EOL);
+			case Node::CAT:
+				{
+					std::vector < int >kids = node.kids;
+					if (reverse)
+						std::reverse(kids.begin(), kids.end());
+					Frag f = build(kids[0]);
+					for (size_t i = 1; i < kids.size(); i++)
+						f = cat(f, build(kids[i]));
+					return f;
+				}
+			case Node::ALT:
+				{
+					Frag a = build(node.kids[0]);
+					Frag b = build(node.kids[1]);
+					int s = add(NState::OP_SPLIT);
+					nfa.states[s].out = a.start;
+					nfa.states[s].out1 = b.start;
+					Outs outs = a.outs;
+					outs.insert(outs.end(), b.outs.begin(), b.outs.end());
+					return Frag { s, outs };
+				}
+			case Node::STAR:
+				return star(build(node.kids[0]));
+			case Node::PLUS:
+				{
+					Frag body = build(node.kids[0]);
+					Frag loop = star(body);
+					return Frag { body.start, loop.outs };
+				}
+			case Node::QUEST:
+				return quest(build(node.kids[0]));
+			case Node::REPEAT:
+				{
+					// x{2,4} is xx(x(x)?)?, and x{2,} is xxx*
+					Frag f = single(NState::OP_EMPTY);
+					for (int i = 0; i < node.min; i++)
+						f = cat(f, build(node.kids[0]));
+
+					if (node.max < 0)
+						return cat(f, star(build(node.kids[0])));
+
+					std::vector < Frag > optional;
+					for (int i = node.min; i < node.max; i++)
+						optional.push_back(build(node.kids[0]));
+					if (optional.empty())
+						return f;
+
+					Frag tail = quest(optional.back());
+					for (size_t i = optional.size() - 1; i-- > 0;)
+						tail = quest(cat(optional[i], tail));
+					return cat(f, tail);
+				}
+			}
+			throw std::runtime_error("Regular expression compiler got an unknown node.");
+		}
+	};
+
+	// Lazily built DFA over an NFA. A DFA state is the set of NFA states
+	// reached after a byte, before following the empty moves, plus whether
+	// that byte was a newline. The empty moves are followed when the next
+	// byte is known, which is what lets ^ and $ be decided without looking
+	// around.
+	//
+	// The NFA states are kept in groups by where their match would start,
+	// earliest first. When a group matches, the groups after it can only
+	// give matches further right, so they are dropped and no new matches
+	// are started; what is left runs on to find the longest match.
+	struct Machine
+	{
+		const Nfa & nfa;
+
+		struct DState
+		{
+			std::vector < int >kernel;	// groups, each ended by -1
+			bool after_nl;
+			bool closed;	// no new matches start
+			int eof = -1;	// does the text ending here match, -1 unknown
+		};
+
+		std::vector < DState > states;
+		std::map < std::pair < int, std::vector < int > >, int >ids;
+		std::vector < int >table;	// [state * 256 + byte] = next * 2 + matched, or -1
+		bool uses_bol = true;	// if not, after_nl is always false
+
+		// Most of a search is spent waiting for a match to begin, in the
+		// state that only holds the start. If few bytes lead out of it,
+		// the scan skips to the next of them.
+		int fast = -1;	// that state, or -1
+		bool fast_checked = false;
+		unsigned char exits[3];
+		int nexits = 0;
+
+		// closure bookkeeping
+		std::vector < unsigned >mark, seen;
+		unsigned generation = 0;
+		std::vector < int >closure, stack;
+
+		  Machine(const Nfa & nfa):nfa(nfa)
+		{
+		}
+
+		int intern(const std::vector < int >&kernel, bool after_nl, bool closed)
+		{
+			after_nl = after_nl && uses_bol;
+			auto key = std::make_pair((after_nl ? 1 : 0) | (closed ? 2 : 0), kernel);
+			auto it = ids.find(key);
+			if (it != ids.end())
+				return it->second;
+
+			// the text needed too many states, start over rather
+			// than grow without bound
+			if (states.size() >= DFA_LIMIT)
+			{
+				states.clear();
+				ids.clear();
+				table.clear();
+				fast = -1;
+				fast_checked = false;
+			}
+
+			DState d;
+			d.kernel = kernel;
+			d.after_nl = after_nl;
+			d.closed = closed;
+			states.push_back(d);
+			table.resize(states.size() * 256, -1);
+			ids[key] = states.size() - 1;
+			return states.size() - 1;
+		}
+
+		int start_state(bool after_nl, bool closed)
+		{
+			if (mark.size() != nfa.states.size())
+			{
+				mark.assign(nfa.states.size(), 0);
+				seen.assign(nfa.states.size(), 0);
+				uses_bol = false;
+				for (const NState & st:nfa.states)
+					uses_bol = uses_bol || st.op == NState::OP_BOL;
+			}
+			return intern(std::vector < int > { nfa.start, -1 }, after_nl, closed);
+		}
+
+		// Find the bytes leading out of the unanchored start state; the
+		// state is only used to skip ahead if there are at most three
+		void check_fast()
+		{
+			if (fast_checked)
+				return;
+			fast_checked = true;
+			fast = -1;
+
+			int s = start_state(false, false);
+			if (states[s].after_nl)
+				return;
+
+			nexits = 0;
+			for (int b = 0; b < 256; b++)
+			{
+				int t = next(s, b);
+				if (!fast_checked)	// the cache was flushed
+					return;
+				if (t != s * 2)
+				{
+					if (nexits == 3)
+						return;
+					exits[nexits++] = b;
+				}
+			}
+			fast = s;
+		}
+
+		// first of the exit bytes in data[i, n), or n
+		size_t skip(const unsigned char *data, size_t i, size_t n) const
+		{
+			if (nexits == 0)
+				return n;
+			if (nexits == 1)
+			{
+				const void *at = memchr(data + i, exits[0], n - i);
+				return (at != NULL) ? (const unsigned char *)at - data : n;
+			}
+#if defined(__SSE2__)
+			__m128i e0 = _mm_set1_epi8(exits[0]);
+			__m128i e1 = _mm_set1_epi8(exits[1]);
+			__m128i e2 = _mm_set1_epi8(exits[nexits - 1]);
+			for (; i + 16 <= n; i += 16)
+			{
+				__m128i v = _mm_loadu_si128((const __m128i *)(data + i));
+				__m128i hit = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, e0), _mm_cmpeq_epi8(v, e1)),
+							   _mm_cmpeq_epi8(v, e2));
+				int mask = _mm_movemask_epi8(hit);
+				if (mask != 0)
+					return i + __builtin_ctz(mask);
+			}
+#endif
+			for (; i < n; i++)
+			{
+				if (data[i] == exits[0] || data[i] == exits[1] || data[i] == exits[nexits - 1])
+					return i;
+			}
+			return n;
+		}
+
+		// the same threads, but no new ones may start
+		int close(int s)
+		{
+			std::vector < int >kernel = states[s].kernel;
+			return intern(kernel, states[s].after_nl, true);
+		}
+
+		// Follow the empty moves from one group, knowing whether the last
+		// byte and the next one are newlines, skipping NFA states an
+		// earlier group reached. Returns true if the match state was
+		// reached.
+		bool follow(const int *group, bool bol, bool eol)
+		{
+			closure.clear();
+			stack.clear();
+			for (; *group >= 0; group++)
+				stack.push_back(*group);
+			std::reverse(stack.begin(), stack.end());
+			bool matched = false;
+
+			while (!stack.empty())
+			{
+				int s = stack.back();
+				stack.pop_back();
+				if (s < 0 || mark[s] == generation)
+					continue;
+				mark[s] = generation;
+
+				const NState & st = nfa.states[s];
+				switch (st.op)
+				{
+				case NState::OP_SET:
+					closure.push_back(s);
+					break;
+				case NState::OP_MATCH:
+					matched = true;
+					break;
+				case NState::OP_SPLIT:
+					stack.push_back(st.out1);
+					stack.push_back(st.out);
+					break;
+				case NState::OP_EMPTY:
+					stack.push_back(st.out);
+					break;
+				case NState::OP_BOL:
+					if (bol)
+						stack.push_back(st.out);
+					break;
+				case NState::OP_EOL:
+					if (eol)
+						stack.push_back(st.out);
+					break;
+				}
+			}
+			return matched;
+		}
+
+		int step(int s, unsigned char b)
+		{
+			const std::vector < int >old = states[s].kernel;
+			bool after_nl = states[s].after_nl;
+			bool closed = states[s].closed;
+			bool matched = false;
+
+			std::vector < int >kernel;
+			generation++;
+			for (size_t g = 0; g < old.size(); g++)
+			{
+				bool hit = follow(&old[g], after_nl, b == '\n');
+
+				size_t begin = kernel.size();
+				for (int c:closure)
+				{
+					const NState & st = nfa.states[c];
+					if (nfa.sets[st.set][b] && seen[st.out] != generation)
+					{
+						seen[st.out] = generation;
+						kernel.push_back(st.out);
+					}
+				}
+				if (kernel.size() > begin)
+				{
+					std::sort(kernel.begin() + begin, kernel.end());
+					kernel.push_back(-1);
+				}
+
+				while (old[g] >= 0)
+					g++;
+
+				if (hit)
+				{
+					matched = true;
+					closed = true;
+					break;
+				}
+			}
+
+			if (!closed && seen[nfa.start] != generation)
+			{
+				kernel.push_back(nfa.start);
+				kernel.push_back(-1);
+			}
+
+			size_t before = states.size();
+			int next = intern(kernel, b == '\n', closed);
+			int t = next * 2 + (matched ? 1 : 0);
+
+			// s is gone if the cache was just flushed. Moves out of a
+			// dead state are never cached, so the scans only see one
+			// when they leave the table lookup.
+			if (states.size() >= before && !old.empty())
+				table[s * 256 + b] = t;
+			return t;
+		}
+
+		int next(int s, unsigned char b)
+		{
+			int t = table[s * 256 + b];
+			return (t >= 0) ? t : step(s, b);
+		}
+
+		bool dead(int s) const
+		{
+			return states[s].kernel.empty();
+		}
+
+		bool eof_match(int s)
+		{
+			if (states[s].eof < 0)
+			{
+				const std::vector < int >&kernel = states[s].kernel;
+				states[s].eof = 0;
+				generation++;
+				for (size_t g = 0; g < kernel.size(); g++)
+				{
+					if (follow(&kernel[g], states[s].after_nl, true))
+					{
+						states[s].eof = 1;
+						break;
+					}
+					while (kernel[g] >= 0)
+						g++;
+				}
+			}
+			return states[s].eof == 1;
+		}
+	};
+
+	// Chunks addressed by buffer offset
+	struct ChunkView
+	{
+		const Chunks & chunks;
+		std::vector < size_t >base;
+		size_t size = 0;
+
+		  ChunkView(const Chunks & chunks):chunks(chunks)
+		{
+			for (const Chunk & c:chunks)
+			{
+				base.push_back(size);
+				size += c.size;
+			}
+		}
+
+		size_t chunk_of(size_t offset) const
+		{
+			return (std::upper_bound(base.begin(), base.end(), offset) - base.begin()) - 1;
+		}
+
+		unsigned char at(size_t offset) const
+		{
+			size_t c = chunk_of(offset);
+			while (offset - base[c] >= chunks[c].size)	// empty chunks
+				c++;
+			return chunks[c].data[offset - base[c]];
+		}
+
+		// is the byte before offset a newline, or is offset the start
+		bool after_nl(size_t offset) const
+		{
+			return offset == 0 || at(offset - 1) == '\n';
+		}
+	};
+
+	struct Regex::Program
+	{
+		std::vector < Node > nodes;
+		Nfa forward_nfa, reverse_nfa;
+		Machine forward, backward;
+
+		  Program(const std::string & pattern, bool icase):forward(forward_nfa), backward(reverse_nfa)
+		{
+			int root = Parser(pattern, icase, nodes).parse();
+			Compiler(nodes, false, forward_nfa).compile(root);
+			Compiler(nodes, true, reverse_nfa).compile(root);
+		}
+	};
+
+	Regex::Regex(const std::string & pattern, bool icase):prog(new Program(pattern, icase))
+	{
+	}
+
+	Regex::~Regex()
+	{
+	}
+
+	bool Regex::find(const Chunks & chunks, size_t from, size_t & pos, size_t & len,
+			 const std::atomic < bool > *cancel, size_t limit)
+	{
+		ChunkView view(chunks);
+		if (from > view.size || from >= limit)
+			return false;
+
+		// pass 1: where does the leftmost-longest match end. New matches
+		// may start until one is found or limit is reached.
+		Machine & fwd = prog->forward;
+		int s = fwd.start_state(view.after_nl(from), from + 1 >= limit);
+		size_t end = std::string::npos;
+		bool at_eof = true;
+		size_t last_start = (limit == std::string::npos) ? limit : limit - 1;
+
+		for (size_t c = (from < view.size) ? view.chunk_of(from) : chunks.size(); c < chunks.size() && at_eof;
+		     c++)
+		{
+			const unsigned char *data = (const unsigned char *)chunks[c].data;
+			size_t i = (from > view.base[c]) ? from - view.base[c] : 0;
+			size_t n = chunks[c].size;
+
+			while (i < n && at_eof)
+			{
+				if (cancel != NULL && cancel->load(std::memory_order_relaxed))
+					return false;
+
+				// run up to the next cancel check or the byte where
+				// matches stop starting, whichever is first
+				size_t stop = std::min(n, i + 0x10000);
+				if (!fwd.states[s].closed)
+				{
+					if (view.base[c] + i >= last_start)
+						s = fwd.close(s);
+					else
+						stop = std::min(stop, last_start - view.base[c]);
+				}
+
+				fwd.check_fast();
+				const int *table = fwd.table.data();
+				for (; i < stop; i++)
+				{
+					if (s == fwd.fast)
+					{
+						i = fwd.skip(data, i, stop);
+						if (i == stop)
+							break;
+					}
+
+					int t = table[s * 256 + data[i]];
+					if (t < 0)
+					{
+						if (fwd.dead(s))
+						{
+							at_eof = false;
+							break;
+						}
+						t = fwd.step(s, data[i]);
+						table = fwd.table.data();
+					}
+					if (t & 1)
+						end = view.base[c] + i;
+					s = t >> 1;
+				}
+			}
+		}
+		if (at_eof && fwd.eof_match(s))
+			end = view.size;
+		if (end == std::string::npos)
+			return false;
+
+		// pass 2: walk back from the end to the leftmost start, never
+		// before from
+		Machine & back = prog->backward;
+		s = back.start_state(end == view.size || view.at(end) == '\n', true);
+		size_t start = end;
+		bool stopped = false;
+
+		for (size_t c = (end > 0) ? view.chunk_of(end - 1) + 1 : 0; c-- > 0 && !stopped;)
+		{
+			const unsigned char *data = (const unsigned char *)chunks[c].data;
+			size_t i = std::min(end, view.base[c] + chunks[c].size) - view.base[c];
+			size_t floor = (from > view.base[c]) ? from - view.base[c] : 0;
+
+			for (; i > floor; i--)
+			{
+				if (back.dead(s))
+				{
+					stopped = true;
+					break;
+				}
+				int t = back.next(s, data[i - 1]);
+				if (t & 1)
+					start = view.base[c] + i;
+				s = t >> 1;
+			}
+			if (view.base[c] + i == from)
+				break;
+		}
+		if (!stopped)
+		{
+			// reached from, see if the match starts right there
+			if (from == 0)
+			{
+				if (back.eof_match(s))
+					start = 0;
+			}
+			else if (back.next(s, view.at(from - 1)) & 1)
+				start = from;
+		}
+
+		pos = start;
+		len = end - start;
+		return true;
+	}
+}				// namespace Search
@@ -0,0 +1,142 @@
+/* 
+   registers.cpp --- named registers for cut, copy and paste
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+namespace Registers
+{
+	char current = '"';
+
+	static Register registers[27];	// a-z, then the unnamed one
+
+	bool valid(char name)
+	{
+		return name == '"' || (name >= 'a' && name <= 'z');
+	}
+
+	static Register & named(char name)
+	{
+		if (!valid(name))
+			throw std::runtime_error(std::string("There is no register '") + name + "'.");
+		return registers[name == '"' ? 26 : name - 'a'];
+	}
+
+	// take the bytes out of the buffer before they change
+	static void take(Register & reg)
+	{
+		reg.text = std::make_shared < const std::string > (filebuf, reg.pos, reg.len);
+		reg.live = false;
+	}
+
+	size_t size(char name)
+	{
+		const Register & reg = named(name);
+		return reg.live ? reg.len : reg.text ? reg.text->size() : 0;
+	}
+
+	bool block(char name)
+	{
+		return named(name).block;
+	}
+
+	void copy(size_t pos, size_t len)
+	{
+		if (pos > filebuf.size() || len > filebuf.size() - pos)
+			throw std::runtime_error("Attempted to copy past the end of the buffer.");
+
+		Register & reg = named(current);
+		reg = Register();
+		reg.live = true;
+		reg.pos = pos;
+		reg.len = len;
+	}
+
+	void cut(size_t pos, size_t len)
+	{
+		Register & reg = named(current);
+		reg = Register();	// no use taking what is being cut
+		reg.text = buffer_cut(pos, len);
+	}
+
+	// a block's rows are not one piece of the buffer, so they are copied
+	void copy_block(const Block::Rect & r)
+	{
+		Register & reg = named(current);
+		reg = Register();
+		reg.text = std::make_shared < const std::string > (Block::text(r));
+		reg.block = true;
+	}
+
+	void cut_block(const Block::Rect & r)
+	{
+		copy_block(r);
+		Block::erase(r);
+	}
+
+	size_t paste(size_t pos)
+	{
+		Register & reg = named(current);
+		if (reg.live)
+			take(reg);	// pasting moves it, and the undo step keeps it
+		if (!reg.text || reg.text->empty())
+			return 0;
+
+		if (reg.block)	// at the same column on the lines from here on
+		{
+			size_t line = buflines.line_of(std::min(pos, filebuf.size()));
+			Block::paste(line, pos - buflines.start(line), *reg.text);
+		}
+		else
+			buffer_paste(pos, reg.text);
+		return reg.text->size();
+	}
+
+	void edited(size_t pos, size_t removed, size_t added)
+	{
+		for (Register & reg:registers)
+		{
+			if (!reg.live)
+				continue;
+
+			size_t end = reg.pos + reg.len;
+			if (removed == 0 ? pos <= reg.pos : pos + removed <= reg.pos)
+				reg.pos = reg.pos + added - removed;	// before it, it moves
+			else if (pos < end)
+				take(reg);	// inside it
+		}
+	}
+
+	void detach()
+	{
+		for (Register & reg:registers)
+		{
+			if (reg.live)
+				take(reg);
+		}
+	}
+}				// namespace Registers
@@ -0,0 +1,759 @@
+/* 
+   search.cpp --- literal search over the buffer
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+namespace Search
+{
+	std::string query;
+	bool match_case = false;
+	size_t match_pos = 0;
+	size_t match_len = 0;	// nothing highlighted when 0
+
+	unsigned char fold(unsigned char c)
+	{
+		return (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;
+	}
+
+	// Rough frequency of a byte in text, higher is more common. The search
+	// scans for the rarest byte of the needle, so it stops as seldom as
+	// possible to verify a candidate.
+	int byte_rank(unsigned char c)
+	{
+		const char *common = " etaoinsrhldcumfpgwybvk";
+		const char *p = strchr(common, fold(c));
+		if (c != '\0' && p != NULL)
+			return 255 - (p - common);
+		if (c >= 'a' && c <= 'z')
+			return 200;
+		if (c >= '0' && c <= '9')
+			return 180;
+		if (c >= 'A' && c <= 'Z')
+			return 150;
+		if (c == '\n' || c == '.' || c == ',' || c == '=' || c == '/' || c == ':')
+			return 140;
+		return 100;
+	}
+
+	Literal::Literal(const std::string & needle, bool icase):needle(needle), icase(icase)
+	{
+		size_t m = needle.size();
+
+		folded = needle;
+		for (char &c:folded)
+			c = fold(c);
+
+		rare = 0;
+		for (size_t i = 1; i < m; i++)
+		{
+			if (byte_rank(needle[i]) < byte_rank(needle[rare]))
+				rare = i;
+		}
+
+		// the runner up, preferably a different byte
+		rare2 = (m > 1 && rare == 0) ? 1 : 0;
+		for (size_t i = 0; i < m; i++)
+		{
+			if (i == rare)
+				continue;
+			bool differs = fold(needle[i]) != fold(needle[rare]);
+			bool best_differs = fold(needle[rare2]) != fold(needle[rare]);
+			if ((differs && !best_differs)
+			    || (differs == best_differs && byte_rank(needle[i]) < byte_rank(needle[rare2])))
+				rare2 = i;
+		}
+
+		// Horspool shift tables, forward keyed by the window's last byte
+		// and backward keyed by its first byte
+		for (size_t c = 0; c < 256; c++)
+		{
+			shift[c] = m;
+			back_shift[c] = m;
+		}
+		for (size_t i = 0; i + 1 < m; i++)
+			shift[(unsigned char)key(needle[i])] = m - 1 - i;
+		for (size_t i = m; i-- > 1;)
+			back_shift[(unsigned char)key(needle[i])] = i;
+	}
+
+	unsigned char Literal::key(unsigned char c) const
+	{
+		return icase ? fold(c) : c;
+	}
+
+	bool Literal::matches(const char *at) const
+	{
+		if (!icase)
+			return memcmp(at, needle.data(), needle.size()) == 0;
+
+		for (size_t i = 0; i < folded.size(); i++)
+		{
+			if (fold(at[i]) != (unsigned char)folded[i])
+				return false;
+		}
+		return true;
+	}
+
+	// Plain Horspool, the fallback when the fast paths do not apply
+	size_t Literal::horspool(const char *hay, size_t n, size_t from) const
+	{
+		size_t m = needle.size();
+		while (from + m <= n)
+		{
+			if (matches(hay + from))
+				return from;
+			from += shift[key(hay[from + m - 1])];
+		}
+		return std::string::npos;
+	}
+
+	size_t Literal::find(const char *hay, size_t n, size_t from) const
+	{
+		size_t m = needle.size();
+		if (m == 0 || n < m || from > n - m)
+			return std::string::npos;
+
+		if (m == 1 && !icase)
+		{
+			const char *p = (const char *)memchr(hay + from, needle[0], n - from);
+			return p ? p - hay : std::string::npos;
+		}
+
+#if defined(__SSE2__)
+		// compare 16 window positions at a time on the two rarest bytes
+		// of the needle, in both cases if need be, and only verify the
+		// positions where both agree
+		unsigned char lo1 = key(needle[rare]);
+		unsigned char lo2 = key(needle[rare2]);
+		unsigned char up1 = (icase && lo1 >= 'a' && lo1 <= 'z') ? lo1 - ('a' - 'A') : lo1;
+		unsigned char up2 = (icase && lo2 >= 'a' && lo2 <= 'z') ? lo2 - ('a' - 'A') : lo2;
+		__m128i vlo1 = _mm_set1_epi8((char)lo1), vup1 = _mm_set1_epi8((char)up1);
+		__m128i vlo2 = _mm_set1_epi8((char)lo2), vup2 = _mm_set1_epi8((char)up2);
+
+		size_t reach = std::max(rare, rare2) + 16;
+		size_t end = n - m;	// last possible start
+		size_t i = from;
+		while (i + reach <= n && i <= end)
+		{
+			__m128i b1 = _mm_loadu_si128((const __m128i *)(hay + i + rare));
+			__m128i b2 = _mm_loadu_si128((const __m128i *)(hay + i + rare2));
+			__m128i m1 = _mm_or_si128(_mm_cmpeq_epi8(b1, vlo1), _mm_cmpeq_epi8(b1, vup1));
+			__m128i m2 = _mm_or_si128(_mm_cmpeq_epi8(b2, vlo2), _mm_cmpeq_epi8(b2, vup2));
+			unsigned mask = _mm_movemask_epi8(_mm_and_si128(m1, m2));
+
+			while (mask != 0)
+			{
+				size_t at = i + __builtin_ctz(mask);
+				if (at > end)
+					return std::string::npos;
+				if (matches(hay + at))
+					return at;
+				mask &= mask - 1;
+			}
+			i += 16;
+		}
+		return horspool(hay, n, i);
+#else
+		if (!icase)
+		{
+			// let memchr race to the rarest byte, then check the
+			// whole needle around it
+			unsigned char r = needle[rare];
+			const char *p = hay + from + rare;
+			const char *last = hay + n - (m - rare - 1);	// one past
+			size_t misses = 0;
+
+			while (p < last && (p = (const char *)memchr(p, r, last - p)) != NULL)
+			{
+				if (matches(p - rare))
+					return p - rare - hay;
+
+				// a needle made of common bytes, memchr is not
+				// buying anything any more
+				if (++misses > 64 && (size_t)(p - hay - from) < misses * 32)
+					return horspool(hay, n, p - rare - hay + 1);
+				p++;
+			}
+			return std::string::npos;
+		}
+		return horspool(hay, n, from);
+#endif
+	}
+
+	// Backwards Horspool, the window slides left keyed by its first byte
+	size_t Literal::back_horspool(const char *hay, size_t n, size_t before) const
+	{
+		size_t m = needle.size();
+		size_t at = std::min(before - 1, n - m);
+		while (true)
+		{
+			if (matches(hay + at))
+				return at;
+
+			size_t step = back_shift[key(hay[at])];
+			if (at < step)
+				return std::string::npos;
+			at -= step;
+		}
+	}
+
+	size_t Literal::rfind(const char *hay, size_t n, size_t before) const
+	{
+		size_t m = needle.size();
+		if (m == 0 || n < m || before == 0)
+			return std::string::npos;
+
+#if defined(__SSE2__)
+		// the forward filter run backwards, 16 window positions at a
+		// time from the last one, taking the highest hit first
+		unsigned char lo1 = key(needle[rare]);
+		unsigned char lo2 = key(needle[rare2]);
+		unsigned char up1 = (icase && lo1 >= 'a' && lo1 <= 'z') ? lo1 - ('a' - 'A') : lo1;
+		unsigned char up2 = (icase && lo2 >= 'a' && lo2 <= 'z') ? lo2 - ('a' - 'A') : lo2;
+		__m128i vlo1 = _mm_set1_epi8((char)lo1), vup1 = _mm_set1_epi8((char)up1);
+		__m128i vlo2 = _mm_set1_epi8((char)lo2), vup2 = _mm_set1_epi8((char)up2);
+
+		size_t reach = std::max(rare, rare2) + 16;
+		size_t hi = std::min(before - 1, n - m) + 1;	// one past the last start
+		while (hi >= 16 && hi - 16 + reach <= n)
+		{
+			size_t j = hi - 16;
+			__m128i b1 = _mm_loadu_si128((const __m128i *)(hay + j + rare));
+			__m128i b2 = _mm_loadu_si128((const __m128i *)(hay + j + rare2));
+			__m128i m1 = _mm_or_si128(_mm_cmpeq_epi8(b1, vlo1), _mm_cmpeq_epi8(b1, vup1));
+			__m128i m2 = _mm_or_si128(_mm_cmpeq_epi8(b2, vlo2), _mm_cmpeq_epi8(b2, vup2));
+			unsigned mask = _mm_movemask_epi8(_mm_and_si128(m1, m2));
+
+			while (mask != 0)
+			{
+				int bit = 31 - __builtin_clz(mask);
+				if (matches(hay + j + bit))
+					return j + bit;
+				mask &= ~(1u << bit);
+			}
+			hi = j;
+		}
+		if (hi == 0)
+			return std::string::npos;
+		return back_horspool(hay, n, hi);
+#else
+		return back_horspool(hay, n, before);
+#endif
+	}
+
+	Chunks chunks_of(const std::string & buffer)
+	{
+		return Chunks(1, Chunk { buffer.data(), buffer.size() });
+	}
+
+	size_t find_next(const Chunks & chunks, const Literal & lit, size_t from)
+	{
+		size_t m = lit.size();
+		size_t base = 0;
+		std::string seam;
+
+		for (size_t c = 0; c < chunks.size(); c++)
+		{
+			const Chunk & ch = chunks[c];
+
+			if (from < base + ch.size)
+			{
+				size_t local = (from > base) ? from - base : 0;
+				size_t at = lit.find(ch.data, ch.size, local);
+				if (at != std::string::npos)
+					return base + at;
+
+				// a match may straddle into the next chunks, search a
+				// small window made of both sides of the seam
+				if (m > 1 && c + 1 < chunks.size())
+				{
+					size_t tail = std::min(m - 1, ch.size);
+					seam.assign(ch.data + ch.size - tail, tail);
+					for (size_t n = c + 1; n < chunks.size() && seam.size() < tail + m - 1; n++)
+						seam.append(chunks[n].data,
+							    std::min(chunks[n].size, tail + m - 1 - seam.size()));
+
+					size_t seam_base = base + ch.size - tail;
+					size_t skip = (from > seam_base) ? from - seam_base : 0;
+					at = lit.find(seam.data(), seam.size(), skip);
+					if (at != std::string::npos && at < tail)
+						return seam_base + at;
+				}
+			}
+			base += ch.size;
+		}
+		return std::string::npos;
+	}
+
+	size_t find_prev(const Chunks & chunks, const Literal & lit, size_t before)
+	{
+		size_t m = lit.size();
+		size_t end = 0;
+		for (const Chunk & ch:chunks)
+			end += ch.size;
+
+		std::string seam;
+		for (size_t c = chunks.size(); c-- > 0;)
+		{
+			const Chunk & ch = chunks[c];
+			end -= ch.size;	// now the chunk's first offset
+
+			if (before <= end)
+				continue;
+
+			// matches straddling into the following chunks come later
+			// in the buffer, try them first
+			if (m > 1 && c + 1 < chunks.size())
+			{
+				size_t tail = std::min(m - 1, ch.size);
+				seam.assign(ch.data + ch.size - tail, tail);
+				for (size_t n = c + 1; n < chunks.size() && seam.size() < tail + m - 1; n++)
+					seam.append(chunks[n].data, std::min(chunks[n].size, tail + m - 1 - seam.size()));
+
+				size_t seam_base = end + ch.size - tail;
+				size_t limit = std::min(tail, (before > seam_base) ? before - seam_base : 0);
+				size_t at = lit.rfind(seam.data(), seam.size(), limit);
+				if (at != std::string::npos)
+					return seam_base + at;
+			}
+
+			size_t at = lit.rfind(ch.data, ch.size, std::min(before - end, ch.size));
+			if (at != std::string::npos)
+				return end + at;
+		}
+		return std::string::npos;
+	}
+
+	const size_t PIECE_MIN = 1 << 20;
+	const size_t PIECE_MAX = 64 << 20;
+
+	// The chunks' bytes in [lo, hi), as chunks
+	static Chunks slice(const Chunks & chunks, size_t lo, size_t hi)
+	{
+		Chunks out;
+		size_t base = 0;
+		for (const Chunk & ch:chunks)
+		{
+			size_t a = std::max(lo, base), b = std::min(hi, base + ch.size);
+			if (a < b)
+				out.push_back(Chunk { ch.data + (a - base), b - a });
+			base += ch.size;
+		}
+		return out;
+	}
+
+	static size_t total_size(const Chunks & chunks)
+	{
+		size_t n = 0;
+		for (const Chunk & ch:chunks)
+			n += ch.size;
+		return n;
+	}
+
+	// How many pieces to cut a range into so every thread stays busy
+	// without the pieces getting tiny
+	static size_t piece_count(size_t bytes, const WorkerPool & pool)
+	{
+		size_t piece = std::min(PIECE_MAX, std::max(PIECE_MIN, bytes / (pool.size() * 8)));
+		return std::max < size_t > (1, (bytes + piece - 1) / piece);
+	}
+
+	// Run work(k) for pieces 0..count-1 on the pool, at most a few per
+	// thread ahead of take(k), which gets them in order on this thread
+	// and returns false to stop. work() should give up when stop is set.
+	// Nothing is left running on return. False if canceled.
+	static bool run_pieces(WorkerPool & pool, size_t count, const std::function < void (size_t) > &work,
+			       const std::function < bool (size_t) > &take, std::atomic < bool > &stop,
+			       const std::atomic < bool > *cancel)
+	{
+		std::mutex lock;
+		std::condition_variable changed;
+		std::vector < char >done(count, 0);
+		size_t submitted = 0, running = 0;
+		size_t ahead = pool.size() * 2;
+		bool finished = true;
+
+		for (size_t next = 0; next < count; next++)
+		{
+			while (submitted < count && submitted < next + ahead)
+			{
+				size_t k = submitted++;
+				{
+					std::lock_guard < std::mutex > guard(lock);
+					running++;
+				}
+				pool.submit([&, k]()
+					    {
+						    if (!stop)
+							    work(k);
+						    std::lock_guard < std::mutex > guard(lock);
+						    done[k] = 1;
+						    running--;
+						    changed.notify_all();
+					    });
+			}
+
+			{
+				std::unique_lock < std::mutex > guard(lock);
+				while (!done[next] && !(cancel != NULL && *cancel))
+					changed.wait_for(guard, std::chrono::milliseconds(20));
+			}
+			if (cancel != NULL && *cancel)
+			{
+				finished = false;
+				break;
+			}
+			if (!take(next))
+				break;
+		}
+
+		stop = true;
+		std::unique_lock < std::mutex > guard(lock);
+		changed.wait(guard,[&]()
+			     {
+				     return running == 0;
+			     });
+		return finished;
+	}
+
+	bool scan(const Chunks & chunks, const Literal & lit, size_t from, size_t to, WorkerPool & pool,
+		  const std::function < bool (size_t) > &found, const std::atomic < bool > *cancel)
+	{
+		size_t size = total_size(chunks);
+		size_t m = lit.size();
+		to = std::min(to, size);
+		if (from >= to || m == 0)
+			return true;
+
+		size_t count = piece_count(to - from, pool);
+		size_t piece = (to - from + count - 1) / count;
+		std::vector < std::vector < size_t > > matches(count);
+		std::atomic < bool > stop(false);
+
+		// a piece owns the matches starting in it, and reads m - 1 bytes
+		// past its end for the ones that cross into the next
+		auto bounds =[&](size_t k, size_t & lo, size_t & hi)
+		{
+			lo = from + k * piece;
+			hi = std::min(to, lo + piece);
+		};
+		auto piece_chunks =[&](size_t lo, size_t hi)
+		{
+			return slice(chunks, lo, std::min(size, hi + m - 1));
+		};
+
+		auto work =[&](size_t k)
+		{
+			size_t lo, hi;
+			bounds(k, lo, hi);
+			Chunks part = piece_chunks(lo, hi);
+			for (size_t p = 0, at; !stop && (at = find_next(part, lit, p)) < hi - lo; p = at + m)
+				matches[k].push_back(lo + at);
+			scanned += hi - lo;
+		};
+
+		// The greedy walk of a piece starts at its beginning. If the last
+		// match of the piece before runs into it, walk again from where
+		// that match ends until the two walks meet.
+		size_t allowed = from;
+		auto take =[&](size_t k)
+		{
+			size_t lo, hi;
+			bounds(k, lo, hi);
+			const std::vector < size_t > &list = matches[k];
+			size_t i = 0;
+
+			if (!list.empty() && list[0] < allowed)
+			{
+				Chunks part = piece_chunks(lo, hi);
+				while (true)
+				{
+					size_t at = find_next(part, lit, allowed - lo);
+					if (at >= hi - lo)
+					{
+						i = list.size();
+						break;
+					}
+					at += lo;
+					while (i < list.size() && list[i] < at)
+						i++;
+					if (i < list.size() && list[i] == at)
+						break;
+					if (!found(at))
+						return false;
+					allowed = at + m;
+				}
+			}
+
+			for (; i < list.size(); i++)
+			{
+				if (!found(list[i]))
+					return false;
+				allowed = list[i] + m;
+			}
+			std::vector < size_t > ().swap(matches[k]);
+			return true;
+		};
+
+		// a single piece is not worth a trip through the pool
+		if (count == 1)
+		{
+			work(0);
+			take(0);
+			return true;
+		}
+		return run_pieces(pool, count, work, take, stop, cancel);
+	}
+
+	size_t scan_back(const Chunks & chunks, const Literal & lit, size_t before, WorkerPool & pool,
+			 const std::atomic < bool > *cancel)
+	{
+		size_t size = total_size(chunks);
+		size_t m = lit.size();
+		before = std::min(before, size);
+		if (before == 0 || m == 0)
+			return std::string::npos;
+
+		// piece 0 is the one just before before, and so on back
+		size_t count = piece_count(before, pool);
+		size_t piece = (before + count - 1) / count;
+		std::vector < size_t > last(count, std::string::npos);
+		std::atomic < bool > stop(false);
+
+		auto work =[&](size_t k)
+		{
+			size_t hi = before - std::min(before, k * piece);
+			size_t lo = hi - std::min(hi, piece);
+			Chunks part = slice(chunks, lo, std::min(size, hi + m - 1));
+			size_t at = find_prev(part, lit, hi - lo);
+			scanned += hi - lo;
+			if (at != std::string::npos)
+				last[k] = lo + at;
+		};
+
+		size_t result = std::string::npos;
+		auto take =[&](size_t k)
+		{
+			result = last[k];
+			return result == std::string::npos;
+		};
+
+		if (count == 1)
+		{
+			work(0);
+			take(0);
+		}
+		else if (!run_pieces(pool, count, work, take, stop, cancel))
+			return std::string::npos;
+		return result;
+	}
+
+	std::vector < std::pair < size_t, size_t > > hits;
+	std::mutex hits_lock;
+	std::atomic < size_t > counted(0);
+	std::atomic < size_t > scanned(0);
+
+	void forget()
+	{
+		match_len = 0;
+		std::lock_guard < std::mutex > guard(hits_lock);
+		hits.clear();
+	}
+
+	bool use_regex = false;
+
+	// the compiled query, kept while it is searched again and again
+	static std::unique_ptr < Regex > regex;
+	static std::string regex_query;
+	static bool regex_case;
+
+	static Regex & compiled()
+	{
+		if (!regex || regex_query != query || regex_case != match_case)
+		{
+			regex.reset(new Regex(query, !match_case));
+			regex_query = query;
+			regex_case = match_case;
+		}
+		return *regex;
+	}
+
+	// Last match starting before before. A DFA only runs forwards, so
+	// search windows that double in size back from the cursor; the cost
+	// is proportional to how far back the match is.
+	static bool regex_prev(Regex & re, const Chunks & chunks, size_t before, size_t & pos, size_t & len,
+			       const std::atomic < bool > *cancel)
+	{
+		size_t window = 1 << 16;
+		size_t hi = before;
+
+		while (hi > 0)
+		{
+			size_t lo = (hi > window) ? hi - window : 0;
+			bool found = false;
+			size_t at, n;
+
+			for (size_t p = lo; re.find(chunks, p, at, n, cancel, hi); p = at + std::max < size_t > (n, 1))
+			{
+				pos = at;
+				len = n;
+				found = true;
+			}
+			if (found)
+				return true;
+			if (cancel != NULL && cancel->load())
+				return false;
+
+			hi = lo;
+			window *= 2;
+		}
+		return false;
+	}
+
+	// Search the current query from the given offset, wrapping around the
+	// end of the buffer. Going back, only matches starting before it count.
+	// Returns false if there is no match at all.
+	bool find(bool forward, size_t from, const std::atomic < bool > *cancel)
+	{
+		if (query.empty())
+			return false;
+
+		Chunks chunks = chunks_of(filebuf);
+		scanned = 0;
+
+		if (use_regex)
+		{
+			Regex & re = compiled();
+			size_t pos, len;
+			bool found;
+
+			if (forward)
+				found = re.find(chunks, std::min(from, filebuf.size()), pos, len, cancel)
+					|| re.find(chunks, 0, pos, len, cancel);
+			else
+				found = regex_prev(re, chunks, from, pos, len, cancel)
+					|| regex_prev(re, chunks, filebuf.size() + 1, pos, len, cancel);
+
+			if (!found)
+			{
+				match_len = 0;
+				return false;
+			}
+			match_pos = pos;
+			match_len = len;
+			return true;
+		}
+
+		Literal lit(query, !match_case);
+		WorkerPool & pool = worker_pool();
+
+		size_t at = std::string::npos;
+		auto first =[&](size_t pos)
+		{
+			at = pos;
+			return false;
+		};
+
+		if (forward)
+		{
+			if (scan(chunks, lit, from, filebuf.size(), pool, first, cancel) && at == std::string::npos)
+				scan(chunks, lit, 0, from, pool, first, cancel);	// the rest was just seen
+		}
+		else
+		{
+			at = scan_back(chunks, lit, from, pool, cancel);
+			if (at == std::string::npos)
+				at = scan_back(chunks, lit, filebuf.size(), pool, cancel);
+		}
+
+		if (at == std::string::npos)
+		{
+			match_len = 0;
+			return false;
+		}
+
+		match_pos = at;
+		match_len = query.size();
+		return true;
+	}
+
+	bool matches(size_t from, const std::function < bool (size_t, size_t) > &found,
+		     const std::atomic < bool > *cancel)
+	{
+		if (query.empty() || from > filebuf.size())
+			return true;
+
+		Chunks chunks = chunks_of(filebuf);
+
+		if (use_regex)
+		{
+			// one DFA, so one thread: a match has no length limit to
+			// overlap the pieces by. As sed, an empty match right where
+			// the one before ended is none.
+			Regex & re = compiled();
+			size_t pos, len, end = std::string::npos;
+			for (size_t p = from; p <= filebuf.size() && re.find(chunks, p, pos, len, cancel);
+			     p = pos + std::max < size_t > (len, 1))
+			{
+				if (len == 0 && pos == end)
+					continue;
+				if (!found(pos, len))
+					return true;
+				end = pos + len;
+			}
+			return cancel == NULL || !*cancel;
+		}
+
+		Literal lit(query, !match_case);
+		return scan(chunks, lit, from, filebuf.size(), worker_pool(),[&](size_t pos)
+			    {
+				    return found(pos, lit.size());
+			    }, cancel);
+	}
+
+	bool find_all(bool keep, const std::atomic < bool > *cancel)
+	{
+		forget();
+		counted = 0;
+
+		return matches(0,[&](size_t pos, size_t len)
+			       {
+				       if (keep)
+				       {
+					       std::lock_guard < std::mutex > guard(hits_lock);
+					       hits.push_back(std::make_pair(pos, len));
+				       }
+				       counted++;
+				       return true;
+			       }, cancel);
+	}
+}				// namespace Search
@@ -0,0 +1,357 @@
+/* 
+   stream.cpp --- reading a pipe into the buffer as it arrives
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__linux__)
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
+
+#ifndef O_BINARY
+#define O_BINARY 0
+#endif
+
+namespace Stream
+{
+	static const size_t BLOCK = 1 << 16;	// a read; a pipe seldom holds more
+	static const size_t KEPT = 64 << 20;	// input the buffer takes
+	static const size_t FOLLOW_BLOCK = 1 << 20;	// a read of a followed file
+	static const size_t FOLLOW_ROOM = 256 << 20;	// reserved ahead, to move the text seldom
+	static const size_t TAKE_MAX = 8 << 20;	// added in one frame; a few ms
+	static const int FOLLOW_WAIT = 250;	// ms between looks without inotify
+
+	// What the reading thread and the screen share. The thread is never
+	// waited for, as it may sit in a read for as long as the pipe is
+	// quiet; it holds this too, and lets go when it ends.
+	struct Reader
+	{
+		std::mutex lock;
+		std::string arrived;	// read and not taken yet
+		std::string spill_path;	// where all the input goes past KEPT
+		std::string error;
+		std::string note;	// shown when it ended
+		bool over = false;	// more came than KEPT
+		bool ended = false;
+		bool follow = false;
+		std::atomic < bool > stop { false };
+	};
+
+	static std::shared_ptr < Reader > reader;
+	static bool spill_noted = false;
+	static bool cut = false;	// the buffer holds only the start of the input
+
+	// what was taken from the reader and is still to be added, from at
+	static std::string taken;
+	static size_t taken_at = 0;
+
+	static void read_all(std::shared_ptr < Reader > r, std::string path)
+	{
+		Memory::Scope memory(Memory::BUFFER);
+		// a FIFO opens once something opens it to write, so here
+		int fd = (path == "-") ? 0 : ::open(path.c_str(), O_RDONLY | O_BINARY);
+		std::string head;	// the input so far, while it is under KEPT
+		FILE *spill = NULL;
+		std::string spill_path, error;
+		unsigned long long total = 0;
+		std::vector < char > block(BLOCK);
+
+		if (fd < 0)
+			error = "Could not open \"" + path + "\" for reading.";
+
+		while (fd >= 0 && !r->stop)
+		{
+			ssize_t n = read(fd, block.data(), block.size());
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+				error = "I/O error occurred while reading \"" + path + "\".";
+			if (n <= 0)
+				break;
+
+			size_t shown = total < KEPT ? std::min < size_t > (n, KEPT - total) : 0;
+			if (total + n > KEPT && total <= KEPT)
+			{
+				// the file gets all of it, from the start
+				auto now = std::chrono::system_clock::now().time_since_epoch().count();
+				std::string name = (std::filesystem::temp_directory_path() /
+						    ("edit-input-" + std::to_string(now) + ".txt")).string();
+				spill = fopen(name.c_str(), "wb");
+				if (spill != NULL && fwrite(head.data(), 1, head.size(), spill) == head.size())
+					spill_path = name;
+				else
+					error = "The input is over " + std::to_string(KEPT >> 20) +
+						" MB and could not be kept in \"" + name + "\"; the rest was left out.";
+				std::string().swap(head);
+			}
+			if (total + n <= KEPT)
+				head.append(block.data(), n);
+			else if (spill != NULL && fwrite(block.data(), 1, n, spill) != (size_t)n)
+				error = "I/O error occurred while writing \"" + spill_path + "\".";
+			if (!error.empty() && spill != NULL)
+			{
+				fclose(spill);	// what is left is only read, to end the pipe
+				spill = NULL;
+			}
+			total += n;
+
+			std::lock_guard < std::mutex > guard(r->lock);
+			r->arrived.append(block.data(), shown);
+			r->spill_path = spill_path;
+		}
+
+		if (spill != NULL)
+			fclose(spill);
+		if (fd > 0)
+			::close(fd);
+
+		std::lock_guard < std::mutex > guard(r->lock);
+		r->error = error;
+		r->note = " The input ended after " + std::to_string(total) + " bytes.";
+		r->over = total > KEPT;
+		r->ended = true;
+	}
+
+	// Read what is appended to path from at on, until it is stopped, got
+	// shorter or went away
+	static void follow_file(std::shared_ptr < Reader > r, std::string path, unsigned long long at)
+	{
+		Memory::Scope memory(Memory::BUFFER);
+		int fd = ::open(path.c_str(), O_RDONLY | O_BINARY);
+		std::string error, note;
+		std::vector < char > block(FOLLOW_BLOCK);
+
+		if (fd < 0 || lseek(fd, at, SEEK_SET) < 0)
+			error = "Could not open \"" + path + "\" to follow it.";
+
+#if defined(__linux__)
+		int notify = fd < 0 ? -1 : inotify_init1(IN_CLOEXEC);
+		if (notify >= 0 && inotify_add_watch(notify, path.c_str(), IN_MODIFY | IN_ATTRIB | IN_MOVE_SELF |
+						     IN_DELETE_SELF) < 0)
+		{
+			::close(notify);
+			notify = -1;
+		}
+#endif
+
+		bool gone = false;	// moved or deleted: what is left is read
+		while (error.empty() && !r->stop)
+		{
+			ssize_t n = read(fd, block.data(), block.size());
+			if (n < 0 && errno == EINTR)
+				continue;
+			if (n < 0)
+			{
+				error = "I/O error occurred while reading \"" + path + "\".";
+				break;
+			}
+			if (n > 0)
+			{
+				at += n;
+				std::lock_guard < std::mutex > guard(r->lock);
+				r->arrived.append(block.data(), n);
+				continue;
+			}
+
+			// at its end
+			struct stat st;
+			if (fstat(fd, &st) == 0 && ((unsigned long long)st.st_size < at || st.st_nlink == 0))
+				gone = true;
+			if (gone)
+			{
+				note = " " + path + " was cut short, moved or deleted; following stopped.";
+				break;
+			}
+
+#if defined(__linux__)
+			if (notify >= 0)
+			{
+				struct pollfd wait = { notify, POLLIN, 0 };
+				if (poll(&wait, 1, FOLLOW_WAIT) > 0)
+				{
+					// many writes make many events; one read takes them
+					alignas(struct inotify_event) char events[4096];
+					ssize_t got = read(notify, events, sizeof(events));
+					for (ssize_t i = 0; i < got;)
+					{
+						const struct inotify_event *e = (const struct inotify_event *)(events + i);
+						gone |= (e->mask & (IN_MOVE_SELF | IN_DELETE_SELF)) != 0;
+						i += sizeof(struct inotify_event) + e->len;
+					}
+				}
+				continue;
+			}
+#endif
+			std::this_thread::sleep_for(std::chrono::milliseconds(FOLLOW_WAIT));
+		}
+
+#if defined(__linux__)
+		if (notify >= 0)
+			::close(notify);
+#endif
+		if (fd >= 0)
+			::close(fd);
+
+		std::lock_guard < std::mutex > guard(r->lock);
+		r->error = error;
+		r->note = note;
+		r->ended = true;
+	}
+
+	void open(const std::string & path)
+	{
+		close();
+		Registers::detach();
+		filebuf.clear();
+		filename = "";		// saving goes through Save As, not into the pipe
+		buffer_reset();
+
+		reader = std::make_shared < Reader > ();
+		spill_noted = false;
+		std::thread(read_all, reader, path).detach();
+	}
+
+	void follow(const std::string & path, unsigned long long from)
+	{
+		close();
+		filebuf.reserve(filebuf.size() + FOLLOW_ROOM);
+		reader = std::make_shared < Reader > ();
+		reader->follow = true;
+		std::thread(follow_file, reader, path, from).detach();
+	}
+
+	bool active()
+	{
+		return reader != NULL;
+	}
+
+	bool following()
+	{
+		return reader != NULL && reader->follow;
+	}
+
+	bool pending()
+	{
+		return taken_at < taken.size();
+	}
+
+	void take()
+	{
+		if (!reader)
+			return;
+		TRACE_SCOPE("Stream::take");
+
+		// the two strings trade places, so neither is made again
+		std::string spill_path, error, note;
+		bool over, ended;
+		{
+			std::lock_guard < std::mutex > guard(reader->lock);
+			if (!pending())
+			{
+				taken.clear();
+				taken_at = 0;
+				taken.swap(reader->arrived);
+			}
+			spill_path = reader->spill_path;
+			error = reader->error;
+			note = reader->note;
+			over = reader->over;
+			ended = reader->ended && taken_at + TAKE_MAX >= taken.size() && reader->arrived.empty();
+		}
+
+		// a burst goes in over a few frames, so none of them waits long
+		size_t n = std::min(TAKE_MAX, taken.size() - taken_at);
+		if (n > 0)
+			buffer_append(taken.data() + taken_at, n);
+		taken_at += n;
+
+		if (!spill_path.empty() && !spill_noted && !ended)
+		{
+			spill_noted = true;
+			status_note(" The input is over " + std::to_string(KEPT >> 20) + " MB; all of it goes to " +
+				    spill_path + ".");
+		}
+		if (!ended)
+			return;
+
+		reader.reset();
+		cut = over;
+		if (!error.empty())
+		{
+			show_err("Error whilest reading input!", error);
+			return;
+		}
+		if (!over)
+		{
+			if (!note.empty())
+				status_note(note);
+			return;
+		}
+
+		// all of it is in the file; what was changed in the start is
+		// only given up when asked
+		std::string answer;
+		if (docstats.modified &&
+		    (!prompt(" The input is in " + spill_path + "; open it over your changes? (y/n) ", answer) ||
+		     (answer != "y" && answer != "Y")))
+		{
+			status_note(" Kept your changes to the first " + std::to_string(KEPT >> 20) +
+				    " MB; all of the input is in " + spill_path + ".");
+			return;
+		}
+		if (open_file(spill_path))
+			status_note(" Opened " + spill_path + ", which holds all of the input.");
+	}
+
+	bool truncated()
+	{
+		return cut;
+	}
+
+	void close(bool replaced)
+	{
+		// input cut off while it arrived leaves only its start
+		if (reader)
+		{
+			reader->stop = true;
+			cut = cut || !reader->follow;
+		}
+		reader.reset();
+		std::string().swap(taken);
+		taken_at = 0;
+		if (replaced)
+			cut = false;
+	}
+}				// namespace Stream
@@ -28,186 +28,103 @@
 
 #include "edit.h"
 
-// Utility function to trim spaces from the start and end of a string
-std::string trim(const std::string & str)
+// Blanks between words; a newline is not one, it ends the paragraph
+static bool is_gap(char c)
 {
-	size_t start = str.find_first_not_of(" \t\n");
-	size_t end = str.find_last_not_of(" \t\n");
-	if (start == std::string::npos || end == std::string::npos)
-		return "";
-	return str.substr(start, end - start + 1);
+	return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
 }
 
-// Function to wrap the message into lines based on max_width, splitting by
-// words and preserving newlines
-bool wrap_message(std::string message, size_t max_width, std::vector < std::string > &wrapped_lines)
+WrappedText::WrappedText(std::string_view message, size_t width):text(message), cols(std::max < size_t > (width, 1))
 {
-	size_t start = 0;
-	size_t end = 0;
+}
 
-	// Split the message by newline characters, processing one segment at
-	// a
-	// time
-	while ((end = message.find('\n', start)) != std::string::npos)
+// Lay out one more row from where the last one ended, false at the end
+bool WrappedText::more()
+{
+	size_t n = text.size(), p = next;
+	while (p < n && is_gap(text[p]))
+		p++;
+	if (p >= n)
 	{
-		std::string line_segment = message.substr(start, end - start);	// Extract 
-										// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-
-		// each 
-		// segment 
-		// between 
-		// newlines
-		std::istringstream line_stream(line_segment);
-		std::string word;
-		std::string current_line;
-
-		// Process the words in the current segment
-		while (line_stream >> word)
-		{
-			word = trim(word);	// Trim any leading/trailing
-			// spaces in words
-
-			// Check if the word fits in the current line
-			if (current_line.empty())
-			{
-				current_line = word;	// First word in the
-				// line
-			}
-			else if (current_line.size() + 1 + word.size() <= max_width)
-			{
-				current_line += " " + word;	// Add word
-				// with space
-				// to the line
-			}
-			else
-			{
-				wrapped_lines.push_back(current_line);	// Add 
-									// 
-				// 
-				// 
-				// 
-				// 
-				// 
-				// 
-				// 
-				// 
-				// the 
-				// current
-				// line to wrapped
-				// lines
-				current_line = word;	// Start a new line
-				// with the current
-				// word
-			}
-		}
-
-		// Add any remaining text in the current line to wrapped lines
-		if (!current_line.empty())
-		{
-			wrapped_lines.push_back(current_line);
-		}
-
-		// Add an empty line to represent the newline in the input
-		// message
-		wrapped_lines.push_back("");	// This ensures a blank line
-		// where the 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// 
-		// '\n' was.
-
-		start = end + 1;	// Move to the next part of the
-		// message after
-		// the newline
+		next = n;
+		return false;
 	}
 
-	// Process any remaining text after the last newline
-	if (start < message.size())
+	// a newline leaves an empty row after its paragraph
+	if (text[p] == '\n')
 	{
-		std::string line_segment = message.substr(start);
-		std::istringstream line_stream(line_segment);
-		std::string word;
-		std::string current_line;
-
-		while (line_stream >> word)
-		{
-			word = trim(word);	// Trim any leading/trailing
-			// spaces in words
-
-			// Check if the word fits in the current line
-			if (current_line.empty())
-			{
-				current_line = word;	// First word in the
-				// line
-			}
-			else if (current_line.size() + 1 + word.size() <= max_width)
-			{
-				current_line += " " + word;	// Add word
-				// with space
-				// to the line
-			}
-			else
-			{
-				wrapped_lines.push_back(current_line);	// Add 
-									// 
-				// 
-				// 
-				// 
-				// 
-				// 
-				// 
-				// 
-				// 
-				// the 
-				// current
-				// line to wrapped
-				// lines
-				current_line = word;	// Start a new line
-				// with the current
-				// word
-			}
-		}
+		rows.push_back(std::make_pair(p, p));
+		next = p + 1;
+		return true;
+	}
 
-		// Add any remaining text in the current line to wrapped lines
-		if (!current_line.empty())
+	// as many words as fit, one space apart
+	size_t begin = p, end = p, used = 0;
+	while (p < n && text[p] != '\n')
+	{
+		size_t q = p;
+		while (q < n && !is_gap(text[q]) && text[q] != '\n')
+			q++;
+		if (used == 0 && q - p > cols)
 		{
-			wrapped_lines.push_back(current_line);
+			end = p = p + cols;	// a word wider than a row is cut
+			break;
 		}
+		if (used > 0 && used + 1 + (q - p) > cols)
+			break;
+		used += (used > 0) + (q - p);
+		end = p = q;
+		while (p < n && is_gap(text[p]))
+			p++;
 	}
+	rows.push_back(std::make_pair(begin, end));
+	next = p;
+	return true;
+}
 
+bool WrappedText::row(size_t i, std::string_view & out)
+{
+	while (rows.size() <= i && more())
+		;
+	if (i >= rows.size())
+		return false;
+	out = text.substr(rows[i].first, rows[i].second - rows[i].first);
 	return true;
 }
+
+size_t WrappedText::row_at(size_t offset)
+{
+	while ((rows.empty() || rows.back().first <= offset) && more())
+		;
+	auto it = std::upper_bound(rows.begin(), rows.end(), offset,[](size_t at, const std::pair < size_t, size_t > &r)
+				   {
+					   return at < r.first;
+				   });
+	return (it == rows.begin())? 0 : (it - rows.begin()) - 1;
+}
+
+size_t WrappedText::shown(std::string_view row, char *out)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < row.size(); i++)
+	{
+		if (!is_gap(row[i]))
+			out[n++] = row[i];
+		else if (n > 0 && !is_gap(row[i - 1]))
+			out[n++] = ' ';
+	}
+	return n;
+}
+
+AsciiFold::AsciiFold()
+{
+	for (int c = 0; c < 256; c++)
+		to[c] = (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c;
+}
+
+const AsciiFold ascii_fold;
+
+bool is_vcs_dir(const std::string & name)
+{
+	return name == ".git" || name == ".svn" || name == ".hg";
+}
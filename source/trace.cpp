@@ -0,0 +1,150 @@
+/* 
+   trace.cpp --- where the time goes, as Chrome trace events
+
+   Copyright 2024 Miles R. Chang
+
+   Permission is hereby granted, free of charge, to any person obtaining a
+   copy of this software and associated documentation files (the
+   “Software”), to deal in the Software without restriction, including
+   without limitation the rights to use, copy, modify, merge, publish,
+   distribute, sublicense, and/or sell copies of the Software, and to permit
+   persons to whom the Software is furnished to do so, subject to the
+   following conditions:
+
+   The above copyright notice and this permission notice shall be included in
+   all copies or substantial portions of the Software.
+
+   THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+   IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+   FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE 
+   AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+   LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING
+   FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER
+   DEALINGS IN THE SOFTWARE.
+
+   Except as contained in this notice, the name of Miles R. Chang shall not be 
+   used in advertising or otherwise to promote the sale, use or other dealings 
+   in this Software without prior written authorization from Miles R. Chang. */
+
+#include "edit.h"
+
+#if USE_TRACE
+
+#include <chrono>
+#include <mutex>
+
+namespace Trace
+{
+	static const size_t RING = 1 << 16;	// events kept per thread, the latest
+
+	// One thread's events. Only the thread that holds it writes, so
+	// recording takes no lock: the event goes in, then head moves past
+	// it. A thread that ends gives its ring to the next one to start.
+	struct Ring
+	{
+		Event events[RING];
+		  std::atomic < unsigned long long > head { 0 };
+	};
+
+	static std::mutex lock;	// over rings and spare, taken once a thread
+	static std::vector < Ring * >rings;
+	static std::vector < Ring * >spare;
+	static std::atomic < unsigned > threads { 0 };
+	static const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+
+	struct Holder
+	{
+		Ring *ring = NULL;
+		unsigned tid = ++threads;
+
+		Ring *take()
+		{
+			std::lock_guard < std::mutex > hold(lock);
+			if (spare.empty())
+			{
+				rings.push_back(new Ring);
+				spare.push_back(rings.back());
+			}
+			ring = spare.back();
+			spare.pop_back();
+			return ring;
+		}
+		~Holder()
+		{
+			if (ring == NULL)
+				return;
+			std::lock_guard < std::mutex > hold(lock);
+			spare.push_back(ring);
+		}
+	};
+
+	static thread_local Holder holder;
+
+	unsigned long long now()
+	{
+		return std::chrono::duration_cast < std::chrono::nanoseconds >
+			(std::chrono::steady_clock::now() - start).count();
+	}
+
+	void record(const char *name, unsigned long long begin, unsigned long long end)
+	{
+		Ring *ring = holder.ring ? holder.ring : holder.take();
+		unsigned long long head = ring->head.load(std::memory_order_relaxed);
+		Event & e = ring->events[head & (RING - 1)];
+		e.name = name;
+		e.begin = begin;
+		e.end = end;
+		e.tid = holder.tid;
+		ring->head.store(head + 1, std::memory_order_release);
+	}
+
+	// a ring's events as they are now; the thread may go on writing, so
+	// those it could have overwritten while they were copied are dropped
+	static void copy(Ring & ring, std::vector < Event > &out)
+	{
+		unsigned long long head = ring.head.load(std::memory_order_acquire);
+		unsigned long long from = (head > RING) ? head - RING : 0;
+		size_t first = out.size();
+		for (unsigned long long i = from; i < head; i++)
+			out.push_back(ring.events[i & (RING - 1)]);
+
+		unsigned long long after = ring.head.load(std::memory_order_acquire);
+		unsigned long long safe = (after + 1 > RING) ? after + 1 - RING : 0;
+		if (safe > from)
+			out.erase(out.begin() + first, out.begin() + first + std::min(safe - from, head - from));
+	}
+
+	bool dump(const std::string & path)
+	{
+		std::vector < Event > events;
+		{
+			std::lock_guard < std::mutex > hold(lock);
+			for (Ring * ring:rings)
+				copy(*ring, events);
+		}
+
+		std::string out = "{\"traceEvents\": [\n";
+		char line[256];
+		for (const Event & e:events)
+		{
+			snprintf(line, sizeof(line),
+				 "{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f},\n",
+				 e.name, e.tid, e.begin / 1000.0, (e.end - e.begin) / 1000.0);
+			out += line;
+		}
+		if (!events.empty())
+			out.erase(out.size() - 2, 1);	// the last comma
+		out += "], \"displayTimeUnit\": \"ms\"}\n";
+
+		try
+		{
+			return writefile(path, out);
+		}
+		catch(const std::runtime_error &)
+		{
+			return false;
+		}
+	}
+}				// namespace Trace
+
+#endif
@@ -31,6 +31,10 @@
 
 #include "edit.h"
 
+#include <chrono>
+#include <cstdio>
+#include <unistd.h>
+
 // extra getch macros
 #define CTRL(x) ((x) & 0x1f)
 // KEY_F(n) is already defined
@@ -44,7 +48,7 @@ WINDOW *menuBar = NULL;
 WINDOW *statusBar = NULL;
 
 // hidden overload
-void display_status(WINDOW * win, std::string message)
+void display_status(WINDOW * win, const char *message)
 {
 	werase(statusBar);
 
@@ -55,9 +59,9 @@ void display_status(WINDOW * win, std::string message)
 
 	int x = getmaxx(win);	// max legnth
 
-	for (int i = 0; i < x && i < (int)message.size(); i++)
+	for (int i = 0; i < x && message[i] != '\0'; i++)
 	{
-		mvwaddch(win, 0, i, message[i]);
+		mvwaddch(win, 0, i, (unsigned char)message[i]);
 	}
 
 	wrefresh(win);
@@ -65,12 +69,97 @@ void display_status(WINDOW * win, std::string message)
 
 void display_status(std::string message)
 {
-	display_status(statusBar, message);
+	display_status(statusBar, message.c_str());
+}
+
+char note[256] = "";		// one shot status message
+
+void status_note(const std::string & text)
+{
+	snprintf(note, sizeof(note), "%s", text.c_str());
+}
+
+// Read a line of text in the status bar, text holds the initial value
+bool prompt(const std::string & label, std::string & text)
+{
+	keypad(statusBar, true);
+	int prev = curs_set(1);
+
+	while (true)
+	{
+		werase(statusBar);
+#if HAVE_COLOR
+		if (console_color)
+			wbkgd(statusBar, COLOR_PAIR(COLOR_PAIR_MENU_BAR));
+#endif
+		// keep the end of a long text in view
+		int room = getmaxx(statusBar) - (int)label.size() - 1;
+		size_t skip = (room > 0 && text.size() > (size_t)room) ? text.size() - room : 0;
+
+		mvwprintw(statusBar, 0, 0, "%s%s", label.c_str(), text.c_str() + skip);
+		wrefresh(statusBar);
+
+		int ch = wgetch(statusBar);
+
+		if (ch == ERR || ch == 27)
+		{
+			curs_set(prev);
+			return false;
+		}
+		else if (ch == '\r' || ch == '\n')
+		{
+			curs_set(prev);
+			return true;
+		}
+		else if (ch == KEY_BACKSPACE || ch == 8 || ch == 127)
+		{
+			if (!text.empty())
+				text.pop_back();
+		}
+		else if (ch >= 32 && ch < 256 && ch != 127)
+		{
+			text += (char)ch;
+		}
+	}
+}
+
+// Run a job on a worker thread, showing label in the status bar until it
+// finishes. ESC raises the job's cancel flag; the job should check it now
+// and then. tick, if given, runs on this thread a few times a second to
+// show how the job is going. Returns false if the job was canceled.
+bool run_cancellable(const std::string & label, std::function < void (const std::atomic < bool > &) > job,
+		     std::function < void () > tick)
+{
+	std::atomic < bool > cancel(false);
+	std::atomic < bool > done(false);
+	std::thread worker([&]()
+			   {
+				   job(cancel);
+				   done = true;
+			   });
+
+	display_status(statusBar, (label + " Press ESC to cancel.").c_str());
+	keypad(statusBar, true);
+	wtimeout(statusBar, 50);
+	while (!done)
+	{
+		if (wgetch(statusBar) == 27)
+			cancel = true;
+		else if (tick)
+			tick();
+	}
+	wtimeout(statusBar, -1);
+
+	worker.join();
+	return !cancel;
 }
 
 void init_curs()
 {
-	initscr();
+	// with text coming down a pipe, keys come from the terminal
+	FILE *tty = isatty(0) ? NULL : fopen("/dev/tty", "r");
+	if (tty == NULL || newterm(NULL, stdout, tty) == NULL)
+		initscr();
 #if HAVE_COLOR
 
 #ifdef FORCE_COLOR_ON
@@ -90,6 +179,12 @@ void init_curs()
 
 		init_pair(COLOR_PAIR_MENU_BAR, COLOR_WHITE, COLOR_BLUE);
 		init_pair(COLOR_PAIR_MENU_PRESS, COLOR_BLACK, COLOR_WHITE);
+
+		init_pair(COLOR_PAIR_HL_KEYWORD, COLOR_YELLOW, COLOR_BLACK);
+		init_pair(COLOR_PAIR_HL_COMMENT, COLOR_CYAN, COLOR_BLACK);
+		init_pair(COLOR_PAIR_HL_STRING, COLOR_GREEN, COLOR_BLACK);
+		init_pair(COLOR_PAIR_HL_NUMBER, COLOR_MAGENTA, COLOR_BLACK);
+		init_pair(COLOR_PAIR_HL_PREPROC, COLOR_BLUE, COLOR_BLACK);
 	}
 #endif
 
@@ -120,29 +215,73 @@ void init_curs()
 // Display the buffer
 void display_buffer(WINDOW * win, std::string & buffer, size_t offset_x, size_t offset_y)
 {
+	TRACE_FUNCTION();
+	Memory::Scope memory(Memory::DISPLAY);
 	// Get the size of the window
 	int max_y, max_x;
 	getmaxyx(win, max_y, max_x);	// max_y is the number of rows, max_x
 	// is
 	// the number of columns
 
-	std::vector < std::string > split_buf;
+	size_t last = std::min(offset_y + max_y, buflines.count());
+	if (offset_y >= last)
+	{
+		wrefresh(win);
+		return;
+	}
+
+	// only the visible lines are lexed and colored
+	Highlight::prepare(last - 1);
 
-	extractLinesFromBuf(split_buf, buffer, offset_y, scr_max_y);
+	// Find All's matches, from the first one reaching the screen
+	std::lock_guard < std::mutex > guard(Search::hits_lock);
+	const auto & hits = Search::hits;
+	auto first_hit =[&](size_t at)
+	{
+		return std::lower_bound(hits.begin(), hits.end(), at,[](const std::pair < size_t, size_t > &hit, size_t at)
+					{
+						return hit.first + hit.second <= at;
+					}) - hits.begin();
+	};
 
+	size_t sel_from = 0, sel_to = 0;
+	selection(sel_from, sel_to);
+	Block::Rect block = { 1, 0, 0, 0 };	// no lines
+	block_selection(block);
 
-	// Loop through the buffer and display the content starting from the
-	// offset
-	for (size_t y = offset_y; y < split_buf.size() && y < offset_y + max_y; ++y)
+	// Loop through the visible lines, reading only their visible part
+	// straight out of the buffer, however long they are
+	for (size_t y = offset_y; y < last; ++y)
 	{
-		// For each line in the window, print the corresponding
-		// portion of the 
-		// buffer
-		std::string line = split_buf[y];
-		for (size_t x = offset_x; x < line.size() && x < offset_x + max_x; ++x)
+		size_t start = buflines.start(y);
+		const char *line = buffer.data() + start;
+		size_t len = buffer_line_length(y);
+		if (offset_x >= len)
+			continue;
+		size_t end = std::min(len, offset_x + max_x);
+		const unsigned char *cls = Highlight::colorize(y, line, len, offset_x, end);
+		size_t h = first_hit(start + offset_x);
+
+		for (size_t x = offset_x; x < end; ++x)
 		{
+			int attr = Highlight::attr(cls[x - offset_x]);
+
+			// the other matches are underlined, the current one
+			// stands out
+			while (h < hits.size() && hits[h].first + hits[h].second <= start + x)
+				h++;
+			if (h < hits.size() && hits[h].first <= start + x)
+				attr = A_UNDERLINE;
+			if (Search::match_len > 0 && start + x >= Search::match_pos
+			    && start + x < Search::match_pos + Search::match_len)
+				attr = A_REVERSE;
+			if (start + x >= sel_from && start + x < sel_to)
+				attr = A_REVERSE;
+			if (y >= block.first && y <= block.last && x >= block.left && x < block.right)
+				attr = A_REVERSE;
+
 			// Print each character
-			mvwaddch(win, y - offset_y, x - offset_x, line[x]);
+			mvwaddch(win, y - offset_y, x - offset_x, (unsigned char)line[x] | attr);
 		}
 	}
 
@@ -165,6 +304,9 @@ size_t cursor_x = 0;
 size_t cursor_y = 0;
 size_t offset_x = 0;
 size_t offset_y = 0;
+size_t selection_mark = std::string::npos;
+size_t mark_col = 0;
+bool block_select = false;
 
 void extrnal_refresh_ui()
 {
@@ -183,33 +325,867 @@ void extrnal_refresh_ui()
 	wrefresh(textArea);
 }
 
-bool mainloop()			// return false to quit
+size_t cursor_offset()
+{
+	return buffer_offset(cursor_y, cursor_x);
+}
+
+bool selection(size_t & from, size_t & to)
+{
+	if (selection_mark == std::string::npos || block_select)
+		return false;
+
+	size_t at = cursor_offset();
+	from = std::min(std::min(selection_mark, at), filebuf.size());
+	to = std::min(std::max(selection_mark, at), filebuf.size());
+	return from < to;
+}
+
+bool block_selection(Block::Rect & r)
+{
+	if (selection_mark == std::string::npos || !block_select)
+		return false;
+
+	size_t mark_line = buflines.line_of(std::min(selection_mark, filebuf.size()));
+	r.first = std::min(mark_line, cursor_y);
+	r.last = std::max(mark_line, cursor_y);
+	r.left = std::min(mark_col, cursor_x);
+	r.right = std::max(mark_col, cursor_x);
+	return true;
+}
+
+void jump_to(size_t offset)
 {
 	int max_y, max_x;
 	getmaxyx(textArea, max_y, max_x);
 
-	if (cursor_x - offset_x <= 2)
+	offset = std::min(offset, filebuf.size());
+	cursor_y = buflines.line_of(offset);
+	cursor_x = offset - buflines.start(cursor_y);
+
+	// center the cursor when it lands off screen
+	if (cursor_y < offset_y || cursor_y + 3 >= offset_y + max_y)
+		offset_y = (cursor_y > (size_t)max_y / 2) ? cursor_y - max_y / 2 : 0;
+	if (cursor_x < offset_x || cursor_x + 3 >= offset_x + max_x)
+		offset_x = (cursor_x > (size_t)max_x / 2) ? cursor_x - max_x / 2 : 0;
+}
+
+// Find the Search menu's query and move the cursor onto the match. The
+// search runs on a worker thread so a slow one can be canceled.
+bool find_and_jump(bool forward, size_t from)
+{
+	bool found = false;
+	std::string error;
+
+	auto search =[&](Progress & progress)
+	{
+		progress.total = filebuf.size();
+		try
+		{
+			found = Search::find(forward, from, &progress.cancel);
+		}
+		catch(std::runtime_error & r)
+		{
+			error = r.what();
+		}
+	};
+	auto tick =[](Progress & progress)
+	{
+		progress.done = Search::scanned.load();
+	};
+
+	bool finished = run_with_progress("Searching", search, tick);
+
+	if (!error.empty())
+		show_err("Search", error);
+	else if (!finished)
+		status_note(" Search canceled.");
+	else if (found)
+		jump_to(Search::match_pos);
+	else
+		status_note(" No match for \"" + Search::query + "\".");
+	return error.empty() && finished && found;
+}
+
+// Count every match of the query, and with keep, underline them all and
+// move to the first one after the cursor as soon as the scan reaches it.
+void find_all(bool keep)
+{
+	std::string error;
+	size_t cursor = cursor_offset();
+	bool jumped = false;
+
+	auto job =[&](const std::atomic < bool > &cancel)
+	{
+		try
+		{
+			Search::find_all(keep, &cancel);
+		}
+		catch(std::runtime_error & r)
+		{
+			error = r.what();
+		}
+	};
+
+	// land on a match, returns false if there is none to land on yet
+	auto land =[&](bool wrap)
+	{
+		std::unique_lock < std::mutex > guard(Search::hits_lock);
+		const auto & hits = Search::hits;
+		auto it = std::lower_bound(hits.begin(), hits.end(), std::make_pair(cursor, (size_t)0));
+		if (it == hits.end() && wrap && !hits.empty())
+			it = hits.begin();
+		if (it == hits.end())
+			return false;
+
+		Search::match_pos = it->first;
+		Search::match_len = it->second;
+		guard.unlock();
+		jump_to(Search::match_pos);
+		return true;
+	};
+
+	auto tick =[&]()
+	{
+		if (keep && !jumped && land(false))
+		{
+			jumped = true;
+			werase(textArea);
+			display_buffer(textArea, filebuf, offset_x, offset_y);
+		}
+		char text[128];
+		snprintf(text, sizeof(text), " %s... %zu so far. Press ESC to cancel.", keep ? "Finding" : "Counting",
+			 Search::counted.load());
+		display_status(statusBar, text);
+	};
+
+	bool finished = run_cancellable(keep ? " Finding..." : " Counting...", job, tick);
+
+	if (!error.empty())
+	{
+		show_err("Search", error);
+		return;
+	}
+	if (keep && !jumped)
+		land(true);
+
+	size_t n = Search::counted;
+	if (!finished)
+		status_note(" Stopped after " + std::to_string(n) + " matches.");
+	else
+		status_note(" " + std::to_string(n) + (n == 1 ? " match" : " matches") + " for \"" + Search::query +
+			    "\".");
+}
+
+// Search as the query is typed in the status bar, from the cursor. Enter
+// stays on the match, ESC goes back to where the search began.
+void incremental_find()
+{
+	typedef Search::Incremental Inc;
+
+	size_t saved_x = cursor_x, saved_y = cursor_y;
+	size_t saved_offset_x = offset_x, saved_offset_y = offset_y;
+	auto restore =[&]()
+	{
+		cursor_x = saved_x;
+		cursor_y = saved_y;
+		offset_x = saved_offset_x;
+		offset_y = saved_offset_y;
+	};
+
+	Inc inc(filebuf, cursor_offset(), !Search::match_case);
+	std::string text;
+	Inc::State state = Inc::NONE;
+	std::vector < std::pair < size_t, size_t > > seen;
+
+	// move to the match and underline the others on screen; only the
+	// screen is searched for them, at most a megabyte of it
+	auto show =[&]()
 	{
-		if (offset_x - 1 < offset_x)	// underflow protection
-			offset_x--;
+		if (state == Inc::FOUND)
+		{
+			Search::match_pos = inc.match();
+			Search::match_len = text.size();
+			jump_to(Search::match_pos);
+		}
+		else
+		{
+			Search::match_len = 0;
+			restore();
+		}
+
+		size_t last = std::min(offset_y + getmaxy(textArea), buflines.count());
+		size_t lo = buflines.start(offset_y);
+		size_t hi = (last < buflines.count()) ? buflines.start(last) : filebuf.size();
+		inc.visible(lo, std::min(hi, lo + (1 << 20)), seen);
+		{
+			std::lock_guard < std::mutex > guard(Search::hits_lock);
+			Search::hits = seen;
+		}
+
+		werase(textArea);
+		display_buffer(textArea, filebuf, offset_x, offset_y);
+	};
+
+	keypad(statusBar, true);
+	int prev = curs_set(1);
+	wtimeout(statusBar, 30);
+
+	while (true)
+	{
+		std::string label = " I-search: " + text;
+		size_t n = inc.count();
+		if (!text.empty() && state == Inc::PENDING)
+			label += "  [searching]";
+		else if (!text.empty() && state == Inc::NONE)
+			label += "  [no match]";
+		else if (!text.empty() && n != std::string::npos)
+			label += "  [" + std::to_string(n) + (n == 1 ? " match]" : " matches]");
+		display_status(statusBar, label.c_str());
+		wmove(statusBar, 0, std::min((int)(11 + text.size()), getmaxx(statusBar) - 1));
+		wrefresh(statusBar);
+
+		int ch = wgetch(statusBar);
+		if (ch == ERR)	// nothing typed, see what the threads found
+		{
+			Inc::State now = inc.poll();
+			if (now != state)
+			{
+				state = now;
+				show();
+			}
+			continue;
+		}
+
+		if (ch == 27)
+		{
+			text.clear();
+			state = Inc::NONE;
+			show();
+			break;
+		}
+		else if (ch == '\r' || ch == '\n')
+		{
+			if (!text.empty())
+			{
+				Search::query = text;
+				Search::use_regex = false;
+			}
+			break;
+		}
+		else if (ch == KEY_BACKSPACE || ch == 8 || ch == 127)
+		{
+			if (text.empty())
+				continue;
+			text.pop_back();
+		}
+		else if (ch >= 32 && ch < 256)
+			text += (char)ch;
+		else
+			continue;
+
+		state = inc.update(text);
+		show();
 	}
-	else if ((int)(cursor_x - offset_x) >= max_x - 2)
+
+	wtimeout(statusBar, -1);
+	curs_set(prev);
+	std::lock_guard < std::mutex > guard(Search::hits_lock);
+	Search::hits.clear();
+}
+
+// Replace every match of the query from from on with text. The matches
+// are all found first, then the buffer is rebuilt once, so this is one
+// undo step. Returns the count, or npos if it was canceled or failed.
+size_t replace_all(const std::string & text, size_t from)
+{
+	std::vector < size_t > at, lens;
+	std::atomic < size_t > found(0);
+	std::string error;
+
+	auto job =[&](const std::atomic < bool > &cancel)
 	{
-		if (offset_x + 1 > offset_x)	// overflow protection
-			offset_x++;
+		try
+		{
+			Search::matches(from,[&](size_t pos, size_t len)
+					{
+						// like sed, no empty match straight after
+						// a match
+						if (len == 0 && !at.empty() && pos == at.back() + lens.back())
+							return true;
+						at.push_back(pos);
+						lens.push_back(len);
+						found++;
+						return true;
+					}, &cancel);
+		}
+		catch(std::runtime_error & r)
+		{
+			error = r.what();
+		}
+	};
+
+	auto tick =[&]()
+	{
+		char text[128];
+		snprintf(text, sizeof(text), " Finding matches... %zu so far. Press ESC to cancel.", found.load());
+		display_status(statusBar, text);
+	};
+
+	bool finished = run_cancellable(" Finding matches...", job, tick);
+
+	if (!error.empty())
+	{
+		show_err("Replace", error);
+		return std::string::npos;
+	}
+	if (!finished)
+	{
+		status_note(" Replace canceled, nothing was changed.");
+		return std::string::npos;
 	}
 
-	if (cursor_y - offset_y <= 2)
+	display_status(" Replacing " + std::to_string(at.size()) + " matches...");
+	try
 	{
-		if (offset_y - 1 < offset_y)	// underflow protection
-			offset_y--;
+		buffer_replace(at, lens, text);
 	}
-	else if ((int)(cursor_y - offset_y) >= max_y - 2)
+	catch(std::runtime_error & r)
 	{
-		if (offset_y + 1 > offset_y)	// overflow protection
-			offset_y++;
+		show_err("Replace", r.what());
+		return std::string::npos;
+	}
+
+	// the text under the cursor may have moved, stay on a real line
+	cursor_y = std::min(cursor_y, buflines.count() - 1);
+	cursor_x = std::min(cursor_x, buffer_line_length(cursor_y));
+
+	status_note(" Replaced " + std::to_string(at.size()) + (at.size() == 1 ? " match" : " matches") +
+		    " of \"" + Search::query + "\".");
+	return at.size();
+}
+
+// Step through the matches after the cursor asking about each one: y
+// replaces it, n skips it, a replaces it and all the rest, ESC stops.
+// Every replacement is its own undo step but the last a.
+void query_replace(const std::string & text)
+{
+	size_t from = cursor_offset();
+	size_t count = 0;
+
+	while (find_and_jump(true, from))
+	{
+		size_t pos = Search::match_pos, len = Search::match_len;
+		if (pos < from)	// wrapped around, that is all of them
+		{
+			Search::forget();
+			jump_to(from);
+			break;
+		}
+
+		werase(textArea);
+		display_buffer(textArea, filebuf, offset_x, offset_y);
+		wrefresh(textArea);
+		display_status(" Replace this match? (y)es, (n)o, (a)ll the rest, ESC to stop");
+
+		int ch = wgetch(statusBar);
+		if (ch == 'y' || ch == 'Y')
+		{
+			buffer_replace(std::vector < size_t > { pos }, std::vector < size_t > { len }, text);
+			count++;
+			from = pos + text.size() + (len == 0 && text.empty());
+			jump_to(pos + text.size());
+		}
+		else if (ch == 'n' || ch == 'N')
+			from = pos + std::max < size_t > (len, 1);
+		else if (ch == 'a' || ch == 'A')
+		{
+			size_t rest = replace_all(text, pos);
+			if (rest == std::string::npos)
+				return;	// said why already
+			count += rest;
+			break;
+		}
+		else
+		{
+			Search::forget();
+			break;
+		}
 	}
 
+	status_note(" Replaced " + std::to_string(count) + (count == 1 ? " match" : " matches") + " of \"" +
+		    Search::query + "\".");
+}
+
+// Find in Files: asks for the query and where to look, then lists the hits
+// as they come in. Enter opens a hit at its line; ESC stops the search,
+// and once it has stopped, closes the list.
+void find_in_files()
+{
+	std::string text = Search::query;
+	std::string dir = ".";
+	if (!prompt(Search::use_regex ? " Find regex in files: " : " Find in files: ", text) || text.empty() ||
+	    !prompt(" In directory: ", dir))
+		return;
+	Search::query = text;
+
+	std::unique_ptr < Search::FileSearch > search;
+	try
+	{
+		search.reset(new Search::FileSearch(dir, text, !Search::match_case, Search::use_regex));
+	}
+	catch(std::runtime_error & r)
+	{
+		show_err("Find in Files", r.what());
+		return;
+	}
+
+	WINDOW *win = newwin(scr_max_y - 2, scr_max_x, 1, 0);
+	if (win == NULL)
+	{
+		show_err("Could not create window.", "The list of hits cannot be shown.");
+		return;
+	}
+	keypad(win, true);
+	wtimeout(win, 100);	// redraw as hits come in
+	int prev = curs_set(0);
+
+	size_t selected = 0, top = 0;
+	bool open = false;
+	Search::FileHit chosen;
+
+	while (true)
+	{
+		int rows, cols;
+		getmaxyx(win, rows, cols);
+		size_t visible = rows > 3 ? rows - 3 : 1;
+		size_t n = search->count();
+
+		if (selected >= top + visible)
+			top = selected - visible + 1;
+		if (selected < top)
+			top = selected;
+
+		werase(win);
+		box(win, 0, 0);
+		mvwprintw(win, 0, (cols - 15) / 2, " Find in Files ");
+
+		char summary[200];
+		std::string split = search->split_lines() == 0 ? "" :
+			", " + std::to_string(search->split_lines()) + " long lines searched in parts";
+		snprintf(summary, sizeof(summary), "%zu hits in %zu files (%zu binary skipped%s)%s", n, search->files(),
+			 search->binary_files(), split.c_str(), search->truncated() ? ", stopped at the limit" :
+			 search->running() ? ", searching..." : "");
+		mvwaddnstr(win, 1, 1, summary, cols - 2);
+
+		for (size_t i = top; i < std::min(n, top + visible); i++)
+		{
+			Search::FileHit hit = search->hit(i);
+			std::string row = hit.path + ":" + std::to_string(hit.line) + ": " + hit.text;
+			for (char &c:row)
+			{
+				if ((unsigned char)c < ' ')
+					c = ' ';	// tabs and CRs would break the row
+			}
+			if (i == selected)
+				wattron(win, A_REVERSE);
+			mvwaddnstr(win, i - top + 2, 1, row.c_str(), cols - 2);
+			if (i == selected)
+				wattroff(win, A_REVERSE);
+		}
+		wrefresh(win);
+		display_status(search->running()? " ENTER -> open; UP, DOWN, PGUP, PGDN -> navigation; ESC -> stop searching" :
+			       " ENTER -> open; UP, DOWN, PGUP, PGDN -> navigation; ESC -> close");
+
+		int ch = wgetch(win);
+		if (ch == KEY_UP && selected > 0)
+			selected--;
+		else if (ch == KEY_DOWN && selected + 1 < n)
+			selected++;
+		else if (ch == KEY_PPAGE)
+			selected -= std::min(selected, visible);
+		else if (ch == KEY_NPAGE && n > 0)
+			selected = std::min(n - 1, selected + visible);
+		else if ((ch == '\r' || ch == '\n') && n > 0)
+		{
+			chosen = search->hit(selected);
+			open = true;
+			break;
+		}
+		else if (ch == 27 || ch == 'q')
+		{
+			if (!search->running())
+				break;
+			search->stop();
+		}
+	}
+
+	search.reset();
+	wtimeout(win, -1);
+	delwin(win);
+	curs_set(prev);
+
+	if (!open)
+		return;
+
+	if (!open_file(chosen.path))
+		return;
+
+	// the hit was the first match on its line
+	find_and_jump(true, buffer_offset(chosen.line - 1, chosen.column));
+}
+
+// Kept for the session: reopening shows the last index at once while a
+// walk brings it up to date
+static std::unique_ptr < QuickOpen::Index > quick_index;
+
+void quick_open()
+{
+	if (!quick_index || !quick_index->walking())
+		quick_index.reset(new QuickOpen::Index("."));
+
+	WINDOW *win = newwin(scr_max_y - 2, scr_max_x, 1, 0);
+	if (win == NULL)
+	{
+		show_err("Could not create window.", "The files cannot be shown.");
+		return;
+	}
+	keypad(win, true);
+	int prev = curs_set(1);
+
+	QuickOpen::Finder finder;
+	QuickOpen::Segments segments;
+	std::vector < QuickOpen::Result > results;
+	std::string query, searched_for;
+	unsigned long long generation = ~0ull;
+	size_t matched = 0, files = 0, selected = 0, top = 0;
+	double took_ms = 0;
+	std::string chosen;
+	bool searched = false;
+
+	while (true)
+	{
+		int rows, cols;
+		getmaxyx(win, rows, cols);
+		size_t visible = rows > 4 ? rows - 4 : 1;
+
+		// search again when the query or the index changed
+		QuickOpen::Segments now = quick_index->segments();
+		unsigned long long gen = quick_index->generation();
+		if (!searched || query != searched_for || gen != generation || now.size() != segments.size())
+		{
+			segments = now;
+			generation = gen;
+			files = 0;
+		      for (const auto & seg:segments)
+				files += seg->files.size();
+
+			auto start = std::chrono::steady_clock::now();
+			matched = finder.search(segments, generation, query, std::max < size_t > (visible, 100), results);
+			took_ms = std::chrono::duration < double, std::milli > (std::chrono::steady_clock::now() - start).count();
+			if (query != searched_for)
+				selected = top = 0;
+			searched_for = query;
+			searched = true;
+		}
+		selected = std::min(selected, results.empty()? 0 : results.size() - 1);
+		if (selected >= top + visible)
+			top = selected - visible + 1;
+		if (selected < top)
+			top = selected;
+
+		werase(win);
+		box(win, 0, 0);
+		mvwprintw(win, 0, (cols - 12) / 2, " Quick Open ");
+
+		char summary[160];
+		snprintf(summary, sizeof(summary), "%zu of %zu files (%.1f ms)%s", matched, files, took_ms,
+			 quick_index->walking()? ", indexing..." : "");
+		mvwaddnstr(win, 2, 1, summary, cols - 2);
+
+		for (size_t i = top; i < std::min(results.size(), top + visible); i++)
+		{
+			std::string row = QuickOpen::path(segments, results[i]);
+			if (i == selected)
+				wattron(win, A_REVERSE);
+			mvwaddnstr(win, i - top + 3, 1, row.c_str(), cols - 2);
+			if (i == selected)
+				wattroff(win, A_REVERSE);
+		}
+		mvwprintw(win, 1, 1, "> ");
+		waddnstr(win, query.c_str(), cols - 4);
+		wrefresh(win);
+		display_status(" ENTER -> open; UP, DOWN, PGUP, PGDN -> navigation; type to match; ESC -> close");
+
+		// while indexing, come back now and then for what it found
+		wtimeout(win, quick_index->walking()? 200 : -1);
+		int ch = wgetch(win);
+		bool done = false;
+
+		// keys typed while the last search ran are taken together, so a
+		// slow search is not run for every one of them
+		while (ch != ERR && !done)
+		{
+			if (ch == KEY_UP && selected > 0)
+				selected--;
+			else if (ch == KEY_DOWN)
+				selected++;
+			else if (ch == KEY_PPAGE)
+				selected -= std::min(selected, visible);
+			else if (ch == KEY_NPAGE)
+				selected += visible;
+			else if (ch == '\r' || ch == '\n')
+			{
+				if (selected < results.size())
+					chosen = QuickOpen::path(segments, results[selected]);
+				done = true;
+			}
+			else if (ch == 27)
+				done = true;
+			else if (ch == KEY_BACKSPACE || ch == 8 || ch == 127)
+			{
+				if (!query.empty())
+					query.pop_back();
+			}
+			else if (ch >= ' ' && ch < 256)
+				query += (char)ch;
+
+			wtimeout(win, 0);
+			ch = done ? ERR : wgetch(win);
+		}
+		if (done)
+			break;
+	}
+
+	wtimeout(win, -1);
+	delwin(win);
+	curs_set(prev);
+
+	if (chosen.empty())
+		return;
+
+	open_file(chosen);
+}
+
+// Ask for a line, and a column after a colon, and put the cursor there; a
+// column past the end of a long line is its end
+void go_to()
+{
+	char current[48];
+	snprintf(current, sizeof(current), "%llu:%llu", (unsigned long long)cursor_y + 1,
+		 (unsigned long long)cursor_x + 1);
+	std::string text = current;
+	if (!prompt(" Go to line:column: ", text) || text.empty())
+		return;
+
+	unsigned long long line = 0, col = 1;
+	if (sscanf(text.c_str(), "%llu:%llu", &line, &col) < 1 || line == 0 || col == 0)
+	{
+		status_note(" Give a line, and a column after a colon, both from 1.");
+		return;
+	}
+	line = std::min < unsigned long long >(line, buflines.count());
+	jump_to(buffer_offset(line - 1, col - 1));
+}
+
+bool open_file(const std::string & path)
+{
+	bool loaded = false;
+	std::string error;
+	run_with_progress("Opening " + std::filesystem::path(path).filename().string(),[&](Progress & progress)
+			  {
+				  try
+				  {
+					  loaded = buffer_load(path, &progress);
+				  }
+				  catch(const std::runtime_error & ex)
+				  {
+					  error = ex.what();
+				  }
+			  });
+
+	if (!error.empty())
+		show_err("Error whilest reading file!", error);
+	else if (!loaded)
+		status_note(" Opening " + path + " canceled.");
+	else
+		jump_to(0);
+	return loaded;
+}
+
+bool save_file()
+{
+	// a file written from this would lose the rest of the input for good
+	if (Stream::truncated())
+	{
+		std::string answer;
+		if (!prompt(" This holds only the start of the input; save it anyway? (y/n) ", answer) ||
+		    (answer != "y" && answer != "Y"))
+		{
+			status_note(" Not saved.");
+			return false;
+		}
+	}
+
+	// what changed on disk since would be lost without a word
+	if (Disk::stale() || Disk::touched(filename))
+	{
+		std::string answer;
+		if (!prompt(" " + filename + " changed on disk since it was read; overwrite it? (y/n) ", answer) ||
+		    (answer != "y" && answer != "Y"))
+		{
+			status_note(" Not saved.");
+			return false;
+		}
+	}
+
+	bool saved = false;
+	std::string error;
+	run_with_progress("Saving " + std::filesystem::path(filename).filename().string(),[&](Progress & progress)
+			  {
+				  try
+				  {
+					  saved = writefile(filename, filebuf, &progress);
+				  }
+				  catch(const std::runtime_error & ex)
+				  {
+					  error = ex.what();
+				  }
+			  });
+
+	if (!error.empty())
+		show_err("Error whilest writing file!", error);
+	else if (!saved)
+		status_note(" Saving canceled, the file was left as it was.");
+	else
+	{
+		docstats.modified = false;
+		LineCache::keep(filename, filebuf, buflines, docstats);
+		Disk::remember(filename, filebuf);
+	}
+	return saved;
+}
+
+void toggle_follow()
+{
+	if (Stream::following())
+	{
+		Stream::close();
+		status_note(" Stopped following " + filename + ".");
+		return;
+	}
+	if (Stream::active())
+		status_note(" The input is still being read.");
+	else if (filename.empty())
+		status_note(" Open a file to follow it.");
+	else if (docstats.modified)
+		status_note(" Save the changes first; following adds to the file as it was read.");
+	else
+	{
+		// what was read is what it had up to here
+		Stream::follow(filename, filebuf.size());
+		jump_to(buflines.start(buflines.count() - 1));
+		status_note(" Following " + filename + "; Ctrl-T stops.");
+	}
+}
+
+// Once a second, see whether the file changed on disk; when it did, take
+// in the lines that differ, as one undo step, so the cursor and the view
+// stay on the text they were on. Changes of the buffer's own are kept
+// unless the user says otherwise.
+static void check_disk()
+{
+	TRACE_FUNCTION();
+	static std::chrono::steady_clock::time_point last;
+	std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+	if (filename.empty() || Stream::active() || now - last < std::chrono::seconds(1))
+		return;
+	last = now;
+	if (!Disk::touched(filename))
+		return;
+
+	std::error_code ec;
+	if (!std::filesystem::exists(filename, ec))
+	{
+		Disk::remember(filename, filebuf);	// said once; saving writes it again
+		status_note(" " + filename + " was removed from disk.");
+		return;
+	}
+
+	std::string text, error;
+	bool changed = false;
+	bool done = run_with_progress("Reading " + std::filesystem::path(filename).filename().string(),[&](Progress & progress)
+				      {
+					      try
+					      {
+						      changed = Disk::changed(filename, text, &progress);
+					      }
+					      catch(const std::runtime_error & ex)
+					      {
+						      error = ex.what();
+					      }
+				      });
+	if (!done || !error.empty())
+	{
+		Disk::ignore(filename);
+		status_note(" " + filename + " changed on disk but was not read again" +
+			    (error.empty()? std::string(".") : ": " + error));
+		return;
+	}
+	if (!changed)
+		return;
+
+	if (docstats.modified)
+	{
+		std::string answer;
+		if (!prompt(" " + filename + " changed on disk; reload it over your changes? (y/n) ", answer) ||
+		    (answer != "y" && answer != "Y"))
+		{
+			Disk::ignore(filename);
+			status_note(" Kept your changes; saving asks before overwriting the file.");
+			return;
+		}
+	}
+
+	std::vector < size_t > at, lens, sizes;
+	std::string texts;
+	Disk::diff(filebuf, text, at, lens, texts, sizes);
+
+	// where an offset ends up: past a piece it moves by what the piece
+	// grew, in one it stays as far in as the new text reaches
+	auto map =[&](size_t offset)
+	{
+		long long moved = 0;
+		for (size_t i = 0; i < at.size() && at[i] <= offset; i++)
+		{
+			if (offset < at[i] + lens[i])
+				return (size_t)(at[i] + moved + std::min(offset - at[i], sizes[i]));
+			moved += (long long)sizes[i] - (long long)lens[i];
+		}
+		return (size_t)(offset + moved);
+	};
+	size_t cursor = map(cursor_offset());
+	size_t top = map(buflines.start(std::min(offset_y, buflines.count() - 1)));
+	if (selection_mark != std::string::npos)
+		selection_mark = map(std::min(selection_mark, filebuf.size()));
+
+	if (!at.empty())
+		buffer_replace(at, lens, texts, sizes);
+	docstats.modified = false;
+	Disk::remember(filename, filebuf);
+
+	offset_y = buflines.line_of(top);
+	jump_to(cursor);
+	status_note(" " + filename + " changed on disk and was reloaded; " + std::to_string(at.size()) +
+		    (at.size() == 1 ? " place" : " places") + " changed, Undo takes it back.");
+}
+
+// Draw the menu bar, the text and the status bar as they are now; false if
+// the text could not be shown
+bool draw_frame()
+{
+	Frame::reset();		// the last frame's is shown
+
 	werase(menuBar);
 	werase(textArea);
 	werase(statusBar);
@@ -225,21 +1201,70 @@ bool mainloop()			// return false to quit
 		show_fatal("Failed to display buffer", r.what());
 		return false;
 	}
-	display_status(statusBar,
-		       (std::string) " Ln " + std::to_string(cursor_y + 1) +
-		       ", Col " + std::to_string(cursor_x + 1) +
-		       " | length: " + std::to_string(filebuf.size()) + " | Press ESC to access to menu bar.");
+	// formatted into the frame's arena, however wide the screen is
+	const char *status =
+		Frame::format(" Ln %llu/%llu, Col %llu | byte %llu of %llu | %llu words, %llu chars%s%s%s | Press ESC to access to menu bar.",
+			      (unsigned long long)cursor_y + 1, (unsigned long long)buflines.count(),
+			      (unsigned long long)cursor_x + 1, (unsigned long long)buffer_offset(cursor_y, cursor_x),
+			      (unsigned long long)filebuf.size(), (unsigned long long)docstats.words,
+			      (unsigned long long)docstats.chars, docstats.modified ? " | modified" : "",
+			      Stream::truncated()? " | truncated" : "",
+			      Stream::following()? " | following" : Stream::active()? " | reading" : "");
+	display_status(statusBar, note[0] != '\0' ? note : status);
+	note[0] = '\0';
 
 	keypad(textArea, true);
 
 	wrefresh(menuBar);
 	wrefresh(textArea);
 	wrefresh(statusBar);
+	return true;
+}
+
+bool mainloop()			// return false to quit
+{
+	TRACE_FUNCTION();
+	Memory::frame();
+	int max_y, max_x;
+	getmaxyx(textArea, max_y, max_x);
+
+	// shown as it arrives; a followed file keeps the bottom in view when
+	// the cursor was there
+	size_t lines = buflines.count();
+	bool at_bottom = cursor_y + 1 >= lines;
+	Stream::take();
+	check_disk();
+	if (Stream::following() && at_bottom && buflines.count() != lines)
+		jump_to(buflines.start(buflines.count() - 1));
 
+	// keep the cursor off the edges however far it went, a column a time
+	// when it moves a column
+	if (cursor_x < offset_x + 3)
+		offset_x = (cursor_x > 3) ? cursor_x - 3 : 0;
+	else if (cursor_x + 2 >= offset_x + max_x)
+		offset_x = cursor_x + 3 - max_x;
+
+	if (cursor_y - offset_y <= 2)
+	{
+		if (offset_y - 1 < offset_y)	// underflow protection
+			offset_y--;
+	}
+	else if ((int)(cursor_y - offset_y) >= max_y - 2)
+	{
+		if (offset_y + 1 > offset_y)	// overflow protection
+			offset_y++;
+	}
+
+	if (!draw_frame())
+		return false;
 
 	curs_set(1);		// set on anyway.
+	// to show what arrives, and to look at the file on disk now and then
+	wtimeout(textArea, Stream::pending()? 0 : Stream::active()? 100 : filename.empty()? -1 : 1000);
 	int ch = mvwgetch(textArea, cursor_y - offset_y, cursor_x - offset_x);
 
+	if (ch == ERR && (Stream::active() || !filename.empty()))
+		return true;
 	if (ch == ERR)
 	{
 		return !show_fatal("ERR received as an input",
@@ -256,29 +1281,102 @@ bool mainloop()			// return false to quit
 		return menu_interact(menuBar, filename);
 	}
 
+	if (ch == CTRL('B'))	// block selection on or off
+	{
+		block_select = !block_select;
+		status_note(block_select ? " Block selection: Shift and the arrows now select columns." :
+			    " Block selection off.");
+		return true;
+	}
+
+	// shift and an arrow select from where the cursor was; anything else
+	// but the menu ends the selection
+	bool erasing = (ch == 8 || ch == 127 || ch == 7 || ch == CTRL('G') || ch == 263);
+	Block::Rect r;
+	if (ch == KEY_SLEFT || ch == KEY_SRIGHT || ch == KEY_SR || ch == KEY_SF)
+	{
+		if (selection_mark == std::string::npos)
+		{
+			selection_mark = cursor_offset();
+			mark_col = cursor_x;
+		}
+		ch = (ch == KEY_SLEFT) ? KEY_LEFT : (ch == KEY_SRIGHT) ? KEY_RIGHT : (ch == KEY_SR) ? KEY_UP : KEY_DOWN;
+
+		if (block_select)	// a block keeps its columns past short lines
+		{
+			if (ch == KEY_LEFT && cursor_x > 0)
+				cursor_x--;
+			else if (ch == KEY_RIGHT)
+				cursor_x++;
+			else if (ch == KEY_UP && cursor_y > 0)
+				cursor_y--;
+			else if (ch == KEY_DOWN && cursor_y + 1 < buflines.count())
+				cursor_y++;
+			return true;
+		}
+	}
+	else if (block_selection(r) && (erasing || (ch >= 32 && ch < 256 && ch != 127)))
+	{
+		// typing goes to every line of the block, in one pass and one
+		// undo step; afterwards the block is a column to go on typing in
+		size_t mark_line = (r.first == cursor_y) ? r.last : r.first;
+		size_t col = r.left;
+		try
+		{
+			if (!erasing)
+			{
+				Block::type(r, std::string(1, (char)ch));
+				col++;
+			}
+			else if (r.left < r.right)
+				Block::erase(r);
+			else if (r.left > 0)
+			{
+				r.left--;
+				Block::erase(r);
+				col--;
+			}
+		}
+		catch(std::runtime_error & ex)
+		{
+			show_err("Failed to edit the block", ex.what());
+		}
+		selection_mark = buflines.start(mark_line);
+		mark_col = cursor_x = col;
+		return true;
+	}
+	else
+	{
+		size_t from, to;
+		bool selected = selection(from, to);
+		selection_mark = std::string::npos;
+		cursor_x = std::min(cursor_x, buffer_line_length(cursor_y));	// a block may have left it past the end
+
+		if (selected && erasing)
+		{
+			buffer_erase(from, to - from);
+			jump_to(from);
+			return true;
+		}
+	}
+
 	// add editor logic
 	if (ch == KEY_UP)
 	{
 		if (cursor_y > 0)
 		{
 			cursor_y--;
-			std::string s;
-			extractSingleLineFromBuf(s, filebuf, cursor_y);
-			if (cursor_x >= s.size() - 1)
-				cursor_x = s.size() - 1;
+			cursor_x = std::min(cursor_x, buffer_line_length(cursor_y));
 		}
 		return true;
 	}
 	if (ch == KEY_DOWN)
 	{
-		cursor_y++;
-		std::string s;
-		bool res = extractSingleLineFromBuf(s, filebuf, cursor_y + 1);
-		
-		if (!res)	// on no such line,
-			cursor_y--;
-		else if (cursor_x >= s.size() - 1)
-			cursor_x = s.size() - 1;
+		if (cursor_y + 1 < buflines.count())	// on no such line, stay
+		{
+			cursor_y++;
+			cursor_x = std::min(cursor_x, buffer_line_length(cursor_y));
+		}
 		return true;
 	}
 	if (ch == KEY_LEFT)
@@ -289,13 +1387,67 @@ bool mainloop()			// return false to quit
 	}
 	if (ch == KEY_RIGHT)
 	{
-		std::string s;
-		extractSingleLineFromBuf(s, filebuf, cursor_y);
-		
-		if (cursor_x < s.size())
+		if (cursor_x < buffer_line_length(cursor_y))
 			cursor_x++;
 		return true;
 	}
+	if (ch == KEY_HOME)
+	{
+		cursor_x = 0;
+		return true;
+	}
+	if (ch == KEY_END)
+	{
+		cursor_x = buffer_line_length(cursor_y);
+		return true;
+	}
+	if (ch == CTRL('L'))	// go to a line and column
+	{
+		go_to();
+		return true;
+	}
+	if (ch == CTRL('T'))	// follow the file as it grows
+	{
+		toggle_follow();
+		return true;
+	}
+#if USE_TRACE
+	if (ch == KEY_F(12))	// what the time went on so far
+	{
+		status_note(Trace::dump("edit-trace.json") ? " Trace written to edit-trace.json." :
+			    " The trace could not be written.");
+		return true;
+	}
+#endif
+	if (ch == CTRL('P'))	// quick open
+	{
+		quick_open();
+		return true;
+	}
+	if (ch == CTRL('F'))	// search as you type
+	{
+		incremental_find();
+		return true;
+	}
+	if (ch == CTRL('U') || ch == CTRL('R'))	// undo, redo
+	{
+		size_t pos = (ch == CTRL('U')) ? buffer_undo() : buffer_redo();
+		if (pos == std::string::npos)
+			status_note(ch == CTRL('U') ? " Nothing to undo." : " Nothing to redo.");
+		else
+			jump_to(pos);
+		return true;
+	}
+	if (ch == KEY_F(3))	// find next
+	{
+		find_and_jump(true, cursor_offset() + 1);
+		return true;
+	}
+	if (ch == KEY_F(15))	// shift F3, find previous
+	{
+		find_and_jump(false, cursor_offset());
+		return true;
+	}
 	if (ch == '\r')
 	{
 		ch = '\n';	// handle as newline... strictly for DOS line
@@ -303,12 +1455,17 @@ bool mainloop()			// return false to quit
 	}
 	if (ch == '\n')		// Enter key (newline)
 	{
-		// Handle newline
-
-		if (useCRLF)
-			filebuf.insert(getNthDelimWithOffset(filebuf, cursor_y, 0), "\r\n");
-		else
-			filebuf.insert(getNthDelimWithOffset(filebuf, cursor_y, 0), "\n");
+		// Handle newline, splitting the line at the cursor
+		try
+		{
+			buffer_insert(buffer_offset(cursor_y, cursor_x), useCRLF ? "\r\n" : "\n");
+		}
+		catch(std::runtime_error & r)
+		{
+			show_fatal
+				("An unexpected error occured while trying to handle event \"newline\"",
+				 "Please report the issue to the issue tracker.\nDETAILS:\n" + (std::string) r.what());
+		}
 
 		cursor_y++;
 		cursor_x = 0;	// This can be changed later.
@@ -324,13 +1481,18 @@ bool mainloop()			// return false to quit
 			// Handle backspace logic
 			if (cursor_x > 0)
 			{
-				filebuf.erase(filebuf.begin() + getNthDelimWithOffset(filebuf, cursor_y, cursor_x) - 1);
+				buffer_erase(buffer_offset(cursor_y, cursor_x) - 1, 1);
 				cursor_x--;
 			}
 			else if (cursor_y > 0)	// Handle delete line
 			{
-				filebuf.erase(filebuf.begin() + getNthDelimWithOffset(filebuf, cursor_y, 0));
+				// join with the previous line, removing its
+				// line ending (LF or CRLF)
+				size_t prev_len = buffer_line_length(cursor_y - 1);
+				size_t from = buflines.start(cursor_y - 1) + prev_len;
+				buffer_erase(from, buflines.start(cursor_y) - from);
 				cursor_y--;
+				cursor_x = prev_len;
 			}
 			else	// not valid move
 			{
@@ -352,7 +1514,7 @@ bool mainloop()			// return false to quit
 	std::string unctrl_ch = std::string(unctrl(ch));
 	try
 	{
-		filebuf.insert(getNthDelimWithOffset(filebuf, cursor_y, cursor_x), unctrl_ch);
+		buffer_insert(buffer_offset(cursor_y, cursor_x), unctrl_ch);
 	}
 	catch(std::runtime_error & ex)
 	{
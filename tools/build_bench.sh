@@ -0,0 +1,33 @@
+# build_bench.sh builds ../bench directory against ../source (without main.cpp)
+# this file is in the public domain
+
+# output build file
+outputfile="../bench.exe"
+outputparam="-o"
+
+# build utility
+clexe=g++
+
+# flags for the compiler (change as you will)
+cflags="$(pkgconf ncursesw --cflags) -pthread -O2 -I../source"
+# flags for the linker (change as you will)
+lflags="$(pkgconf ncursesw --libs --static)"
+
+# no need to update anything bellow this line
+
+echo build_bench.sh
+
+flags="$cflags $lflags $@ $outputparam $outputfile "
+
+# find each c++ and c file run g++
+echo BUILDING ...
+
+# Find all source files, the editor's main() is replaced by the bench's
+source=$(find ../source ../bench -type f \( -iname "*.cpp" -o -iname "*.c" \) ! -name "main.cpp")
+
+# List of files (improved handling of spaces)
+printf "%s\n" $source
+
+$clexe $source $flags
+
+printf '\a'
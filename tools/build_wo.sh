@@ -9,7 +9,7 @@ outputparam="-o"
 clexe=g++
 
 # flags for the compiler (change as you will)
-cflags="$(pkgconf ncursesw --cflags)" 
+cflags="$(pkgconf ncursesw --cflags) -pthread" 
 # flags for the linker (change as you will)
 lflags="$(pkgconf ncursesw --libs --static)"
 